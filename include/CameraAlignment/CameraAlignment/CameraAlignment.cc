@@ -0,0 +1,253 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "CameraAlignment/CameraAlignment.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+void CameraAlignment::setup_camera_alignment(const rs2::pipeline_profile &profile, ThreadPool *thread_pool) {
+  thread_pool_ = thread_pool;
+
+  try {
+    auto color_profile = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+    auto depth_profile = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+
+    color_intrinsics_ = color_profile.get_intrinsics();
+    depth_intrinsics_ = depth_profile.get_intrinsics();
+    depth_to_color_ = depth_profile.get_extrinsics_to(color_profile);
+    color_to_depth_ = color_profile.get_extrinsics_to(depth_profile);
+    depth_stream_unique_id_ = depth_profile.unique_id();
+  } catch (const rs2::error &error) {
+    std::cerr << "Camera alignment disabled, could not read calibration: " << error.what() << std::endl;
+    is_setup_ = false;
+    return;
+  }
+
+  //! An inverse distorted image can not be projected to, the color coefficients are close to zero in that case.
+  color_projection_intrinsics_ = color_intrinsics_;
+  if (color_projection_intrinsics_.model == RS2_DISTORTION_INVERSE_BROWN_CONRADY) {
+    color_projection_intrinsics_.model = RS2_DISTORTION_NONE;
+  }
+  color_pinhole_intrinsics_ = color_intrinsics_;
+  color_pinhole_intrinsics_.model = RS2_DISTORTION_NONE;
+
+  depth_ray_lookup_table_.update(depth_intrinsics_);
+  is_setup_ = true;
+
+  std::cout << "Camera alignment: color " << color_intrinsics_.width << "x" << color_intrinsics_.height
+            << " fx " << color_intrinsics_.fx << " fy " << color_intrinsics_.fy
+            << ", depth " << depth_intrinsics_.width << "x" << depth_intrinsics_.height
+            << ", baseline " << depth_to_color_.translation[0] << " "
+            << depth_to_color_.translation[1] << " " << depth_to_color_.translation[2] << std::endl;
+}
+
+void CameraAlignment::update_depth_stream(const rs2::depth_frame &depth) {
+  if (!is_setup_) {
+    return;
+  }
+  auto depth_profile = depth.get_profile().as<rs2::video_stream_profile>();
+  if (depth_profile.unique_id() == depth_stream_unique_id_) {
+    return;
+  }
+  depth_stream_unique_id_ = depth_profile.unique_id();
+  depth_intrinsics_ = depth_profile.get_intrinsics();
+  depth_ray_lookup_table_.update(depth_intrinsics_);
+}
+
+void CameraAlignment::crop_roi(const rs2::depth_frame &depth,
+                               const cv::Rect &color_roi,
+                               float near_plane_distance_meter,
+                               float far_plane_distance_meter,
+                               pcl::PointCloud<pcl::PointXYZ> *cloud,
+                               std::vector<int> *indices) const {
+  cloud->clear();
+  indices->clear();
+
+  if (!is_setup_ || color_roi.area() <= 0 || depth.get_width() != depth_intrinsics_.width
+      || depth.get_height() != depth_intrinsics_.height) {
+    return;
+  }
+
+  const cv::Rect depth_roi = color_roi_to_depth_roi(color_roi, near_plane_distance_meter, far_plane_distance_meter);
+  if (depth_roi.empty()) {
+    return;
+  }
+
+  const auto *depth_data = reinterpret_cast<const uint16_t *>(depth.get_data());
+  const float depth_units = depth.get_units();
+  const int depth_width = depth_intrinsics_.width;
+  const cv::Rect_<float> color_roi_float(color_roi);
+
+  const size_t number_of_tasks = (depth_roi.height + rows_per_task_ - 1) / rows_per_task_;
+  if (task_scratch_.size() < number_of_tasks) {
+    task_scratch_.resize(number_of_tasks);
+  }
+
+  auto crop_rows = [&](size_t task_begin, size_t task_end) {
+    for (size_t task = task_begin; task < task_end; ++task) {
+      TaskScratch &scratch = task_scratch_.at(task);
+      scratch.points.clear();
+      scratch.indices.clear();
+      scratch.resize_span(depth_roi.width);
+      float *x = scratch.x.data();
+      float *y = scratch.y.data();
+      float *z = scratch.z.data();
+
+      const int row_begin = depth_roi.y + static_cast<int>(task) * rows_per_task_;
+      const int row_end = std::min(depth_roi.y + depth_roi.height, row_begin + rows_per_task_);
+
+      for (int v = row_begin; v < row_end; ++v) {
+        const size_t span_begin = static_cast<size_t>(v) * depth_width + depth_roi.x;
+        depth_ray_lookup_table_.back_project(depth_data,
+                                             depth_units,
+                                             span_begin,
+                                             span_begin + depth_roi.width,
+                                             x,
+                                             y,
+                                             z);
+
+        for (int i = 0; i < depth_roi.width; ++i) {
+          if (z[i] <= 0 || z[i] < near_plane_distance_meter || z[i] > far_plane_distance_meter) {
+            continue;
+          }
+
+          const float depth_point[3] = {x[i], y[i], z[i]};
+          float color_point[3];
+          float color_pixel[2];
+          rs2_transform_point_to_point(color_point, &depth_to_color_, depth_point);
+          rs2_project_point_to_pixel(color_pixel, &color_projection_intrinsics_, color_point);
+
+          if (!color_roi_float.contains(cv::Point2f(color_pixel[0], color_pixel[1]))) {
+            continue;
+          }
+          scratch.points.emplace_back(color_point[0], color_point[1], color_point[2]);
+          scratch.indices.emplace_back(static_cast<int>(span_begin) + i);
+        }
+      }
+    }
+  };
+
+  if (thread_pool_ != nullptr) {
+    thread_pool_->parallel_for(0, number_of_tasks, 1, crop_rows);
+  } else {
+    crop_rows(0, number_of_tasks);
+  }
+
+  for (size_t task = 0; task < number_of_tasks; ++task) {
+    const TaskScratch &scratch = task_scratch_.at(task);
+    cloud->points.insert(cloud->points.end(), scratch.points.begin(), scratch.points.end());
+    indices->insert(indices->end(), scratch.indices.begin(), scratch.indices.end());
+  }
+  cloud->width = cloud->points.size();
+  cloud->height = 1;
+  cloud->is_dense = true;
+}
+
+void CameraAlignment::back_project_depth(const rs2::depth_frame &depth,
+                                         pcl::PointCloud<pcl::PointXYZ> *cloud) const {
+  const int depth_width = depth_intrinsics_.width;
+  const int depth_height = depth_intrinsics_.height;
+  if (!is_setup_ || depth.get_width() != depth_width || depth.get_height() != depth_height) {
+    cloud->clear();
+    return;
+  }
+
+  cloud->resize(static_cast<size_t>(depth_width) * depth_height);
+  cloud->width = depth_width;
+  cloud->height = depth_height;
+  cloud->is_dense = false;
+
+  const auto *depth_data = reinterpret_cast<const uint16_t *>(depth.get_data());
+  const float depth_units = depth.get_units();
+  const size_t number_of_tasks = (depth_height + rows_per_task_ - 1) / rows_per_task_;
+
+  if (task_scratch_.size() < number_of_tasks) {
+    task_scratch_.resize(number_of_tasks);
+  }
+
+  auto back_project_rows = [&](size_t task_begin, size_t task_end) {
+    for (size_t task = task_begin; task < task_end; ++task) {
+      TaskScratch &scratch = task_scratch_.at(task);
+      scratch.resize_span(depth_width);
+      const float *x = scratch.x.data();
+      const float *y = scratch.y.data();
+      const float *z = scratch.z.data();
+
+      const int row_begin = static_cast<int>(task) * rows_per_task_;
+      const int row_end = std::min(depth_height, row_begin + rows_per_task_);
+
+      for (int v = row_begin; v < row_end; ++v) {
+        const size_t span_begin = static_cast<size_t>(v) * depth_width;
+        depth_ray_lookup_table_.back_project(depth_data,
+                                             depth_units,
+                                             span_begin,
+                                             span_begin + depth_width,
+                                             scratch.x.data(),
+                                             scratch.y.data(),
+                                             scratch.z.data());
+        for (int i = 0; i < depth_width; ++i) {
+          pcl::PointXYZ &point = cloud->points[span_begin + i];
+          point.x = x[i];
+          point.y = y[i];
+          point.z = z[i];
+        }
+      }
+    }
+  };
+
+  if (thread_pool_ != nullptr) {
+    thread_pool_->parallel_for(0, number_of_tasks, 1, back_project_rows);
+  } else {
+    back_project_rows(0, number_of_tasks);
+  }
+}
+
+const rs2_intrinsics &CameraAlignment::get_color_intrinsics() const {
+  return color_intrinsics_;
+}
+
+const rs2_intrinsics &CameraAlignment::get_depth_intrinsics() const {
+  return depth_intrinsics_;
+}
+
+bool CameraAlignment::is_setup() const {
+  return is_setup_;
+}
+
+cv::Rect CameraAlignment::color_roi_to_depth_roi(const cv::Rect &color_roi,
+                                                 float near_plane_distance_meter,
+                                                 float far_plane_distance_meter) const {
+  const float near_distance = std::max(near_plane_distance_meter, minimum_projection_distance_meter_);
+  const float far_distance = std::max(far_plane_distance_meter, near_distance);
+
+  const float corners[4][2] = {{static_cast<float>(color_roi.x), static_cast<float>(color_roi.y)},
+                               {static_cast<float>(color_roi.br().x), static_cast<float>(color_roi.y)},
+                               {static_cast<float>(color_roi.x), static_cast<float>(color_roi.br().y)},
+                               {static_cast<float>(color_roi.br().x), static_cast<float>(color_roi.br().y)}};
+
+  float min_u = FLT_MAX, min_v = FLT_MAX, max_u = -FLT_MAX, max_v = -FLT_MAX;
+  for (const auto &corner : corners) {
+    for (float distance : {near_distance, far_distance}) {
+      float color_point[3];
+      float depth_point[3];
+      float depth_pixel[2];
+      rs2_deproject_pixel_to_point(color_point, &color_pinhole_intrinsics_, corner, distance);
+      rs2_transform_point_to_point(depth_point, &color_to_depth_, color_point);
+      rs2_project_point_to_pixel(depth_pixel, &depth_intrinsics_, depth_point);
+
+      min_u = std::min(min_u, depth_pixel[0]);
+      min_v = std::min(min_v, depth_pixel[1]);
+      max_u = std::max(max_u, depth_pixel[0]);
+      max_v = std::max(max_v, depth_pixel[1]);
+    }
+  }
+
+  cv::Rect depth_roi(cv::Point(static_cast<int>(std::floor(min_u)) - depth_roi_margin_pixels_,
+                               static_cast<int>(std::floor(min_v)) - depth_roi_margin_pixels_),
+                     cv::Point(static_cast<int>(std::ceil(max_u)) + depth_roi_margin_pixels_,
+                               static_cast<int>(std::ceil(max_v)) + depth_roi_margin_pixels_));
+  return depth_roi & cv::Rect(0, 0, depth_intrinsics_.width, depth_intrinsics_.height);
+}
@@ -0,0 +1,85 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_CAMERAALIGNMENT_CAMERAALIGNMENT_CAMERAALIGNMENT_H_
+#define INCLUDE_CAMERAALIGNMENT_CAMERAALIGNMENT_CAMERAALIGNMENT_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <vector>
+
+#include "librealsense2/rs.hpp"
+#include "librealsense2/rsutil.h"
+#include "opencv2/opencv.hpp"
+
+#include "RayLookupTable/RayLookupTable.h"
+#include "ThreadPool/ThreadPool.h"
+
+//! Maps a color image region of interest to the depth stream using the calibration of the running device,
+//! instead of aligning the full frame. Only the depth pixels that can project into the region are visited.
+class CameraAlignment {
+ public:
+  void setup_camera_alignment(const rs2::pipeline_profile &profile, ThreadPool *thread_pool);
+
+  //! Rebuilds the depth ray lookup table if the depth stream profile of the frame has new intrinsics.
+  void update_depth_stream(const rs2::depth_frame &depth);
+
+  //! Depth points whose projection into the color image is inside color_roi. The points are returned in the
+  //! color camera frame, the indices are depth pixel indices (v * width + u) into the organized depth cloud.
+  void crop_roi(const rs2::depth_frame &depth,
+                const cv::Rect &color_roi,
+                float near_plane_distance_meter,
+                float far_plane_distance_meter,
+                pcl::PointCloud<pcl::PointXYZ> *cloud,
+                std::vector<int> *indices) const;
+
+  //! Organized cloud of the full depth frame in the depth camera frame, invalid depth gives the point (0, 0, 0).
+  void back_project_depth(const rs2::depth_frame &depth, pcl::PointCloud<pcl::PointXYZ> *cloud) const;
+
+  const rs2_intrinsics &get_color_intrinsics() const;
+
+  const rs2_intrinsics &get_depth_intrinsics() const;
+
+  bool is_setup() const;
+
+ private:
+  cv::Rect color_roi_to_depth_roi(const cv::Rect &color_roi,
+                                  float near_plane_distance_meter,
+                                  float far_plane_distance_meter) const;
+
+  static constexpr float minimum_projection_distance_meter_ = 0.1;
+  static constexpr int depth_roi_margin_pixels_ = 2;
+  static constexpr int rows_per_task_ = 16;
+
+  rs2_intrinsics color_intrinsics_{};
+  rs2_intrinsics depth_intrinsics_{};
+  rs2_intrinsics color_projection_intrinsics_{};
+  rs2_intrinsics color_pinhole_intrinsics_{};
+  rs2_extrinsics depth_to_color_{};
+  rs2_extrinsics color_to_depth_{};
+
+  //! Buffers of one row task, kept between frames so the crop does not allocate in steady state.
+  struct TaskScratch {
+    pcl::PointCloud<pcl::PointXYZ>::VectorType points;
+    std::vector<int> indices;
+    CacheAlignedFloatBuffer x;
+    CacheAlignedFloatBuffer y;
+    CacheAlignedFloatBuffer z;
+
+    void resize_span(int width) {
+      x.resize(width);
+      y.resize(width);
+      z.resize(width);
+    }
+  };
+
+  RayLookupTable depth_ray_lookup_table_;
+  mutable std::vector<TaskScratch> task_scratch_;  //! Only used from the calling thread and its pool tasks.
+  int depth_stream_unique_id_ = -1;
+
+  ThreadPool *thread_pool_ = nullptr;
+  bool is_setup_ = false;
+};
+
+#endif  // INCLUDE_CAMERAALIGNMENT_CAMERAALIGNMENT_CAMERAALIGNMENT_H_
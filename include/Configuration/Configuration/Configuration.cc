@@ -0,0 +1,354 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "Configuration/Configuration.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+
+namespace {
+
+//! Converts one JSON value. Returns false and leaves value untouched on the wrong type or out of range.
+template<typename T>
+bool parse_value(const Json::Value &entry, T *value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    if (!entry.isBool()) {
+      return false;
+    }
+    *value = entry.asBool();
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    if (!entry.isString()) {
+      return false;
+    }
+    *value = entry.asString();
+  } else if constexpr (std::is_floating_point_v<T>) {
+    if (!entry.isNumeric()) {
+      return false;
+    }
+    *value = static_cast<T>(entry.asDouble());
+  } else if constexpr (std::is_unsigned_v<T>) {
+    if (!entry.isUInt64() || entry.asUInt64() > std::numeric_limits<T>::max()) {
+      return false;
+    }
+    *value = static_cast<T>(entry.asUInt64());
+  } else {
+    if (!entry.isInt64() || entry.asInt64() < std::numeric_limits<T>::min()
+        || entry.asInt64() > std::numeric_limits<T>::max()) {
+      return false;
+    }
+    *value = static_cast<T>(entry.asInt64());
+  }
+  return true;
+}
+
+bool parse_value(const Json::Value &entry, std::vector<int> *value) {
+  if (!entry.isArray()) {
+    return false;
+  }
+  std::vector<int> values;
+  for (const auto &element : entry) {
+    if (!element.isInt()) {
+      return false;
+    }
+    values.emplace_back(element.asInt());
+  }
+  *value = values;
+  return true;
+}
+
+bool parse_value(const Json::Value &entry, std::vector<SourceSettings> *value) {
+  if (!entry.isArray()) {
+    return false;
+  }
+  std::vector<SourceSettings> sources;
+  for (const auto &element : entry) {
+    SourceSettings source;
+    if (!element.isObject()
+        || (element.isMember("name") && !parse_value(element["name"], &source.name))
+        || (element.isMember("serial_number") && !parse_value(element["serial_number"], &source.serial_number))
+        || (element.isMember("rosbag_relative_path")
+            && !parse_value(element["rosbag_relative_path"], &source.rosbag_relative_path))) {
+      return false;
+    }
+    sources.emplace_back(source);
+  }
+  *value = sources;
+  return true;
+}
+
+//! Reads the keys of one parse. Missing keys keep their defaults, invalid values are reported by key and keep theirs
+//! as well.
+class ValueReader {
+ public:
+  explicit ValueReader(bool report_errors) : report_errors_(report_errors) {}
+
+  template<typename T>
+  void read(const Json::Value &section, const char *key, T *value) {
+    if (!section.isObject() || !section.isMember(key) || parse_value(section[key], value)) {
+      return;
+    }
+    valid_ = false;
+    if (report_errors_) {
+      Json::StreamWriterBuilder writer_builder;
+      writer_builder["indentation"] = "";
+      std::cerr << "Configuration: invalid value for \"" << key << "\": "
+                << Json::writeString(writer_builder, section[key]) << std::endl;
+    }
+  }
+
+  bool is_valid() const {
+    return valid_;
+  }
+
+ private:
+  bool report_errors_;
+  bool valid_ = true;
+};
+
+}  // namespace
+
+bool Configuration::load_configuration(const std::string &path) {
+  path_ = path;
+  Json::Value root;
+
+  std::error_code error;
+  const std::filesystem::file_time_type write_time = std::filesystem::last_write_time(path_, error);
+  if (!read_configuration_file(&root)) {
+    std::cerr << "Using default configuration" << std::endl;
+    return false;
+  }
+
+  bool valid = parse_settings(root, &settings_);
+
+  auto tunable_settings = std::make_shared<TunableSettings>();
+  valid &= parse_tunable_settings(root, tunable_settings.get());
+  std::atomic_store(&tunable_settings_, std::shared_ptr<const TunableSettings>(tunable_settings));
+  last_write_time_ = write_time;
+
+  if (!valid) {
+    std::cerr << "Loaded configuration with invalid values, their defaults are used: " << path_ << std::endl;
+    return false;
+  }
+  std::cout << "Loaded configuration: " << path_ << std::endl;
+  return true;
+}
+
+const Settings &Configuration::get_settings() const {
+  return settings_;
+}
+
+std::shared_ptr<const TunableSettings> Configuration::get_tunable_settings() const {
+  return std::atomic_load(&tunable_settings_);
+}
+
+bool Configuration::reload_tunable_settings_if_changed() {
+  std::unique_lock<std::mutex> lock(reload_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;
+  }
+
+  std::error_code error;
+  auto write_time = std::filesystem::last_write_time(path_, error);
+  if (error || write_time == last_write_time_) {
+    return false;
+  }
+
+  //! A failed edit is retried on every check until the file parses, but only reported once.
+  const bool report_errors = write_time != failed_write_time_;
+  failed_write_time_ = write_time;
+
+  Json::Value root;
+  if (!read_configuration_file(&root, report_errors)) {
+    return false;
+  }
+
+  auto tunable_settings = std::make_shared<TunableSettings>(*get_tunable_settings());
+  if (!parse_tunable_settings(root, tunable_settings.get(), report_errors)) {
+    if (report_errors) {
+      std::cerr << "Keeping the previous tunable configuration, fix the invalid values in: " << path_ << std::endl;
+    }
+    return false;
+  }
+  std::atomic_store(&tunable_settings_, std::shared_ptr<const TunableSettings>(tunable_settings));
+  last_write_time_ = write_time;
+
+  std::cout << "Reloaded tunable configuration: " << path_ << std::endl;
+  return true;
+}
+
+bool Configuration::read_configuration_file(Json::Value *root, bool report_errors) {
+  std::ifstream configuration_file(path_);
+  if (!configuration_file.is_open()) {
+    if (report_errors) {
+      std::cerr << "Could not open configuration file: " << path_ << std::endl;
+    }
+    return false;
+  }
+
+  Json::CharReaderBuilder reader_builder;
+  std::string errors;
+  if (!Json::parseFromStream(reader_builder, configuration_file, root, &errors)) {
+    if (report_errors) {
+      std::cerr << "Could not parse configuration file: " << errors << std::endl;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool Configuration::parse_settings(const Json::Value &root, Settings *settings, bool report_errors) {
+  ValueReader reader(report_errors);
+  const Json::Value &capture = root["capture"];
+  reader.read(capture, "load_from_rosbag", &settings->load_from_rosbag);
+  reader.read(capture, "single_run", &settings->single_run);
+  reader.read(capture, "rosbag_relative_path", &settings->rosbag_relative_path);
+  reader.read(capture, "sources", &settings->sources);
+  reader.read(capture, "color_format", &settings->capture_color_format);
+  reader.read(capture, "color_width", &settings->capture_color_width);
+  reader.read(capture, "color_height", &settings->capture_color_height);
+  reader.read(capture, "color_fps", &settings->capture_color_fps);
+
+  const Json::Value &object_detection = root["object_detection"];
+  reader.read(object_detection, "model_relative_path", &settings->object_detection_model_relative_path);
+  reader.read(object_detection, "int8_model_relative_path", &settings->object_detection_int8_model_relative_path);
+  reader.read(object_detection, "model_precision", &settings->object_detection_model_precision);
+  reader.read(object_detection, "input_precision", &settings->object_detection_input_precision);
+  reader.read(object_detection, "inference_device_name", &settings->inference_device_name);
+  reader.read(object_detection, "number_of_classes", &settings->number_of_classes);
+  reader.read(object_detection, "network_input_width", &settings->network_input_width);
+  reader.read(object_detection, "network_input_height", &settings->network_input_height);
+  reader.read(object_detection, "model_cache_relative_path", &settings->model_cache_relative_path);
+  reader.read(object_detection, "shared_detector_batch_timeout_ms", &settings->shared_detector_batch_timeout_ms);
+
+  const Json::Value &pose_estimation = root["pose_estimation"];
+  reader.read(pose_estimation, "april_tag_marker_length_meter", &settings->april_tag_marker_length_meter);
+  reader.read(pose_estimation, "enable_roi_alignment", &settings->enable_roi_alignment);
+  reader.read(pose_estimation, "pallet_face_solver", &settings->pallet_face_solver);
+
+  const Json::Value &aruco = root["aruco"];
+  reader.read(aruco, "evaluation_mode", &settings->aruco_evaluation_mode);
+  reader.read(aruco, "roi_margin_ratio", &settings->aruco_roi_margin_ratio);
+  reader.read(aruco, "adaptive_threshold_window_min", &settings->aruco_adaptive_threshold_window_min);
+  reader.read(aruco, "adaptive_threshold_window_max", &settings->aruco_adaptive_threshold_window_max);
+  reader.read(aruco, "adaptive_threshold_window_step", &settings->aruco_adaptive_threshold_window_step);
+
+  const Json::Value &ground_plane = root["ground_plane"];
+  reader.read(ground_plane, "enable_prior", &settings->enable_ground_plane_prior);
+  reader.read(ground_plane, "calibration_relative_path", &settings->ground_plane_calibration_relative_path);
+  reader.read(ground_plane, "calibration_frames", &settings->ground_plane_calibration_frames);
+  reader.read(ground_plane, "maximum_tilt_radians", &settings->ground_plane_maximum_tilt_radians);
+  reader.read(ground_plane, "force_calibration", &settings->ground_plane_force_calibration);
+
+  const Json::Value &pose_filter = root["pose_filter"];
+  reader.read(pose_filter, "enable", &settings->enable_pose_filter);
+
+  const Json::Value &pose_export = root["pose_export"];
+  reader.read(pose_export, "enable", &settings->enable_pose_export);
+  reader.read(pose_export, "shared_memory_name", &settings->pose_export_shared_memory_name);
+  reader.read(pose_export, "preview_format", &settings->pose_export_preview_format);
+  reader.read(pose_export, "preview_width", &settings->pose_export_preview_width);
+  reader.read(pose_export, "preview_jpeg_quality", &settings->pose_export_preview_jpeg_quality);
+
+  const Json::Value &frame_recorder = root["frame_recorder"];
+  reader.read(frame_recorder, "enable", &settings->enable_frame_recorder);
+  reader.read(frame_recorder, "buffer_seconds", &settings->frame_recorder_buffer_seconds);
+  reader.read(frame_recorder, "directory_relative_path", &settings->frame_recorder_directory_relative_path);
+  reader.read(frame_recorder, "minimum_seconds_between_captures",
+              &settings->frame_recorder_minimum_seconds_between_captures);
+  reader.read(frame_recorder, "trigger_invalid_pose_frames", &settings->frame_recorder_trigger_invalid_pose_frames);
+
+  const Json::Value &latency = root["latency"];
+  reader.read(latency, "enable_global_time", &settings->latency_enable_global_time);
+  reader.read(latency, "report_interval_frames", &settings->latency_report_interval_frames);
+
+  const Json::Value &thread_pool = root["thread_pool"];
+  reader.read(thread_pool, "number_of_threads", &settings->thread_pool_number_of_threads);
+  reader.read(thread_pool, "pin_threads", &settings->thread_pool_pin_threads);
+  reader.read(thread_pool, "core_ids", &settings->thread_pool_core_ids);
+
+  const Json::Value &visualization = root["visualization"];
+  reader.read(visualization, "enable", &settings->enable_visualization);
+
+  const Json::Value &logger = root["logger"];
+  reader.read(logger, "enable_logger", &settings->enable_logger);
+  reader.read(logger, "enable_debug_mode", &settings->enable_debug_mode);
+  reader.read(logger, "file_save_relative_path", &settings->logger_file_save_relative_path);
+  reader.read(logger, "debug_print_after_seconds", &settings->debug_print_after_seconds);
+
+  const Json::Value &configuration = root["configuration"];
+  reader.read(configuration, "reload_check_interval_frames", &settings->configuration_reload_check_interval_frames);
+  return reader.is_valid();
+}
+
+bool Configuration::parse_tunable_settings(const Json::Value &root, TunableSettings *tunable_settings,
+                                           bool report_errors) {
+  ValueReader reader(report_errors);
+  const Json::Value &object_detection = root["object_detection"];
+  reader.read(object_detection, "nms_threshold", &tunable_settings->object_detection_nms_threshold);
+  reader.read(object_detection, "bbox_conf_threshold", &tunable_settings->object_detection_bbox_conf_threshold);
+  reader.read(object_detection, "minimum_width_pixels", &tunable_settings->minimum_object_detection_width_pixels);
+  reader.read(object_detection, "minimum_height_pixels", &tunable_settings->minimum_object_detection_height_pixels);
+
+  const Json::Value &pose_estimation = root["pose_estimation"];
+  reader.read(pose_estimation, "frustum_filter_near_plane_distance_meter",
+              &tunable_settings->pcl_frustum_filter_near_plane_distance_meter);
+  reader.read(pose_estimation, "frustum_filter_far_plane_distance_meter",
+              &tunable_settings->pcl_frustum_filter_far_plane_distance_meter);
+  reader.read(pose_estimation, "ransac_eps_angle_radians", &tunable_settings->ransac_eps_angle_radians);
+  reader.read(pose_estimation, "ransac_max_iterations", &tunable_settings->ransac_max_iterations);
+  reader.read(pose_estimation, "first_ransac_distance_threshold_meter",
+              &tunable_settings->first_ransac_distance_threshold_meter);
+  reader.read(pose_estimation, "second_ransac_distance_threshold_meter",
+              &tunable_settings->second_ransac_distance_threshold_meter);
+  reader.read(pose_estimation, "sample_surface_normal_sample_size",
+              &tunable_settings->sample_surface_normal_sample_size);
+  reader.read(pose_estimation, "sample_surface_normal_ratio", &tunable_settings->sample_surface_normal_ratio);
+  reader.read(pose_estimation, "minimum_points_for_ransac", &tunable_settings->minimum_points_for_ransac);
+  reader.read(pose_estimation, "minimum_points_for_sampling_surface_normals",
+              &tunable_settings->minimum_points_for_sampling_surface_normals);
+  reader.read(pose_estimation, "maximum_iterations_for_segmentation",
+              &tunable_settings->maximum_iterations_for_segmentation);
+  reader.read(pose_estimation, "segmentation_distance_threshold_meter",
+              &tunable_settings->segmentation_distance_threshold_meter);
+  reader.read(pose_estimation, "segmentation_eps_angle_radians", &tunable_settings->segmentation_eps_angle_radians);
+  reader.read(pose_estimation, "pallet_face_ransac_iterations", &tunable_settings->pallet_face_ransac_iterations);
+  reader.read(pose_estimation, "pallet_face_distance_threshold_meter",
+              &tunable_settings->pallet_face_distance_threshold_meter);
+  reader.read(pose_estimation, "pallet_face_refinement_iterations",
+              &tunable_settings->pallet_face_refinement_iterations);
+
+  const Json::Value &ground_plane = root["ground_plane"];
+  reader.read(ground_plane, "verification_sample_size", &tunable_settings->ground_plane_verification_sample_size);
+  reader.read(ground_plane, "verification_distance_threshold_meter",
+              &tunable_settings->ground_plane_verification_distance_threshold_meter);
+  reader.read(ground_plane, "minimum_inlier_ratio", &tunable_settings->ground_plane_minimum_inlier_ratio);
+  reader.read(ground_plane, "stable_angle_radians", &tunable_settings->ground_plane_stable_angle_radians);
+  reader.read(ground_plane, "stable_distance_meter", &tunable_settings->ground_plane_stable_distance_meter);
+  reader.read(ground_plane, "recalibration_failed_frames",
+              &tunable_settings->ground_plane_recalibration_failed_frames);
+
+  const Json::Value &pose_filter = root["pose_filter"];
+  reader.read(pose_filter, "process_noise_acceleration", &tunable_settings->pose_filter_process_noise_acceleration);
+  reader.read(pose_filter, "process_noise_yaw_acceleration",
+              &tunable_settings->pose_filter_process_noise_yaw_acceleration);
+  reader.read(pose_filter, "measurement_noise_position_meter",
+              &tunable_settings->pose_filter_measurement_noise_position_meter);
+  reader.read(pose_filter, "measurement_noise_yaw_radians",
+              &tunable_settings->pose_filter_measurement_noise_yaw_radians);
+  reader.read(pose_filter, "gate_threshold", &tunable_settings->pose_filter_gate_threshold);
+  reader.read(pose_filter, "maximum_consecutive_rejections",
+              &tunable_settings->pose_filter_maximum_consecutive_rejections);
+  reader.read(pose_filter, "maximum_prediction_horizon_seconds",
+              &tunable_settings->pose_filter_maximum_prediction_horizon_seconds);
+
+  const Json::Value &pose_quality = root["pose_quality"];
+  reader.read(pose_quality, "distance_threshold_meter", &tunable_settings->pose_quality_distance_threshold_meter);
+  reader.read(pose_quality, "full_confidence_roi_points", &tunable_settings->pose_quality_full_confidence_roi_points);
+  reader.read(pose_quality, "maximum_plane_angle_deviation_radians",
+              &tunable_settings->pose_quality_maximum_plane_angle_deviation_radians);
+  reader.read(pose_quality, "minimum_confidence", &tunable_settings->minimum_pose_confidence);
+  return reader.is_valid();
+}
@@ -0,0 +1,191 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_CONFIGURATION_CONFIGURATION_CONFIGURATION_H_
+#define INCLUDE_CONFIGURATION_CONFIGURATION_CONFIGURATION_H_
+
+#include <jsoncpp/json/json.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! Non-structural parameters. These can be swapped at runtime without restarting the pipeline.
+struct TunableSettings {
+  float object_detection_nms_threshold = 0.3;
+  float object_detection_bbox_conf_threshold = 0.1;
+  uint16_t minimum_object_detection_width_pixels = 10;
+  uint16_t minimum_object_detection_height_pixels = 10;
+
+  float pcl_frustum_filter_near_plane_distance_meter = 0;
+  float pcl_frustum_filter_far_plane_distance_meter = 15;
+
+  double ransac_eps_angle_radians = 0.1;
+  uint16_t ransac_max_iterations = 50;
+  double first_ransac_distance_threshold_meter = 0.001;
+  double second_ransac_distance_threshold_meter = 0.0001;
+
+  uint16_t sample_surface_normal_sample_size = 50;
+  float sample_surface_normal_ratio = 0.5;
+
+  uint16_t minimum_points_for_ransac = 10;
+  uint16_t minimum_points_for_sampling_surface_normals = 10;
+
+  uint16_t maximum_iterations_for_segmentation = 500;
+  double segmentation_distance_threshold_meter = 0.1;
+  double segmentation_eps_angle_radians = 0.1;
+
+  uint16_t ground_plane_verification_sample_size = 256;
+  double ground_plane_verification_distance_threshold_meter = 0.02;
+  double ground_plane_minimum_inlier_ratio = 0.3;
+  double ground_plane_stable_angle_radians = 0.05;
+  double ground_plane_stable_distance_meter = 0.02;
+  uint16_t ground_plane_recalibration_failed_frames = 10;  //! Consecutive failed verifications before recalibrating.
+
+  uint16_t pallet_face_ransac_iterations = 50;
+  double pallet_face_distance_threshold_meter = 0.02;
+  uint16_t pallet_face_refinement_iterations = 5;
+
+  double pose_filter_process_noise_acceleration = 0.5;
+  double pose_filter_process_noise_yaw_acceleration = 0.5;
+  double pose_filter_measurement_noise_position_meter = 0.02;
+  double pose_filter_measurement_noise_yaw_radians = 0.05;
+  double pose_filter_gate_threshold = 13.28;  //! Chi-square, 4 degrees of freedom, 99 %.
+  uint16_t pose_filter_maximum_consecutive_rejections = 5;
+  double pose_filter_maximum_prediction_horizon_seconds = 0.5;
+
+  double pose_quality_distance_threshold_meter = 0.02;
+  uint32_t pose_quality_full_confidence_roi_points = 500;
+  double pose_quality_maximum_plane_angle_deviation_radians = 0.35;
+  float minimum_pose_confidence = 0.1;  //! Poses below are rejected before the pose filter, 0 keeps all.
+};
+
+//! One camera of a multi camera setup.
+struct SourceSettings {
+  std::string name;  //! Tags the results and suffixes the per camera files, e.g. front or rear.
+  std::string serial_number;  //! Live device to open, empty opens the first one found.
+  std::string rosbag_relative_path;  //! Recording used with load_from_rosbag, empty uses the capture default.
+};
+
+//! Structural parameters. Parsed once at startup and immutable afterwards.
+struct Settings {
+  //! Capture
+  bool load_from_rosbag = true;  //! Select if input should be recorder rosbag or direct from camera.
+  bool single_run = true;
+  std::string rosbag_relative_path =
+      "data/20220327_162128_2meter_with_light_standing_aruco_90_deg_slow_move.bag";
+  std::vector<SourceSettings> sources;  //! Two or more runs one pipeline per camera with a shared detector.
+  //! Color stream requested from live cameras, recordings keep the recorded one. 0 leaves it to the device.
+  std::string capture_color_format = "BGR8";  //! BGR8 or RGB8.
+  uint16_t capture_color_width = 0;
+  uint16_t capture_color_height = 0;
+  uint16_t capture_color_fps = 0;
+
+  //! Object detection
+  std::string object_detection_model_relative_path =
+      "models/yolox_s_only_pallet_294epoch_o10/yolox_s_only_pallet_294epoch_o10.xml";
+  std::string object_detection_int8_model_relative_path =
+      "models/yolox_s_only_pallet_294epoch_o10/yolox_s_only_pallet_294epoch_o10_int8.xml";
+  std::string object_detection_model_precision = "FP32";  //! FP32 or INT8, selects which of the two models is loaded.
+  std::string object_detection_input_precision = "FP32";  //! FP32, or U8 for a U8 NHWC input converted by the plugin.
+  std::string inference_device_name = "CPU";
+  uint16_t number_of_classes = 1;
+  uint16_t network_input_width = 640;  //! Multiple of 32, e.g. 640x384 fits a 16:9 frame with little padding.
+  uint16_t network_input_height = 640;
+  std::string model_cache_relative_path = "models/cache";  //! Compiled network cache, empty disables it.
+  uint32_t shared_detector_batch_timeout_ms = 15;  //! Longest wait for the other cameras before a partial batch.
+
+  //! Pose estimation
+  float april_tag_marker_length_meter = 0.535;
+  bool enable_roi_alignment = true;  //! Crop by mapping the detection from color to depth instead of the frustum filter.
+  std::string pallet_face_solver = "PCL";  //! PCL or GROUND_CONSTRAINED, selects how the second plane is fitted.
+
+  //! Aruco
+  std::string aruco_evaluation_mode = "TRACKED";  //! FULL_FRAME, or TRACKED for a region search on its own thread.
+  float aruco_roi_margin_ratio = 0.5;  //! Search region margin, relative to the last marker size.
+  uint16_t aruco_adaptive_threshold_window_min = 7;
+  uint16_t aruco_adaptive_threshold_window_max = 17;
+  uint16_t aruco_adaptive_threshold_window_step = 10;
+
+  //! Ground plane
+  bool enable_ground_plane_prior = false;  //! Verify a calibrated floor plane instead of fitting it every frame.
+  std::string ground_plane_calibration_relative_path = "config/ground_plane_calibration.json";
+  uint16_t ground_plane_calibration_frames = 30;
+  double ground_plane_maximum_tilt_radians = 0.5;  //! Of the floor normal from the camera y axis.
+  bool ground_plane_force_calibration = false;  //! Ignore the file on disk and calibrate again.
+
+  //! Pose filter
+  bool enable_pose_filter = true;
+
+  //! Pose export
+  bool enable_pose_export = false;  //! Publish poses and a preview image to shared memory for other processes.
+  std::string pose_export_shared_memory_name = "/realtime_pose_estimation";
+  std::string pose_export_preview_format = "JPEG";  //! NONE, JPEG or RAW.
+  uint16_t pose_export_preview_width = 320;
+  uint8_t pose_export_preview_jpeg_quality = 70;
+
+  bool enable_frame_recorder = false;  //! Keep the last frames in memory and write them to a file on a trigger.
+  float frame_recorder_buffer_seconds = 3;
+  std::string frame_recorder_directory_relative_path = "log/captures";
+  float frame_recorder_minimum_seconds_between_captures = 10;
+  //! Consecutive frames with a detection but no pose, or a pose below minimum_pose_confidence. 0 disables.
+  uint32_t frame_recorder_trigger_invalid_pose_frames = 30;
+
+  //! Latency
+  bool latency_enable_global_time = true;  //! Map the device clock of live cameras to the host clock.
+  uint32_t latency_report_interval_frames = 300;  //! Prints the latency histograms, 0 disables.
+
+  //! Thread pool
+  uint16_t thread_pool_number_of_threads = 4;
+  bool thread_pool_pin_threads = false;
+  std::vector<int> thread_pool_core_ids = {0, 1, 2, 3};
+
+  //! Visualization
+  bool enable_visualization = true;  //! OpenCV and PCL windows. Off for headless runs such as parameter_sweep.
+
+  //! Logging
+  bool enable_logger = true;
+  bool enable_debug_mode = false;
+  std::string logger_file_save_relative_path = "log/data_out.csv";
+  uint64_t debug_print_after_seconds = 5;
+
+  //! Configuration
+  uint32_t configuration_reload_check_interval_frames = 30;
+};
+
+class Configuration {
+ public:
+  //! Returns false if the file could not be read or has invalid values, which keep their defaults.
+  bool load_configuration(const std::string &path);
+
+  const Settings &get_settings() const;
+
+  //! One atomic load. Hold the returned pointer for the duration of a frame.
+  std::shared_ptr<const TunableSettings> get_tunable_settings() const;
+
+  //! Re-parses the file if it changed on disk and swaps in the tunable part. Structural changes are ignored. A file
+  //! that does not parse, or has an invalid value, keeps the previous settings and is tried again on the next call.
+  //! Safe to call from several threads, a call made while another one is reloading returns false at once.
+  bool reload_tunable_settings_if_changed();
+
+ private:
+  bool read_configuration_file(Json::Value *root, bool report_errors = true);
+
+  //! Both return false if a value was invalid, the other values are still read.
+  static bool parse_settings(const Json::Value &root, Settings *settings, bool report_errors = true);
+
+  static bool parse_tunable_settings(const Json::Value &root, TunableSettings *tunable_settings,
+                                     bool report_errors = true);
+
+  std::string path_;
+  Settings settings_;
+  std::shared_ptr<const TunableSettings> tunable_settings_ = std::make_shared<const TunableSettings>();
+  std::mutex reload_mutex_;  //! Guards the write times, every camera checks for changes.
+  std::filesystem::file_time_type last_write_time_;  //! Of the last file that was applied.
+  std::filesystem::file_time_type failed_write_time_;  //! Of the last file that was reported as invalid.
+};
+
+#endif  // INCLUDE_CONFIGURATION_CONFIGURATION_CONFIGURATION_H_
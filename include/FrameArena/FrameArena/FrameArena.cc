@@ -0,0 +1,27 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "FrameArena/FrameArena.h"
+
+pcl::PointIndices::Ptr FrameArena::acquire_point_indices() {
+  return point_indices_.acquire();
+}
+
+pcl::ModelCoefficients::Ptr FrameArena::acquire_model_coefficients() {
+  return model_coefficients_.acquire();
+}
+
+pcl::IndicesPtr FrameArena::acquire_indices() {
+  return indices_.acquire();
+}
+
+size_t FrameArena::reset() {
+  return xyz_clouds_.reset() + xyzrgb_clouds_.reset() + normal_clouds_.reset() + point_indices_.reset()
+      + model_coefficients_.reset() + indices_.reset();
+}
+
+size_t FrameArena::get_number_of_buffers() const {
+  return xyz_clouds_.get_number_of_slots() + xyzrgb_clouds_.get_number_of_slots()
+      + normal_clouds_.get_number_of_slots() + point_indices_.get_number_of_slots()
+      + model_coefficients_.get_number_of_slots() + indices_.get_number_of_slots();
+}
@@ -0,0 +1,116 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_FRAMEARENA_FRAMEARENA_FRAMEARENA_H_
+#define INCLUDE_FRAMEARENA_FRAMEARENA_FRAMEARENA_H_
+
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+#include <pcl/pcl_base.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstddef>
+#include <vector>
+
+//! Emptying keeps the allocated capacity, so a recycled buffer is filled again without touching the heap.
+template<typename PointT>
+void clear_keep_capacity(pcl::PointCloud<PointT> *cloud) {
+  cloud->clear();  //! Clears the Eigen aligned point vector, width and height.
+  cloud->is_dense = true;
+}
+
+inline void clear_keep_capacity(pcl::PointIndices *indices) {
+  indices->indices.clear();
+}
+
+inline void clear_keep_capacity(pcl::ModelCoefficients *coefficients) {
+  coefficients->values.clear();
+}
+
+inline void clear_keep_capacity(std::vector<int> *indices) {
+  indices->clear();
+}
+
+//! Recycles shared buffers of one type. A slot is free when the pool holds the only reference to it, so a buffer
+//! that is still kept by a member from an earlier frame is never handed out twice.
+template<typename T, typename Ptr = typename T::Ptr>
+class FramePool {
+ public:
+  Ptr acquire() {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      Ptr &slot = slots_.at((next_slot_ + i) % slots_.size());
+      if (slot.use_count() == 1) {
+        next_slot_ = (next_slot_ + i + 1) % slots_.size();
+        clear_keep_capacity(slot.get());
+        return slot;
+      }
+    }
+    slots_.emplace_back(new T);
+    new_slots_this_frame_++;
+    return slots_.back();
+  }
+
+  //! Returns the number of slots that had to be added since the last reset.
+  size_t reset() {
+    size_t new_slots = new_slots_this_frame_;
+    new_slots_this_frame_ = 0;
+    return new_slots;
+  }
+
+  size_t get_number_of_slots() const {
+    return slots_.size();
+  }
+
+ private:
+  std::vector<Ptr> slots_;
+  size_t next_slot_ = 0;
+  size_t new_slots_this_frame_ = 0;
+};
+
+//! Per frame buffers of the point cloud stages. The buffers are acquired from the arena instead of allocated,
+//! and the arena is reset at the end of every frame. Not thread safe, acquire on the pose estimation thread.
+//! Only the arena's own buffers are recycled and counted. A recycled buffer still reallocates when a frame needs more
+//! points than it held before, and the PCL stages allocate internally, e.g. SACSegmentation and
+//! SamplingSurfaceNormal, so a frame is not free of heap allocations.
+class FrameArena {
+ public:
+  template<typename PointT>
+  typename pcl::PointCloud<PointT>::Ptr acquire_cloud();
+
+  pcl::PointIndices::Ptr acquire_point_indices();
+
+  pcl::ModelCoefficients::Ptr acquire_model_coefficients();
+
+  pcl::IndicesPtr acquire_indices();
+
+  //! Ends the frame. Returns how many new buffers the arena had to create during it, zero in steady state.
+  size_t reset();
+
+  size_t get_number_of_buffers() const;
+
+ private:
+  FramePool<pcl::PointCloud<pcl::PointXYZ>> xyz_clouds_;
+  FramePool<pcl::PointCloud<pcl::PointXYZRGB>> xyzrgb_clouds_;
+  FramePool<pcl::PointCloud<pcl::PointNormal>> normal_clouds_;
+  FramePool<pcl::PointIndices> point_indices_;
+  FramePool<pcl::ModelCoefficients> model_coefficients_;
+  FramePool<std::vector<int>, pcl::IndicesPtr> indices_;
+};
+
+template<>
+inline pcl::PointCloud<pcl::PointXYZ>::Ptr FrameArena::acquire_cloud<pcl::PointXYZ>() {
+  return xyz_clouds_.acquire();
+}
+
+template<>
+inline pcl::PointCloud<pcl::PointXYZRGB>::Ptr FrameArena::acquire_cloud<pcl::PointXYZRGB>() {
+  return xyzrgb_clouds_.acquire();
+}
+
+template<>
+inline pcl::PointCloud<pcl::PointNormal>::Ptr FrameArena::acquire_cloud<pcl::PointNormal>() {
+  return normal_clouds_.acquire();
+}
+
+#endif  // INCLUDE_FRAMEARENA_FRAMEARENA_FRAMEARENA_H_
@@ -0,0 +1,92 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_FRAMERECORDER_FRAMERECORDER_CAPTURELAYOUT_H_
+#define INCLUDE_FRAMERECORDER_FRAMERECORDER_CAPTURELAYOUT_H_
+
+#include <cstdint>
+#include <type_traits>
+
+//! File format of a retroactive capture, made to be memory mapped by a reader. The file starts with a FileHeader,
+//! followed by number_of_frames frames of frame_stride_bytes each, starting at frames_offset_bytes. Every frame is a
+//! FrameRecord, the raw color image at color_offset_bytes and the raw depth image at depth_offset_bytes, both
+//! relative to the start of the frame. Only depends on the standard library. Any change to the structs below must
+//! increase layout_version.
+namespace capture {
+
+constexpr uint32_t magic = 0x43415031;  //! "CAP1"
+constexpr uint32_t layout_version = 3;
+constexpr uint64_t alignment_bytes = 64;
+
+enum TriggerReason : uint32_t {
+  kApi = 0,
+  kSignal = 1,
+  kPoseQuality = 2,
+};
+
+enum FrameFlags : uint32_t {
+  kPoseValid = 1 << 0,
+  kFilteredPoseValid = 1 << 1,
+};
+
+struct StreamInfo {
+  uint32_t width;
+  uint32_t height;
+  uint32_t bytes_per_pixel;
+  uint32_t format;  //! rs2_format.
+  uint32_t fps;
+  uint32_t distortion_model;  //! rs2_distortion.
+  float fx;
+  float fy;
+  float ppx;
+  float ppy;
+  float coefficients[5];
+};
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t layout_version;
+  uint32_t trigger_reason;
+  uint32_t number_of_frames;
+  uint64_t trigger_frame_number;  //! Last frame before the trigger.
+  double trigger_time_seconds;  //! System clock, seconds since epoch.
+  uint64_t frames_offset_bytes;
+  uint64_t frame_stride_bytes;
+  uint64_t color_offset_bytes;
+  uint64_t depth_offset_bytes;
+  float depth_units;  //! Meter per depth unit.
+  uint32_t source_id;
+  StreamInfo color;
+  StreamInfo depth;
+  float depth_to_color_rotation[9];  //! Column major, as rs2_extrinsics.
+  float depth_to_color_translation[3];
+};
+
+struct FrameRecord {
+  uint64_t frame_number;
+  double color_timestamp_seconds;
+  double depth_timestamp_seconds;
+  double sensor_time_seconds;  //! Exposure on the system clock, 0 when unmapped.
+  uint32_t flags;
+  uint16_t detection_box[4];  //! x, y, width, height of the detection the pose was estimated from.
+  float detection_confidence;
+  float position[3];
+  float direction[3];
+  float yaw_radians;
+  float filtered_position[3];
+  float filtered_yaw_radians;
+  float pose_confidence;
+  uint32_t roi_points;
+  float latency_seconds;  //! From the exposure to the pose being published.
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader>, "FileHeader is copied into the mapped file");
+static_assert(std::is_trivially_copyable_v<FrameRecord>, "FrameRecord is copied into the mapped file");
+
+constexpr uint64_t align(uint64_t bytes) {
+  return (bytes + alignment_bytes - 1) / alignment_bytes * alignment_bytes;
+}
+
+}  // namespace capture
+
+#endif  // INCLUDE_FRAMERECORDER_FRAMERECORDER_CAPTURELAYOUT_H_
@@ -0,0 +1,328 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "FrameRecorder/FrameRecorder.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+
+constexpr double milliseconds_per_second = 1000;
+
+uint32_t bytes_per_pixel(rs2_format format) {
+  switch (format) {
+    case RS2_FORMAT_Y8:
+      return 1;
+    case RS2_FORMAT_Z16:
+    case RS2_FORMAT_Y16:
+    case RS2_FORMAT_YUYV:
+    case RS2_FORMAT_UYVY:
+      return 2;
+    case RS2_FORMAT_RGB8:
+    case RS2_FORMAT_BGR8:
+      return 3;
+    case RS2_FORMAT_RGBA8:
+    case RS2_FORMAT_BGRA8:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+capture::StreamInfo stream_info(const rs2::video_stream_profile &profile) {
+  const rs2_intrinsics intrinsics = profile.get_intrinsics();
+  capture::StreamInfo info{};
+  info.width = profile.width();
+  info.height = profile.height();
+  info.bytes_per_pixel = bytes_per_pixel(profile.format());
+  info.format = profile.format();
+  info.fps = profile.fps();
+  info.distortion_model = intrinsics.model;
+  info.fx = intrinsics.fx;
+  info.fy = intrinsics.fy;
+  info.ppx = intrinsics.ppx;
+  info.ppy = intrinsics.ppy;
+  std::copy(std::begin(intrinsics.coeffs), std::end(intrinsics.coeffs), std::begin(info.coefficients));
+  return info;
+}
+
+uint64_t image_bytes(const capture::StreamInfo &info) {
+  return static_cast<uint64_t>(info.width) * info.height * info.bytes_per_pixel;
+}
+
+}  // namespace
+
+std::atomic<uint32_t> FrameRecorder::signal_count_{0};
+
+FrameRecorder::~FrameRecorder() {
+  shutdown();
+}
+
+bool FrameRecorder::setup_frame_recorder(const rs2::pipeline_profile &profile,
+                                         float buffer_seconds,
+                                         const std::string &directory,
+                                         float minimum_seconds_between_captures,
+                                         uint16_t source_id) {
+  const auto color_profile = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+  const auto depth_profile = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+
+  header_ = capture::FileHeader{};
+  header_.magic = capture::magic;
+  header_.layout_version = capture::layout_version;
+  header_.source_id = source_id;
+  header_.color = stream_info(color_profile);
+  header_.depth = stream_info(depth_profile);
+  if (header_.color.bytes_per_pixel == 0 || header_.depth.bytes_per_pixel == 0) {
+    std::cerr << "Frame recorder disabled, unsupported stream format" << std::endl;
+    return false;
+  }
+  for (auto &sensor : profile.get_device().query_sensors()) {
+    if (auto depth_sensor = sensor.as<rs2::depth_sensor>()) {
+      header_.depth_units = depth_sensor.get_depth_scale();
+    }
+  }
+  const rs2_extrinsics depth_to_color = depth_profile.get_extrinsics_to(color_profile);
+  std::copy(std::begin(depth_to_color.rotation), std::end(depth_to_color.rotation),
+            std::begin(header_.depth_to_color_rotation));
+  std::copy(std::begin(depth_to_color.translation), std::end(depth_to_color.translation),
+            std::begin(header_.depth_to_color_translation));
+
+  header_.frames_offset_bytes = capture::align(sizeof(capture::FileHeader));
+  header_.color_offset_bytes = capture::align(sizeof(capture::FrameRecord));
+  header_.depth_offset_bytes = header_.color_offset_bytes + capture::align(image_bytes(header_.color));
+  header_.frame_stride_bytes = header_.depth_offset_bytes + capture::align(image_bytes(header_.depth));
+
+  capacity_frames_ = std::max<size_t>(2, static_cast<size_t>(std::ceil(buffer_seconds * header_.color.fps)));
+  directory_ = directory;
+  minimum_time_between_captures_ = std::chrono::duration<double>(minimum_seconds_between_captures);
+
+  //! Zero filled here, so every page is touched before the first frame.
+  slots_.assign(capacity_frames_ * header_.frame_stride_bytes, 0);
+  sequences_ = std::make_unique<std::atomic<uint64_t>[]>(capacity_frames_);
+  for (size_t slot = 0; slot < capacity_frames_; ++slot) {
+    sequences_[slot].store(0, std::memory_order_relaxed);
+  }
+  write_count_.store(0, std::memory_order_relaxed);
+  handled_signal_count_ = signal_count_.load(std::memory_order_relaxed);
+
+  stop_ = false;
+  capture_thread_ = std::thread(&FrameRecorder::capture_loop, this);
+
+  std::cout << "Frame recorder: " << capacity_frames_ << " frames, " << slots_.size() / (1024 * 1024) << " MB"
+            << std::endl;
+  return true;
+}
+
+void FrameRecorder::install_signal_trigger() {
+  struct sigaction action{};
+  action.sa_handler = &FrameRecorder::signal_handler;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, nullptr);
+}
+
+void FrameRecorder::signal_handler(int) {
+  signal_count_.fetch_add(1, std::memory_order_relaxed);  //! Lock-free, so safe in a signal handler.
+}
+
+void FrameRecorder::begin_frame(const rs2::video_frame &color, const rs2::depth_frame &depth) {
+  open_slot_ = nullptr;
+  if (slots_.empty()) {
+    return;
+  }
+  const uint64_t color_bytes = image_bytes(header_.color);
+  const uint64_t depth_bytes = image_bytes(header_.depth);
+  if (static_cast<uint64_t>(color.get_data_size()) != color_bytes
+      || static_cast<uint64_t>(depth.get_data_size()) != depth_bytes) {
+    if (!size_mismatch_reported_) {
+      std::cerr << "Frame recorder skips frames that do not match the stream profile" << std::endl;
+      size_mismatch_reported_ = true;
+    }
+    return;
+  }
+
+  const uint64_t write_index = write_count_.load(std::memory_order_relaxed);
+  const size_t slot = write_index % capacity_frames_;
+  sequences_[slot].store(2 * write_index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  open_slot_ = slots_.data() + slot * header_.frame_stride_bytes;
+  std::memcpy(open_slot_ + header_.color_offset_bytes, color.get_data(), color_bytes);
+  std::memcpy(open_slot_ + header_.depth_offset_bytes, depth.get_data(), depth_bytes);
+
+  capture::FrameRecord record{};
+  record.frame_number = color.get_frame_number();
+  record.color_timestamp_seconds = color.get_timestamp() / milliseconds_per_second;
+  record.depth_timestamp_seconds = depth.get_timestamp() / milliseconds_per_second;
+  std::memcpy(open_slot_, &record, sizeof(record));
+}
+
+void FrameRecorder::end_frame(const PoseResult &result, const std::array<uint16_t, 4> &detection_box) {
+  if (open_slot_ != nullptr) {
+    capture::FrameRecord record;
+    std::memcpy(&record, open_slot_, sizeof(record));
+    record.flags = (result.valid ? capture::kPoseValid : 0) | (result.filtered_valid ? capture::kFilteredPoseValid : 0);
+    std::copy(detection_box.begin(), detection_box.end(), std::begin(record.detection_box));
+    record.detection_confidence = result.detection_confidence;
+    std::copy(std::begin(result.position), std::end(result.position), std::begin(record.position));
+    std::copy(std::begin(result.direction), std::end(result.direction), std::begin(record.direction));
+    record.yaw_radians = result.yaw_radians;
+    std::copy(std::begin(result.filtered_position), std::end(result.filtered_position),
+              std::begin(record.filtered_position));
+    record.filtered_yaw_radians = result.filtered_yaw_radians;
+    record.pose_confidence = result.pose_confidence;
+    record.roi_points = result.roi_points;
+    record.sensor_time_seconds = result.sensor_time_seconds;
+    record.latency_seconds = result.latency_seconds;
+    std::memcpy(open_slot_, &record, sizeof(record));
+
+    const uint64_t write_index = write_count_.load(std::memory_order_relaxed);
+    sequences_[write_index % capacity_frames_].store(2 * (write_index + 1), std::memory_order_release);
+    write_count_.store(write_index + 1, std::memory_order_release);
+    open_slot_ = nullptr;
+  }
+
+  const uint32_t signal_count = signal_count_.load(std::memory_order_relaxed);
+  if (signal_count != handled_signal_count_) {
+    handled_signal_count_ = signal_count;
+    trigger_capture(capture::kSignal);
+  }
+}
+
+void FrameRecorder::trigger_capture(capture::TriggerReason reason) {
+  if (slots_.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const bool cooling_down = last_capture_time_ != std::chrono::steady_clock::time_point()
+        && std::chrono::steady_clock::now() - last_capture_time_ < minimum_time_between_captures_;
+    if (capture_pending_ || capture_running_ || cooling_down) {
+      return;
+    }
+    capture_pending_ = true;
+    capture_write_count_ = write_count_.load(std::memory_order_acquire);
+    capture_reason_ = reason;
+  }
+  condition_.notify_one();
+}
+
+void FrameRecorder::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  if (capture_thread_.joinable()) {
+    capture_thread_.join();
+  }
+}
+
+bool FrameRecorder::is_setup() const {
+  return !slots_.empty();
+}
+
+void FrameRecorder::capture_loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    condition_.wait(lock, [this]() { return stop_ || capture_pending_; });
+    if (stop_) {
+      return;
+    }
+    capture_pending_ = false;
+    capture_running_ = true;
+    const uint64_t end_write_count = capture_write_count_;
+    const capture::TriggerReason reason = capture_reason_;
+
+    lock.unlock();
+    write_capture(end_write_count, reason);
+    lock.lock();
+
+    capture_running_ = false;
+    last_capture_time_ = std::chrono::steady_clock::now();
+  }
+}
+
+void FrameRecorder::write_capture(uint64_t end_write_count, capture::TriggerReason reason) {
+  //! The slot of the oldest frame is the one the vision thread writes next, so it is left out.
+  const uint64_t begin_write_count = end_write_count >= capacity_frames_ ? end_write_count - capacity_frames_ + 1 : 0;
+  const uint64_t number_of_frames = end_write_count - begin_write_count;
+  if (number_of_frames == 0) {
+    return;
+  }
+
+  const double trigger_time_seconds = std::chrono::duration<double>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::error_code error;
+  std::filesystem::create_directories(directory_, error);
+  const std::string path = (std::filesystem::path(directory_) /
+      ("capture_" + std::to_string(header_.source_id) + "_" +
+          std::to_string(static_cast<uint64_t>(trigger_time_seconds * milliseconds_per_second)) + ".bin")).string();
+
+  const uint64_t file_size = header_.frames_offset_bytes + number_of_frames * header_.frame_stride_bytes;
+  int file_descriptor = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (file_descriptor < 0) {
+    std::cerr << "Capture failed, open " << path << ": " << std::strerror(errno) << std::endl;
+    return;
+  }
+  if (ftruncate(file_descriptor, file_size) != 0) {
+    std::cerr << "Capture failed, ftruncate: " << std::strerror(errno) << std::endl;
+    close(file_descriptor);
+    return;
+  }
+  void *address = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+  if (address == MAP_FAILED) {
+    std::cerr << "Capture failed, mmap: " << std::strerror(errno) << std::endl;
+    close(file_descriptor);
+    return;
+  }
+  auto *file = static_cast<uint8_t *>(address);
+
+  capture::FileHeader header = header_;
+  header.trigger_reason = reason;
+  header.trigger_time_seconds = trigger_time_seconds;
+  uint32_t copied_frames = 0;
+  for (uint64_t write_index = begin_write_count; write_index < end_write_count; ++write_index) {
+    uint8_t *frame = file + header.frames_offset_bytes + copied_frames * header.frame_stride_bytes;
+    if (copy_frame(write_index, frame)) {
+      capture::FrameRecord record;
+      std::memcpy(&record, frame, sizeof(record));
+      header.trigger_frame_number = record.frame_number;
+      copied_frames++;
+    }
+  }
+  header.number_of_frames = copied_frames;
+  std::memcpy(file, &header, sizeof(header));
+
+  munmap(address, file_size);
+  if (ftruncate(file_descriptor, header.frames_offset_bytes + copied_frames * header.frame_stride_bytes) != 0) {
+    std::cerr << "Capture ftruncate: " << std::strerror(errno) << std::endl;
+  }
+  close(file_descriptor);
+
+  std::cout << "Capture of " << copied_frames << " frames written to " << path << " ("
+            << number_of_frames - copied_frames << " overwritten while copying)" << std::endl;
+}
+
+bool FrameRecorder::copy_frame(uint64_t write_index, uint8_t *destination) const {
+  const size_t slot = write_index % capacity_frames_;
+  const uint64_t complete_sequence = 2 * (write_index + 1);
+  if (sequences_[slot].load(std::memory_order_acquire) != complete_sequence) {
+    return false;
+  }
+  //! The vision thread may start overwriting the slot during the copy, a torn copy is caught by the second check.
+  std::memcpy(destination, slots_.data() + slot * header_.frame_stride_bytes, header_.frame_stride_bytes);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return sequences_[slot].load(std::memory_order_relaxed) == complete_sequence;
+}
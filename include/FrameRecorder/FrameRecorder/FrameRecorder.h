@@ -0,0 +1,89 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_FRAMERECORDER_FRAMERECORDER_FRAMERECORDER_H_
+#define INCLUDE_FRAMERECORDER_FRAMERECORDER_FRAMERECORDER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "librealsense2/rs.hpp"
+
+#include "FrameRecorder/CaptureLayout.h"
+#include "PosePublisher/PosePublisher.h"
+
+//! Ring of the last buffer_seconds of raw color and depth frames with the pipeline output of each, so a failure can
+//! be captured after it happened. The slots are allocated once at setup and every slot has its own seqlock. The
+//! vision thread only copies into the next slot and never waits; a capture thread of its own copies the ring into a
+//! memory mapped file (CaptureLayout.h) and skips slots that were overwritten while it copied them.
+class FrameRecorder {
+ public:
+  ~FrameRecorder();
+
+  //! Sizes the slots from the color and depth streams of the profile. Returns false and stays disabled if a stream
+  //! format is not supported.
+  bool setup_frame_recorder(const rs2::pipeline_profile &profile,
+                            float buffer_seconds,
+                            const std::string &directory,
+                            float minimum_seconds_between_captures,
+                            uint16_t source_id);
+
+  //! SIGUSR1 triggers a capture of every recorder in the process, checked at the end of its next frame.
+  static void install_signal_trigger();
+
+  //! Copies the raw frames into the next slot. The slot is completed by end_frame.
+  void begin_frame(const rs2::video_frame &color, const rs2::depth_frame &depth);
+
+  void end_frame(const PoseResult &result, const std::array<uint16_t, 4> &detection_box);
+
+  //! Safe to call from any thread. Ignored while a capture is written or within the minimum time after the last.
+  void trigger_capture(capture::TriggerReason reason);
+
+  void shutdown();
+
+  bool is_setup() const;
+
+ private:
+  static void signal_handler(int signal);
+
+  void capture_loop();
+
+  void write_capture(uint64_t end_write_count, capture::TriggerReason reason);
+
+  //! Copies the frame with this write index, returns false if its slot was being written or already reused.
+  bool copy_frame(uint64_t write_index, uint8_t *destination) const;
+
+  static std::atomic<uint32_t> signal_count_;
+  uint32_t handled_signal_count_ = 0;
+
+  capture::FileHeader header_{};
+  std::string directory_;
+  std::chrono::duration<double> minimum_time_between_captures_{0};
+  std::chrono::steady_clock::time_point last_capture_time_;
+  size_t capacity_frames_ = 0;
+
+  std::vector<uint8_t> slots_;  //! capacity_frames_ frames in the file layout, so a capture is a copy per frame.
+  std::unique_ptr<std::atomic<uint64_t>[]> sequences_;  //! 2 * (write index + 1) when complete, odd while written.
+  std::atomic<uint64_t> write_count_{0};
+  uint8_t *open_slot_ = nullptr;  //! Slot between begin_frame and end_frame.
+  bool size_mismatch_reported_ = false;
+
+  std::thread capture_thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stop_ = false;
+  bool capture_pending_ = false;
+  bool capture_running_ = false;
+  uint64_t capture_write_count_ = 0;
+  capture::TriggerReason capture_reason_ = capture::kApi;
+};
+
+#endif  // INCLUDE_FRAMERECORDER_FRAMERECORDER_FRAMERECORDER_H_
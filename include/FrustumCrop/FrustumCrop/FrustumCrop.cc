@@ -0,0 +1,109 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "FrustumCrop/FrustumCrop.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Geometry>
+
+void FrustumCrop::set_frustum(const Eigen::Matrix4f &camera_pose,
+                              float vertical_fov_rad,
+                              float horizontal_fov_rad,
+                              float near_plane_distance_meter,
+                              float far_plane_distance_meter) {
+  const Eigen::Vector3f view = camera_pose.block<3, 1>(0, 0);
+  const Eigen::Vector3f up = camera_pose.block<3, 1>(0, 1);
+  const Eigen::Vector3f right = camera_pose.block<3, 1>(0, 2);
+  const Eigen::Vector3f position = camera_pose.block<3, 1>(0, 3);
+
+  //! Planes built from the frustum corners the same way as pcl::FrustumCulling, so the same points are kept.
+  const float near_height = 2 * std::tan(vertical_fov_rad / 2) * near_plane_distance_meter;
+  const float near_width = 2 * std::tan(horizontal_fov_rad / 2) * near_plane_distance_meter;
+  const float far_height = 2 * std::tan(vertical_fov_rad / 2) * far_plane_distance_meter;
+  const float far_width = 2 * std::tan(horizontal_fov_rad / 2) * far_plane_distance_meter;
+
+  const Eigen::Vector3f far_center = position + view * far_plane_distance_meter;
+  const Eigen::Vector3f far_top_left = far_center + (up * far_height / 2) - (right * far_width / 2);
+  const Eigen::Vector3f far_top_right = far_center + (up * far_height / 2) + (right * far_width / 2);
+  const Eigen::Vector3f far_bottom_left = far_center - (up * far_height / 2) - (right * far_width / 2);
+  const Eigen::Vector3f far_bottom_right = far_center - (up * far_height / 2) + (right * far_width / 2);
+
+  const Eigen::Vector3f near_center = position + view * near_plane_distance_meter;
+  const Eigen::Vector3f near_top_right = near_center + (up * near_height / 2) + (right * near_width / 2);
+  const Eigen::Vector3f near_bottom_left = near_center - (up * near_height / 2) - (right * near_width / 2);
+  const Eigen::Vector3f near_bottom_right = near_center - (up * near_height / 2) + (right * near_width / 2);
+
+  const Eigen::Vector3f a = far_bottom_left - position;
+  const Eigen::Vector3f b = far_bottom_right - position;
+  const Eigen::Vector3f c = far_top_right - position;
+  const Eigen::Vector3f d = far_top_left - position;
+
+  auto set_plane = [this](int row, const Eigen::Vector3f &normal, const Eigen::Vector3f &point) {
+    planes_.block<1, 3>(row, 0) = normal.transpose();
+    planes_(row, 3) = -point.dot(normal);
+  };
+  set_plane(0, (far_bottom_left - far_bottom_right).cross(far_top_right - far_bottom_right), far_center);
+  set_plane(1, (near_top_right - near_bottom_right).cross(near_bottom_left - near_bottom_right), near_center);
+  set_plane(2, b.cross(c), position);
+  set_plane(3, d.cross(a), position);
+  set_plane(4, c.cross(d), position);
+  set_plane(5, a.cross(b), position);
+
+  far_corners_ = {far_top_left, far_top_right, far_bottom_right, far_bottom_left};
+  position_ = position;
+}
+
+const std::array<Eigen::Vector3f, 4> &FrustumCrop::get_far_corners() const {
+  return far_corners_;
+}
+
+const Eigen::Vector3f &FrustumCrop::get_position() const {
+  return position_;
+}
+
+void FrustumCrop::crop(const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                       size_t begin,
+                       size_t end,
+                       pcl::PointCloud<pcl::PointXYZ>::VectorType *points,
+                       std::vector<int> *indices) const {
+  alignas(64) float x[block_size_points_];
+  alignas(64) float y[block_size_points_];
+  alignas(64) float z[block_size_points_];
+  alignas(64) float distance[block_size_points_];
+
+  end = std::min(end, cloud.size());
+  for (size_t block_begin = begin; block_begin < end; block_begin += block_size_points_) {
+    const size_t length = std::min(block_size_points_, end - block_begin);
+    for (size_t i = 0; i < length; ++i) {
+      const pcl::PointXYZ &point = cloud.points[block_begin + i];
+      x[i] = point.x;
+      y[i] = point.y;
+      z[i] = point.z;
+    }
+
+    const auto block_length = static_cast<Eigen::Index>(length);
+    Eigen::Map<const Eigen::ArrayXf, Eigen::Aligned64> x_block(x, block_length);
+    Eigen::Map<const Eigen::ArrayXf, Eigen::Aligned64> y_block(y, block_length);
+    Eigen::Map<const Eigen::ArrayXf, Eigen::Aligned64> z_block(z, block_length);
+    Eigen::Map<Eigen::ArrayXf, Eigen::Aligned64> distance_block(distance, block_length);
+
+    //! Largest signed distance to any of the planes, a point is inside if it is not above any.
+    distance_block = x_block * planes_(0, 0) + y_block * planes_(0, 1) + z_block * planes_(0, 2) + planes_(0, 3);
+    for (int plane = 1; plane < number_of_planes_; ++plane) {
+      distance_block = distance_block.max(
+          x_block * planes_(plane, 0) + y_block * planes_(plane, 1) + z_block * planes_(plane, 2)
+              + planes_(plane, 3));
+    }
+
+    //! The vectorized max does not propagate NaN, points with a NaN coordinate are dropped here as in
+    //! pcl::FrustumCulling.
+    for (size_t i = 0; i < length; ++i) {
+      if (distance[i] <= 0 && !std::isnan(x[i] + y[i] + z[i])) {
+        points->emplace_back(cloud.points[block_begin + i]);
+        indices->emplace_back(static_cast<int>(block_begin + i));
+      }
+    }
+  }
+}
@@ -0,0 +1,55 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_FRUSTUMCROP_FRUSTUMCROP_FRUSTUMCROP_H_
+#define INCLUDE_FRUSTUMCROP_FRUSTUMCROP_FRUSTUMCROP_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Core>
+
+//! Frustum crop with the same frustum as pcl::FrustumCulling. Points are copied block by block into a struct of
+//! arrays and tested against the six planes with Eigen array operations, and the points inside are written out
+//! together with their indices, so no second pass copies them out of the input cloud.
+class FrustumCrop {
+ public:
+  //! Same convention as pcl::FrustumCulling::setCameraPose: the camera views along the first column of the pose,
+  //! up is the second column and right the third.
+  void set_frustum(const Eigen::Matrix4f &camera_pose,
+                   float vertical_fov_rad,
+                   float horizontal_fov_rad,
+                   float near_plane_distance_meter,
+                   float far_plane_distance_meter);
+
+  //! Appends the points of cloud in [begin, end) inside the frustum to points, and their indices to indices, in
+  //! order. Safe to call from several threads at once.
+  void crop(const pcl::PointCloud<pcl::PointXYZ> &cloud,
+            size_t begin,
+            size_t end,
+            pcl::PointCloud<pcl::PointXYZ>::VectorType *points,
+            std::vector<int> *indices) const;
+
+  //! Far plane corners in order around the rectangle. Every point inside the frustum is on a ray from the camera
+  //! position through this rectangle, so for an organized cloud taken from that position only the pixels the
+  //! rectangle projects to can hold points inside.
+  const std::array<Eigen::Vector3f, 4> &get_far_corners() const;
+
+  const Eigen::Vector3f &get_position() const;
+
+ private:
+  static constexpr size_t block_size_points_ = 1024;  //! Three float blocks of this size stay in L1.
+  static constexpr int number_of_planes_ = 6;
+
+  //! One plane per row, (a, b, c, d) with a*x + b*y + c*z + d <= 0 inside.
+  using Planes = Eigen::Matrix<float, number_of_planes_, 4, Eigen::RowMajor>;
+  Planes planes_ = Planes::Zero();
+  std::array<Eigen::Vector3f, 4> far_corners_;
+  Eigen::Vector3f position_ = Eigen::Vector3f::Zero();
+};
+
+#endif  // INCLUDE_FRUSTUMCROP_FRUSTUMCROP_FRUSTUMCROP_H_
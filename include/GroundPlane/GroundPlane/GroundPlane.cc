@@ -0,0 +1,211 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "GroundPlane/GroundPlane.h"
+
+#include <jsoncpp/json/json.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+void GroundPlane::setup_ground_plane(const std::string &calibration_path,
+                                     uint16_t calibration_frames,
+                                     double maximum_tilt_radians,
+                                     bool force_calibration) {
+  calibration_path_ = calibration_path;
+  calibration_frames_ = std::max<uint16_t>(calibration_frames, 1);
+  maximum_tilt_radians_ = maximum_tilt_radians;
+  is_calibrated_ = false;
+  consecutive_failed_verifications_ = 0;
+  stable_fits_.clear();
+
+  if (force_calibration) {
+    std::cout << "Ground plane calibration forced, fitting the first " << calibration_frames_ << " stable frames"
+              << std::endl;
+    return;
+  }
+  if (load_calibration()) {
+    std::cout << "Loaded ground plane: " << calibration_path_ << std::endl;
+  } else {
+    std::cout << "No ground plane calibration, fitting the first " << calibration_frames_ << " stable frames"
+              << std::endl;
+  }
+}
+
+bool GroundPlane::add_fit(const std::vector<float> &coefficients,
+                          double stable_angle_radians,
+                          double stable_distance_meter,
+                          uint16_t recalibration_failed_frames) {
+  if (coefficients.size() != number_of_plane_coefficients_) {
+    return false;
+  }
+  //! A single failed frame is usually an occluded floor, the calibrated plane is kept until a run of them.
+  if (is_calibrated_ && consecutive_failed_verifications_ < std::max<uint16_t>(recalibration_failed_frames, 1)) {
+    return false;
+  }
+
+  if (!is_level(coefficients, maximum_tilt_radians_)) {
+    return false;  //! Not the floor, does not break a run of stable floor fits either.
+  }
+
+  const Eigen::Vector4f reference_plane =
+      !stable_fits_.empty() ? stable_fits_.front() : is_calibrated_ ? plane_ : Eigen::Vector4f::Zero();
+  const Eigen::Vector4f plane = normalize_plane(coefficients, reference_plane);
+
+  if (!stable_fits_.empty()) {
+    const Eigen::Vector4f &previous_plane = stable_fits_.back();
+    const double angle = std::acos(std::clamp(plane.head<3>().dot(previous_plane.head<3>()), -1.0f, 1.0f));
+    if (angle > stable_angle_radians || std::abs(plane.w() - previous_plane.w()) > stable_distance_meter) {
+      stable_fits_.clear();  //! The run has to be consecutive.
+    }
+  }
+  stable_fits_.emplace_back(plane);
+
+  if (stable_fits_.size() < calibration_frames_) {
+    return false;
+  }
+
+  Eigen::Vector4f mean_plane = Eigen::Vector4f::Zero();
+  for (const auto &fit : stable_fits_) {
+    mean_plane += fit;
+  }
+  mean_plane /= static_cast<float>(stable_fits_.size());
+  mean_plane /= mean_plane.head<3>().norm();
+  stable_fits_.clear();
+
+  std::cout << (is_calibrated_ ? "Ground plane recalibrated after " : "Ground plane calibrated")
+            << (is_calibrated_ ? std::to_string(consecutive_failed_verifications_) + " failed frames: " : ": ")
+            << mean_plane.transpose() << std::endl;
+  set_coefficients(mean_plane);
+  is_calibrated_ = true;
+  consecutive_failed_verifications_ = 0;
+  return true;
+}
+
+bool GroundPlane::verify(const pcl::PointCloud<pcl::PointXYZ> &floor_cloud,
+                         uint16_t sample_size,
+                         double distance_threshold_meter,
+                         double minimum_inlier_ratio) {
+  if (!is_calibrated_ || floor_cloud.empty() || sample_size == 0) {
+    return false;
+  }
+  const size_t stride = std::max<size_t>(1, floor_cloud.size() / sample_size);
+  size_t number_of_samples = 0;
+  size_t number_of_inliers = 0;
+  for (size_t i = 0; i < floor_cloud.size(); i += stride) {
+    const pcl::PointXYZ &point = floor_cloud.points[i];
+    if (!std::isfinite(point.z) || point.z <= 0) {
+      continue;
+    }
+    number_of_samples++;
+    const float distance = plane_.x() * point.x + plane_.y() * point.y + plane_.z() * point.z + plane_.w();
+    if (std::abs(distance) < distance_threshold_meter) {
+      number_of_inliers++;
+    }
+  }
+
+  if (number_of_samples < minimum_verification_samples_) {
+    return false;
+  }
+  if (static_cast<double>(number_of_inliers) / number_of_samples < minimum_inlier_ratio) {
+    consecutive_failed_verifications_++;
+    return false;
+  }
+  consecutive_failed_verifications_ = 0;
+  stable_fits_.clear();  //! Drops a recalibration that was started, the cached plane holds again.
+  return true;
+}
+
+const std::vector<float> &GroundPlane::get_coefficients() const {
+  return coefficients_;
+}
+
+const std::string &GroundPlane::get_calibration_path() const {
+  return calibration_path_;
+}
+
+bool GroundPlane::is_calibrated() const {
+  return is_calibrated_;
+}
+
+bool GroundPlane::load_calibration() {
+  std::ifstream calibration_file(calibration_path_);
+  if (!calibration_file.is_open()) {
+    return false;
+  }
+
+  Json::CharReaderBuilder reader_builder;
+  Json::Value root;
+  std::string errors;
+  if (!Json::parseFromStream(reader_builder, calibration_file, &root, &errors)) {
+    std::cerr << "Could not parse ground plane calibration: " << errors << std::endl;
+    return false;
+  }
+
+  const Json::Value &coefficients = root["coefficients"];
+  if (!coefficients.isArray() || coefficients.size() != number_of_plane_coefficients_) {
+    std::cerr << "Ground plane calibration needs 4 coefficients: " << calibration_path_ << std::endl;
+    return false;
+  }
+
+  std::vector<float> values;
+  for (Json::ArrayIndex i = 0; i < number_of_plane_coefficients_; ++i) {
+    values.emplace_back(coefficients[i].asFloat());
+  }
+  if (!is_level(values, maximum_tilt_radians_)) {
+    std::cerr << "Ground plane calibration is not level, calibrating again: " << calibration_path_ << std::endl;
+    return false;
+  }
+  const Eigen::Vector4f plane(values[0], values[1], values[2], values[3]);
+  set_coefficients(plane / plane.head<3>().norm());
+  is_calibrated_ = true;
+  return true;
+}
+
+bool GroundPlane::save_calibration(const std::string &calibration_path, const std::vector<float> &coefficients) {
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(calibration_path).parent_path(), error);
+
+  std::ofstream calibration_file(calibration_path, std::ios_base::trunc | std::ios_base::out);
+  if (!calibration_file.is_open()) {
+    std::cerr << "Could not save ground plane calibration: " << calibration_path << std::endl;
+    return false;
+  }
+
+  Json::Value root;
+  for (float coefficient : coefficients) {
+    root["coefficients"].append(coefficient);
+  }
+  Json::StreamWriterBuilder writer_builder;
+  calibration_file << Json::writeString(writer_builder, root) << std::endl;
+  return true;
+}
+
+void GroundPlane::set_coefficients(const Eigen::Vector4f &plane) {
+  plane_ = plane;
+  coefficients_.assign(plane_.data(), plane_.data() + number_of_plane_coefficients_);
+}
+
+bool GroundPlane::is_level(const std::vector<float> &coefficients, double maximum_tilt_radians) {
+  if (coefficients.size() != number_of_plane_coefficients_) {
+    return false;
+  }
+  const float norm = Eigen::Vector3f(coefficients[0], coefficients[1], coefficients[2]).norm();
+  return norm > 0 && std::acos(std::min(std::abs(coefficients[1]) / norm, 1.0f)) <= maximum_tilt_radians;
+}
+
+Eigen::Vector4f GroundPlane::normalize_plane(const std::vector<float> &coefficients,
+                                             const Eigen::Vector4f &reference_plane) {
+  Eigen::Vector4f plane(coefficients.at(0), coefficients.at(1), coefficients.at(2), coefficients.at(3));
+  const float norm = plane.head<3>().norm();
+  if (norm > 0) {
+    plane /= norm;
+  }
+  if (plane.head<3>().dot(reference_plane.head<3>()) < 0) {
+    plane = -plane;
+  }
+  return plane;
+}
@@ -0,0 +1,80 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_GROUNDPLANE_GROUNDPLANE_GROUNDPLANE_H_
+#define INCLUDE_GROUNDPLANE_GROUNDPLANE_GROUNDPLANE_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+//! Cached floor plane of a camera rigidly mounted on the mast. The plane is calibrated once from a run of stable
+//! RANSAC fits and kept on disk. Afterwards every frame only verifies it on a sparse sample of floor points. A frame
+//! that fails is refitted on its own, and only a run of failed frames starts a new calibration from stable fits.
+class GroundPlane {
+ public:
+  //! Only planes whose normal is within maximum_tilt_radians of the camera y axis are taken as the floor, for the
+  //! loaded calibration and for every fit. The first RANSAC returns the dominant plane of the ROI, which is the pallet
+  //! face or a truck when the floor is hidden.
+  void setup_ground_plane(const std::string &calibration_path,
+                          uint16_t calibration_frames,
+                          double maximum_tilt_radians,
+                          bool force_calibration);
+
+  //! Feeds one RANSAC fit (a, b, c, d). While calibrating, or after recalibration_failed_frames consecutive failed
+  //! verifications, a run of stable fits is averaged into the cached plane. Fits that are not level and other fits are
+  //! ignored. Returns true when the cached plane changed and should be saved.
+  bool add_fit(const std::vector<float> &coefficients,
+               double stable_angle_radians,
+               double stable_distance_meter,
+               uint16_t recalibration_failed_frames);
+
+  //! Fraction of a strided sample of floor_cloud within distance_threshold_meter of the cached plane is compared to
+  //! minimum_inlier_ratio. floor_cloud should hold floor points only, e.g. the region below the pallet. A sample too
+  //! small to decide fails without counting towards a recalibration.
+  bool verify(const pcl::PointCloud<pcl::PointXYZ> &floor_cloud,
+              uint16_t sample_size,
+              double distance_threshold_meter,
+              double minimum_inlier_ratio);
+
+  const std::vector<float> &get_coefficients() const;
+
+  const std::string &get_calibration_path() const;
+
+  bool is_calibrated() const;
+
+  //! The normal of the plane (a, b, c, d) is within maximum_tilt_radians of the camera y axis, either sign.
+  static bool is_level(const std::vector<float> &coefficients, double maximum_tilt_radians);
+
+  //! Writes to disk, so called off the vision thread with a copy of the coefficients.
+  static bool save_calibration(const std::string &calibration_path, const std::vector<float> &coefficients);
+
+ private:
+  bool load_calibration();
+
+  void set_coefficients(const Eigen::Vector4f &plane);
+
+  //! Unit normal, sign chosen to agree with reference_plane so fits with flipped normals can be compared.
+  static Eigen::Vector4f normalize_plane(const std::vector<float> &coefficients, const Eigen::Vector4f &reference_plane);
+
+  static constexpr uint8_t number_of_plane_coefficients_ = 4;
+  static constexpr uint16_t minimum_verification_samples_ = 16;  // TODO(simon) Magic number.
+
+  std::string calibration_path_;
+  uint16_t calibration_frames_ = 30;
+  double maximum_tilt_radians_ = 0.5;
+
+  bool is_calibrated_ = false;
+  uint32_t consecutive_failed_verifications_ = 0;
+  std::vector<float> coefficients_;
+  Eigen::Vector4f plane_ = Eigen::Vector4f::Zero();
+
+  std::vector<Eigen::Vector4f> stable_fits_;
+};
+
+#endif  // INCLUDE_GROUNDPLANE_GROUNDPLANE_GROUNDPLANE_H_
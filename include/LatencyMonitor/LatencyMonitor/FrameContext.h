@@ -0,0 +1,57 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_LATENCYMONITOR_LATENCYMONITOR_FRAMECONTEXT_H_
+#define INCLUDE_LATENCYMONITOR_LATENCYMONITOR_FRAMECONTEXT_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+//! Stages of one frame in the order they run. Each stage ends when it is marked, kFrameArrived when
+//! wait_for_frames returns.
+enum FrameStage : uint8_t {
+  kFrameArrived = 0,
+  kMarker = 1,  //! Color conversion and AprilTag.
+  kDetection = 2,
+  kPointCloud = 3,  //! Depth to point cloud, skipped when nothing needs the full cloud.
+  kCrop = 4,  //! Detection frustum and crop, skipped without a detection.
+  kPlaneFit = 5,  //! RANSAC, pose vector and pose quality.
+  kPoseFilter = 6,
+  kPublished = 7,  //! Ground truth pose, up to the pose record being written.
+  kNumberOfFrameStages = 8,
+};
+
+//! How sensor_time_seconds was put on the host system clock.
+enum TimestampMapping : uint8_t {
+  kUnmapped = 0,  //! Playback or unknown domain, only the host side of the latency is measured.
+  kGlobalTime = 1,  //! librealsense global time, the device clock continuously mapped to the host clock.
+  kSystemTime = 2,  //! Host time at arrival, the transfer from the device is not included.
+  kHardwareClock = 3,  //! Device clock with the smallest arrival offset of the recent frames added.
+};
+
+//! Everything the stages of one frame share about where the frame came from and when it got where.
+struct FrameContext {
+  uint64_t frame_number = 0;  //! Color frame number.
+  double timestamp_seconds = 0;  //! Color frame timestamp as reported, the time base of the pose filter.
+
+  //! Mid exposure of the older of the color and depth frames, host system clock seconds since epoch. 0 when
+  //! unmapped.
+  double sensor_time_seconds = 0;
+  TimestampMapping timestamp_mapping = kUnmapped;
+  double sensor_to_arrival_seconds = 0;  //! From sensor_time_seconds to kFrameArrived, 0 when unmapped.
+
+  std::array<std::chrono::steady_clock::time_point, kNumberOfFrameStages> stage_end_times;
+
+  void mark(FrameStage stage) {
+    stage_end_times[stage] = std::chrono::steady_clock::now();
+  }
+
+  //! From the sensor exposure of this frame to time.
+  double seconds_since_sensor(std::chrono::steady_clock::time_point time) const {
+    return sensor_to_arrival_seconds
+        + std::chrono::duration<double>(time - stage_end_times[kFrameArrived]).count();
+  }
+};
+
+#endif  // INCLUDE_LATENCYMONITOR_LATENCYMONITOR_FRAMECONTEXT_H_
@@ -0,0 +1,203 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "LatencyMonitor/LatencyMonitor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+constexpr const char *stage_names[kNumberOfFrameStages] = {
+    "sensor to host", "marker", "detection", "point cloud", "crop", "plane fit", "pose filter", "published"};
+
+constexpr double milliseconds_per_second = 1000;
+constexpr double microseconds_per_second = 1000000;
+
+void print_histogram(std::ostream &stream, const char *name, const LatencyHistogram &histogram, double percentile) {
+  stream << "  " << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+         << " p50 " << std::setw(7) << histogram.get_percentile_seconds(0.5) * milliseconds_per_second
+         << " p" << static_cast<int>(percentile * 100) << " " << std::setw(7)
+         << histogram.get_percentile_seconds(percentile) * milliseconds_per_second
+         << " max " << std::setw(7) << histogram.get_maximum_seconds() * milliseconds_per_second << " ms"
+         << std::endl;
+}
+
+}  // namespace
+
+void LatencyHistogram::add(double seconds) {
+  const double bucket = std::max(0.0, seconds) / bucket_width_seconds_;
+  const uint32_t bucket_id = bucket < number_of_buckets_ - 1 ? static_cast<uint32_t>(bucket) : number_of_buckets_ - 1;
+  //! Single writer, so load and store instead of read-modify-write.
+  buckets_[bucket_id].store(buckets_[bucket_id].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if (seconds > maximum_seconds_.load(std::memory_order_relaxed)) {
+    maximum_seconds_.store(seconds, std::memory_order_relaxed);
+  }
+  count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint64_t LatencyHistogram::get_count() const {
+  return count_.load(std::memory_order_acquire);
+}
+
+double LatencyHistogram::get_maximum_seconds() const {
+  return maximum_seconds_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::get_percentile_seconds(double percentile) const {
+  const uint64_t count = get_count();
+  if (count == 0) {
+    return 0;
+  }
+  const auto rank = static_cast<uint64_t>(std::ceil(percentile * count));
+  uint64_t below = 0;
+  for (uint32_t bucket_id = 0; bucket_id < number_of_buckets_; ++bucket_id) {
+    below += buckets_[bucket_id].load(std::memory_order_relaxed);
+    if (below >= rank) {
+      return std::min((bucket_id + 1) * bucket_width_seconds_, get_maximum_seconds());
+    }
+  }
+  return get_maximum_seconds();
+}
+
+uint64_t LatencyHistogram::get_count_above(double seconds) const {
+  const auto first_bucket_id = static_cast<uint32_t>(std::clamp(seconds / bucket_width_seconds_, 0.0,
+                                                                static_cast<double>(number_of_buckets_)));
+  uint64_t above = 0;
+  for (uint32_t bucket_id = first_bucket_id; bucket_id < number_of_buckets_; ++bucket_id) {
+    above += buckets_[bucket_id].load(std::memory_order_relaxed);
+  }
+  return above;
+}
+
+void LatencyMonitor::setup_latency_monitor(const rs2::pipeline_profile &profile, bool enable_global_time,
+                                           uint32_t report_interval_frames) {
+  report_interval_frames_ = report_interval_frames;
+  is_playback_ = profile.get_device().is<rs2::playback>();
+  if (is_playback_ || !enable_global_time) {
+    return;
+  }
+  for (auto &sensor : profile.get_device().query_sensors()) {
+    if (sensor.supports(RS2_OPTION_GLOBAL_TIME_ENABLED)) {
+      sensor.set_option(RS2_OPTION_GLOBAL_TIME_ENABLED, 1);
+    }
+  }
+}
+
+void LatencyMonitor::begin_frame(const rs2::video_frame &color, const rs2::depth_frame &depth, FrameContext *context) {
+  context->mark(kFrameArrived);
+  const double arrival_seconds =
+      std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+  context->frame_number = color.get_frame_number();
+  context->timestamp_seconds = color.get_timestamp() / milliseconds_per_second;
+  context->sensor_time_seconds = 0;
+  context->sensor_to_arrival_seconds = 0;
+  context->timestamp_mapping = kUnmapped;
+  if (is_playback_) {
+    return;
+  }
+
+  TimestampMapping color_mapping;
+  TimestampMapping depth_mapping;
+  const double color_seconds = sensor_time_seconds(color, arrival_seconds, &color_clock_offset_, &color_mapping);
+  const double depth_seconds = sensor_time_seconds(depth, arrival_seconds, &depth_clock_offset_, &depth_mapping);
+  if (color_mapping == kUnmapped || depth_mapping == kUnmapped) {
+    return;
+  }
+  //! The older of the two bounds the age of the pose.
+  const bool color_is_older = color_seconds < depth_seconds;
+  context->sensor_time_seconds = color_is_older ? color_seconds : depth_seconds;
+  context->timestamp_mapping = color_is_older ? color_mapping : depth_mapping;
+  context->sensor_to_arrival_seconds = arrival_seconds - context->sensor_time_seconds;
+}
+
+void LatencyMonitor::end_frame(FrameContext *context) {
+  context->mark(kPublished);
+  pose_latency_seconds_ = context->seconds_since_sensor(context->stage_end_times[kPublished]);
+
+  if (context->timestamp_mapping != kUnmapped) {
+    stage_histograms_[kFrameArrived].add(context->sensor_to_arrival_seconds);
+  }
+  for (uint8_t stage = kFrameArrived + 1; stage < kNumberOfFrameStages; ++stage) {
+    stage_histograms_[stage].add(
+        std::chrono::duration<double>(context->stage_end_times[stage] - context->stage_end_times[stage - 1]).count());
+  }
+  pose_latency_histogram_.add(pose_latency_seconds_);
+
+  if (report_interval_frames_ > 0 && ++frames_ % report_interval_frames_ == 0) {
+    print_report(std::cout);
+  }
+}
+
+double LatencyMonitor::get_pose_latency_seconds() const {
+  return pose_latency_seconds_;
+}
+
+const LatencyHistogram &LatencyMonitor::get_stage_histogram(FrameStage stage) const {
+  return stage_histograms_.at(stage);
+}
+
+const LatencyHistogram &LatencyMonitor::get_pose_latency_histogram() const {
+  return pose_latency_histogram_;
+}
+
+void LatencyMonitor::print_report(std::ostream &stream) const {
+  const std::ios_base::fmtflags flags = stream.flags();
+  const std::streamsize precision = stream.precision();
+  stream << "Latency over " << pose_latency_histogram_.get_count() << " frames"
+         << (stage_histograms_[kFrameArrived].get_count() == 0 ? ", host side only:" : ":") << std::endl;
+  for (uint8_t stage = kFrameArrived; stage < kNumberOfFrameStages; ++stage) {
+    if (stage_histograms_[stage].get_count() > 0) {
+      print_histogram(stream, stage_names[stage], stage_histograms_[stage], report_percentile_);
+    }
+  }
+  print_histogram(stream, "pose", pose_latency_histogram_, report_percentile_);
+  stream.flags(flags);
+  stream.precision(precision);
+}
+
+double LatencyMonitor::sensor_time_seconds(const rs2::frame &frame, double arrival_seconds, ClockOffset *clock_offset,
+                                           TimestampMapping *mapping) {
+  double frame_seconds = frame.get_timestamp() / milliseconds_per_second;
+  switch (frame.get_frame_timestamp_domain()) {
+    case RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME:
+      *mapping = kGlobalTime;
+      break;
+    case RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME:
+      *mapping = kSystemTime;
+      break;
+    case RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK: {
+      //! The driver's arrival time is closer to the transfer than wait_for_frames returning.
+      const double host_seconds = frame.supports_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL)
+          ? frame.get_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL) / milliseconds_per_second
+          : arrival_seconds;
+      clock_offset->current_minimum_seconds =
+          std::min(clock_offset->current_minimum_seconds, host_seconds - frame_seconds);
+      const double offset_seconds =
+          std::min(clock_offset->current_minimum_seconds, clock_offset->previous_minimum_seconds);
+      if (++clock_offset->frames_in_window == clock_offset_window_frames_) {
+        clock_offset->previous_minimum_seconds = clock_offset->current_minimum_seconds;
+        clock_offset->current_minimum_seconds = std::numeric_limits<double>::infinity();
+        clock_offset->frames_in_window = 0;
+      }
+      frame_seconds += offset_seconds;
+      *mapping = kHardwareClock;
+      break;
+    }
+    default:
+      *mapping = kUnmapped;
+      return 0;
+  }
+
+  //! The frame timestamp is taken at the start of the readout, the sensor timestamp in the middle of the exposure.
+  if (frame.supports_frame_metadata(RS2_FRAME_METADATA_FRAME_TIMESTAMP)
+      && frame.supports_frame_metadata(RS2_FRAME_METADATA_SENSOR_TIMESTAMP)) {
+    frame_seconds -= static_cast<double>(frame.get_frame_metadata(RS2_FRAME_METADATA_FRAME_TIMESTAMP)
+        - frame.get_frame_metadata(RS2_FRAME_METADATA_SENSOR_TIMESTAMP)) / microseconds_per_second;
+  }
+  return frame_seconds;
+}
@@ -0,0 +1,93 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_LATENCYMONITOR_LATENCYMONITOR_LATENCYMONITOR_H_
+#define INCLUDE_LATENCYMONITOR_LATENCYMONITOR_LATENCYMONITOR_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+#include "librealsense2/rs.hpp"
+
+#include "LatencyMonitor/FrameContext.h"
+
+//! Fixed bucket latency histogram. Written by one thread, readable from any thread without locks. The maximum is
+//! exact, the percentiles are the upper edge of their bucket, so they never under report.
+class LatencyHistogram {
+ public:
+  void add(double seconds);
+
+  uint64_t get_count() const;
+
+  double get_maximum_seconds() const;
+
+  double get_percentile_seconds(double percentile) const;
+
+  //! Samples above seconds, rounded down to a bucket edge.
+  uint64_t get_count_above(double seconds) const;
+
+ private:
+  static constexpr double bucket_width_seconds_ = 0.0005;
+  static constexpr uint32_t number_of_buckets_ = 2000;  //! One second, later samples go to the last bucket.
+
+  std::array<std::atomic<uint64_t>, number_of_buckets_> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<double> maximum_seconds_{0};
+};
+
+//! Puts the sensor timestamps of every frame on the host clock and keeps histograms of how long each stage took and
+//! how old a pose is when it is published, from the exposure of the depth and color the pose was fitted on.
+class LatencyMonitor {
+ public:
+  //! With enable_global_time the devices are switched to librealsense global time. Playback is never mapped.
+  void setup_latency_monitor(const rs2::pipeline_profile &profile, bool enable_global_time,
+                             uint32_t report_interval_frames);
+
+  //! Starts the context of a new frame, called right after wait_for_frames.
+  void begin_frame(const rs2::video_frame &color, const rs2::depth_frame &depth, FrameContext *context);
+
+  //! Marks kPublished and adds the frame to the histograms.
+  void end_frame(FrameContext *context);
+
+  double get_pose_latency_seconds() const;  //! Of the last frame.
+
+  //! For kFrameArrived the time from the sensor to the host, otherwise the duration of the stage.
+  const LatencyHistogram &get_stage_histogram(FrameStage stage) const;
+
+  const LatencyHistogram &get_pose_latency_histogram() const;
+
+  void print_report(std::ostream &stream) const;
+
+ private:
+  //! Smallest offset between the host and device clocks over the last one or two windows. The smallest is the
+  //! frame with the least transfer delay, the window lets it follow the drift between the clocks.
+  struct ClockOffset {
+    double current_minimum_seconds = std::numeric_limits<double>::infinity();
+    double previous_minimum_seconds = std::numeric_limits<double>::infinity();
+    uint32_t frames_in_window = 0;
+  };
+
+  //! Mid exposure of the frame on the host clock.
+  double sensor_time_seconds(const rs2::frame &frame, double arrival_seconds, ClockOffset *clock_offset,
+                             TimestampMapping *mapping);
+
+  static constexpr uint32_t clock_offset_window_frames_ = 300;
+  static constexpr double report_percentile_ = 0.99;
+
+  bool is_playback_ = false;
+  uint32_t report_interval_frames_ = 0;
+  uint64_t frames_ = 0;
+
+  ClockOffset color_clock_offset_;
+  ClockOffset depth_clock_offset_;
+
+  double pose_latency_seconds_ = 0;
+
+  std::array<LatencyHistogram, kNumberOfFrameStages> stage_histograms_;
+  LatencyHistogram pose_latency_histogram_;
+};
+
+#endif  // INCLUDE_LATENCYMONITOR_LATENCYMONITOR_LATENCYMONITOR_H_
@@ -0,0 +1,176 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "MarkerTracker/MarkerTracker.h"
+
+#include <algorithm>
+#include <utility>
+
+MarkerTracker::~MarkerTracker() {
+  shutdown();
+}
+
+void MarkerTracker::setup_marker_tracker(const cv::Ptr<cv::aruco::Dictionary> &dictionary,
+                                         const cv::Mat &camera_matrix,
+                                         const cv::Mat &dist_coefficients,
+                                         float marker_length_meter) {
+  if (tracker_.joinable()) {
+    return;
+  }
+  dictionary_ = dictionary;
+  camera_matrix_ = camera_matrix.clone();
+  dist_coefficients_ = dist_coefficients.clone();
+  marker_length_meter_ = marker_length_meter;
+
+  stop_ = false;
+  tracker_ = std::thread(&MarkerTracker::tracker_loop, this);
+}
+
+void MarkerTracker::set_detector_settings(int adaptive_threshold_window_min,
+                                          int adaptive_threshold_window_max,
+                                          int adaptive_threshold_window_step) {
+  parameters_->adaptiveThreshWinSizeMin = adaptive_threshold_window_min;
+  parameters_->adaptiveThreshWinSizeMax = adaptive_threshold_window_max;
+  parameters_->adaptiveThreshWinSizeStep = adaptive_threshold_window_step;
+}
+
+void MarkerTracker::set_roi_margin_ratio(float roi_margin_ratio) {
+  roi_margin_ratio_ = roi_margin_ratio;
+}
+
+void MarkerTracker::set_rgb_input(bool rgb_input) {
+  gray_conversion_ = rgb_input ? cv::COLOR_RGB2GRAY : cv::COLOR_BGR2GRAY;
+}
+
+void MarkerTracker::submit_frame(const cv::Mat &image, uint64_t frame_number) {
+  if (!tracker_.joinable()) {
+    return;
+  }
+  image.copyTo(submit_image_);  //! Reuses the buffer while the frame size stays the same.
+  {
+    std::lock_guard<std::mutex> lock(frame_mutex_);
+    std::swap(submit_image_, pending_image_);
+    pending_frame_number_ = frame_number;
+    has_pending_frame_ = true;
+  }
+  frame_condition_.notify_one();
+}
+
+MarkerResult MarkerTracker::get_latest_result() const {
+  std::lock_guard<std::mutex> lock(result_mutex_);
+  return latest_result_;
+}
+
+void MarkerTracker::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(frame_mutex_);
+    stop_ = true;
+  }
+  frame_condition_.notify_all();
+  if (tracker_.joinable()) {
+    tracker_.join();
+  }
+}
+
+void MarkerTracker::tracker_loop() {
+  MarkerResult last_result;
+
+  while (true) {
+    uint64_t frame_number;
+    {
+      std::unique_lock<std::mutex> lock(frame_mutex_);
+      frame_condition_.wait(lock, [this]() { return stop_ || has_pending_frame_; });
+      if (stop_) {
+        return;
+      }
+      std::swap(pending_image_, working_image_);
+      frame_number = pending_frame_number_;
+      has_pending_frame_ = false;
+    }
+
+    MarkerResult result;
+    result.frame_number = frame_number;
+    result.marker_id = last_result.marker_id;
+    if (last_result.valid) {
+      result.found_in_roi = detect(working_image_, predict_search_region(last_result, working_image_.size()), &result);
+    }
+    if (!result.valid) {
+      detect(working_image_, cv::Rect(cv::Point(0, 0), working_image_.size()), &result);
+    }
+    last_result = result;
+
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    latest_result_ = result;
+  }
+}
+
+bool MarkerTracker::detect(const cv::Mat &image, cv::Rect search_region, MarkerResult *result) {
+  if (search_region.empty()) {
+    return false;
+  }
+  //! Only the search region is converted, into a view of a full frame buffer so the buffer is never reallocated.
+  gray_image_.create(image.size(), CV_8UC1);
+  cv::Mat gray_region = gray_image_(search_region);
+  cv::cvtColor(image(search_region), gray_region, gray_conversion_);
+
+  cv::aruco::detectMarkers(gray_region,
+                           dictionary_,
+                           marker_corners_,
+                           marker_ids_,
+                           parameters_,
+                           rejected_candidates_);
+  if (marker_ids_.empty()) {
+    return false;
+  }
+
+  size_t marker_index = 0;  //! Keep following the same marker if it is still in view.
+  for (size_t i = 0; i < marker_ids_.size(); ++i) {
+    if (marker_ids_[i] == result->marker_id) {
+      marker_index = i;
+    }
+  }
+
+  const cv::Point2f offset(static_cast<float>(search_region.x), static_cast<float>(search_region.y));
+  pose_corners_.resize(1);
+  pose_corners_[0].resize(result->corners.size());
+  for (size_t i = 0; i < result->corners.size(); ++i) {
+    result->corners[i] = marker_corners_[marker_index][i] + offset;
+    pose_corners_[0][i] = result->corners[i];
+  }
+
+  cv::aruco::estimatePoseSingleMarkers(pose_corners_,
+                                       marker_length_meter_,
+                                       camera_matrix_,
+                                       dist_coefficients_,
+                                       rvecs_,
+                                       tvecs_);
+  if (rvecs_.empty() || tvecs_.empty()) {
+    return false;
+  }
+
+  result->valid = true;
+  result->marker_id = marker_ids_[marker_index];
+  result->rvec = rvecs_.front();
+  result->tvec = tvecs_.front();
+  return true;
+}
+
+cv::Rect MarkerTracker::predict_search_region(const MarkerResult &last_result, const cv::Size &image_size) const {
+  cv::Point2f top_left = last_result.corners.front();
+  cv::Point2f bottom_right = last_result.corners.front();
+  for (const cv::Point2f &corner : last_result.corners) {
+    top_left.x = std::min(top_left.x, corner.x);
+    top_left.y = std::min(top_left.y, corner.y);
+    bottom_right.x = std::max(bottom_right.x, corner.x);
+    bottom_right.y = std::max(bottom_right.y, corner.y);
+  }
+  const cv::Rect marker_box(cv::Point(cvFloor(top_left.x), cvFloor(top_left.y)),
+                            cv::Point(cvCeil(bottom_right.x), cvCeil(bottom_right.y)));
+  const int margin = std::max(minimum_roi_margin_pixels_,
+                              static_cast<int>(roi_margin_ratio_ * std::max(marker_box.width, marker_box.height)));
+  const cv::Rect search_region(marker_box.x - margin,
+                               marker_box.y - margin,
+                               marker_box.width + 2 * margin,
+                               marker_box.height + 2 * margin);
+  return search_region & cv::Rect(cv::Point(0, 0), image_size);
+}
@@ -0,0 +1,103 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_MARKERTRACKER_MARKERTRACKER_MARKERTRACKER_H_
+#define INCLUDE_MARKERTRACKER_MARKERTRACKER_MARKERTRACKER_H_
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "opencv2/aruco.hpp"
+#include "opencv2/opencv.hpp"
+
+//! Marker found in one frame, with its pose in the camera frame.
+struct MarkerResult {
+  uint64_t frame_number = 0;
+  bool valid = false;
+  bool found_in_roi = false;  //! False if the marker needed a full frame search.
+  int marker_id = -1;
+  std::array<cv::Point2f, 4> corners;
+  cv::Vec3d rvec;
+  cv::Vec3d tvec;
+};
+
+//! Ground truth marker detection for evaluation, run on a thread of its own so it does not add to the pose
+//! latency. The marker is searched for in a region around its last position, and in the full frame only when it
+//! is lost. Frames submitted while the tracker is busy replace each other, only the latest is processed. All
+//! frame buffers are reused, so after the first frames only OpenCV's detector allocates.
+class MarkerTracker {
+ public:
+  ~MarkerTracker();
+
+  //! Starts the tracker thread, the set_* functions must be called before this.
+  void setup_marker_tracker(const cv::Ptr<cv::aruco::Dictionary> &dictionary,
+                            const cv::Mat &camera_matrix,
+                            const cv::Mat &dist_coefficients,
+                            float marker_length_meter);
+
+  //! Adaptive threshold window sizes go from window_min to window_max in window_step steps, fewer sizes is faster.
+  void set_detector_settings(int adaptive_threshold_window_min,
+                             int adaptive_threshold_window_max,
+                             int adaptive_threshold_window_step);
+
+  //! The search region is the last marker bounding box grown by roi_margin_ratio of its largest side on all sides.
+  void set_roi_margin_ratio(float roi_margin_ratio);
+
+  void set_rgb_input(bool rgb_input);  //! Submitted images are RGB instead of BGR.
+
+  //! Copies the image, the caller may draw on or release it afterwards.
+  void submit_frame(const cv::Mat &image, uint64_t frame_number);
+
+  //! Result of the latest processed frame, usually one frame behind the submitted ones.
+  MarkerResult get_latest_result() const;
+
+  void shutdown();
+
+ private:
+  void tracker_loop();
+
+  bool detect(const cv::Mat &image, cv::Rect search_region, MarkerResult *result);
+
+  cv::Rect predict_search_region(const MarkerResult &last_result, const cv::Size &image_size) const;
+
+  static constexpr int minimum_roi_margin_pixels_ = 16;  // TODO(simon) Magic number.
+
+  cv::Ptr<cv::aruco::Dictionary> dictionary_;
+  cv::Ptr<cv::aruco::DetectorParameters> parameters_ = cv::aruco::DetectorParameters::create();
+  cv::Mat camera_matrix_;
+  cv::Mat dist_coefficients_;
+  float marker_length_meter_ = 0;
+  float roi_margin_ratio_ = 0.5;  // TODO(simon) Magic number.
+  cv::ColorConversionCodes gray_conversion_ = cv::COLOR_BGR2GRAY;
+
+  //! Triple buffer: the caller copies into submit_image_, swaps it with pending_image_, the tracker swaps that
+  //! with working_image_.
+  cv::Mat submit_image_;
+  cv::Mat pending_image_;
+  cv::Mat working_image_;
+  uint64_t pending_frame_number_ = 0;
+  bool has_pending_frame_ = false;
+
+  //! Tracker thread scratch.
+  cv::Mat gray_image_;
+  std::vector<std::vector<cv::Point2f>> marker_corners_;
+  std::vector<std::vector<cv::Point2f>> rejected_candidates_;
+  std::vector<int> marker_ids_;
+  std::vector<std::vector<cv::Point2f>> pose_corners_;
+  std::vector<cv::Vec3d> rvecs_;
+  std::vector<cv::Vec3d> tvecs_;
+
+  MarkerResult latest_result_;
+  mutable std::mutex result_mutex_;
+
+  std::thread tracker_;
+  std::mutex frame_mutex_;
+  std::condition_variable frame_condition_;
+  bool stop_ = false;
+};
+
+#endif  // INCLUDE_MARKERTRACKER_MARKERTRACKER_MARKERTRACKER_H_
@@ -5,20 +5,41 @@
 
 void ObjectDetection::setup_object_detection() {
   input_model_path_ = std::filesystem::current_path().parent_path() / model_path_;
-  num_classes_ = number_of_classes_;
-  input_dimensions_.width = network_input_dimensions_wh_[width_id_];
-  input_dimensions_.height = network_input_dimensions_wh_[height_id_];
-  device_name_ = inference_device_name_;
 
   std::cout << input_model_path_ << std::endl;
 
-  network_ = ie_.ReadNetwork(input_model_path_);
+  auto startup_begin = std::chrono::steady_clock::now();
+
+  if (!model_cache_path_.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(model_cache_path_, error);
+    ie_->SetConfig({{CONFIG_KEY(CACHE_DIR), model_cache_path_}});
+    std::cout << "Model cache " << model_cache_path_
+              << ", used by every network loaded through the shared inference core" << std::endl;
+  }
+
+  network_ = ie_->ReadNetwork(input_model_path_);
 
   if (network_.getOutputsInfo().size() != 1)  // TODO(simon) Magic number.
     std::cout << "Sample supports topologies with 1 output only" << std::endl;
   if (network_.getInputsInfo().size() != 1)  // TODO(simon) Magic number.
     std::cout << "Sample supports topologies with 1 input only" << std::endl;
 
+  InferenceEngine::ICNNNetwork::InputShapes input_shapes = network_.getInputShapes();
+  InferenceEngine::SizeVector &input_shape = input_shapes.begin()->second;  //! NCHW
+  if (input_shape.at(0) != batch_size_ || input_shape.at(2) != input_dimensions_.height
+      || input_shape.at(3) != input_dimensions_.width) {  // TODO(simon) Magic number.
+    std::cout << "Reshaping network input from " << input_shape.at(0) << "x" << input_shape.at(3) << "x"
+              << input_shape.at(2) << " to " << batch_size_ << "x" << input_dimensions_.width << "x"
+              << input_dimensions_.height << std::endl;
+    input_shape.at(0) = batch_size_;
+    input_shape.at(2) = input_dimensions_.height;  // TODO(simon) Magic number.
+    input_shape.at(3) = input_dimensions_.width;  // TODO(simon) Magic number.
+    network_.reshape(input_shapes);
+  }
+
+  setup_proposal_decoder();
+
   input_info_ = network_.getInputsInfo().begin()->second;
   input_name_ = network_.getInputsInfo().begin()->first;
 
@@ -29,14 +50,59 @@ void ObjectDetection::setup_object_detection() {
   output_info_ = network_.getOutputsInfo().begin()->second;
   output_name_ = network_.getOutputsInfo().begin()->first;
 
-  executable_network_ = ie_.LoadNetwork(network_, device_name_);
+  if (u8_input_) {  //! The plugin converts to the network precision, the host only letterboxes.
+    input_info_->setPrecision(InferenceEngine::Precision::U8);
+    input_info_->setLayout(InferenceEngine::Layout::NHWC);
+  }
+
+  std::map<std::string, std::string> inference_config;
+  if (inference_threads_ > 0) {  //! Share the cores with the application thread pool instead of oversubscribing.
+    inference_config[CONFIG_KEY(CPU_THREADS_NUM)] = std::to_string(inference_threads_);
+    inference_config[CONFIG_KEY(CPU_BIND_THREAD)] =
+        bind_inference_threads_ ? CONFIG_VALUE(YES) : CONFIG_VALUE(NO);
+  }
+
+  const std::filesystem::file_time_type load_begin = std::filesystem::file_time_type::clock::now();
+  executable_network_ = ie_->LoadNetwork(network_, device_name_, inference_config);
+  //! A network compiled from scratch writes its blob to the cache, one loaded from the cache writes nothing.
+  const bool warm_start = !model_cache_path_.empty() && !is_cache_written_since(load_begin);
   infer_request_ = executable_network_.CreateInferRequest();
+  if (u8_input_) {
+    setup_u8_input();
+  }
+
+  startup_time_ms_ = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - startup_begin).count();
+  std::cout << "Model startup: " << startup_time_ms_ << " ms ("
+            << (model_cache_path_.empty() ? "cache disabled" : warm_start ? "loaded from cache" : "compiled, cached")
+            << ")" << std::endl;
+}
+
+void ObjectDetection::setup_u8_input() {
+  //! All images of the batch are stacked in one buffer, wrapped once as the input blob without a copy.
+  input_buffer_.create(batch_size_ * input_dimensions_.height, input_dimensions_.width, CV_8UC3);
+  input_images_.clear();
+  for (uint16_t i = 0; i < batch_size_; ++i) {
+    input_images_.emplace_back(input_buffer_.rowRange(i * input_dimensions_.height,
+                                                      (i + 1) * input_dimensions_.height));
+  }
+
+  InferenceEngine::TensorDesc tensor_desc(InferenceEngine::Precision::U8,
+                                          {batch_size_, 3,  // TODO(simon) Magic number.
+                                           static_cast<size_t>(input_dimensions_.height),
+                                           static_cast<size_t>(input_dimensions_.width)},
+                                          InferenceEngine::Layout::NHWC);
+  infer_request_.SetBlob(input_name_, InferenceEngine::make_shared_blob<uint8_t>(tensor_desc, input_buffer_.data));
 }
 
 void ObjectDetection::run_object_detection(cv::Mat &image) {
-  cv::Mat pr_image = static_resize(image);
-  InferenceEngine::Blob::Ptr imgBlob = infer_request_.GetBlob(input_name_);
-  blobFromImage(pr_image, imgBlob);
+  if (u8_input_) {
+    static_resize(image, &input_images_.at(0));
+  } else {
+    cv::Mat pr_image = static_resize(image);
+    InferenceEngine::Blob::Ptr imgBlob = infer_request_.GetBlob(input_name_);
+    blobFromImage(pr_image, imgBlob);
+  }
 
   infer_request_.Infer();
 
@@ -59,25 +125,88 @@ void ObjectDetection::run_object_detection(cv::Mat &image) {
                              / (image.rows * 1.0));  // TODO(simon) Magic number.
 
   decode_outputs(net_pred, objects_, scale, img_w, img_h);
-  draw_objects(image, objects_);
+  draw_objects(image, objects_, &detection_output_struct_);
+  image_size_ = image.size();
+}
+
+void ObjectDetection::run_object_detection_batch(const std::vector<cv::Mat *> &images, ThreadPool *thread_pool) {
+  if (images.size() > batch_size_) {
+    std::cerr << "Batch of " << images.size() << " images, network batch size is " << batch_size_ << std::endl;
+    return;
+  }
+
+  //! One image per task, every image has its own resized image, objects and detections, so no state is shared.
+  auto for_each_image = [&images, thread_pool](const std::function<void(size_t)> &body) {
+    if (thread_pool == nullptr) {
+      for (size_t i = 0; i < images.size(); ++i) {
+        body(i);
+      }
+      return;
+    }
+    thread_pool->parallel_for(0, images.size(), 1, [&body](size_t chunk_begin, size_t chunk_end) {
+      for (size_t i = chunk_begin; i < chunk_end; ++i) {
+        body(i);
+      }
+    });
+  };
+
+  if (u8_input_) {
+    for_each_image([this, &images](size_t i) { static_resize(*images.at(i), &input_images_.at(i)); });
+  } else {
+    batch_resized_images_.resize(images.size());
+    for_each_image([this, &images](size_t i) { batch_resized_images_.at(i) = static_resize(*images.at(i)); });
+    InferenceEngine::Blob::Ptr imgBlob = infer_request_.GetBlob(input_name_);
+    for (size_t i = 0; i < images.size(); ++i) {
+      blobFromImage(batch_resized_images_.at(i), imgBlob, i);
+    }
+  }
+
+  infer_request_.Infer();  //! Unused slots of a partial batch hold the previous images, their output is ignored.
+
+  const InferenceEngine::Blob::Ptr output_blob = infer_request_.GetBlob(output_name_);
+  moutput_ = InferenceEngine::as<InferenceEngine::MemoryBlob>(output_blob);
+  auto moutputHolder = moutput_->rmap();
+  const auto *net_pred =
+      moutputHolder.as<const InferenceEngine::PrecisionTrait<InferenceEngine::Precision::FP32>::value_type *>();
+  const size_t output_size_per_image = grid_strides_.size() * (num_classes_ + 5);  // TODO(simon) Magic number.
+
+  batch_objects_.resize(images.size());
+  batch_detections_.resize(images.size());
+  batch_image_sizes_.resize(images.size());
+  for_each_image([this, &images, net_pred, output_size_per_image](size_t i) {
+    cv::Mat &image = *images.at(i);
+    float scale = std::min(input_dimensions_.width / (image.cols * 1.0),
+                           input_dimensions_.height / (image.rows * 1.0));
+    decode_outputs(net_pred + i * output_size_per_image, batch_objects_.at(i), scale, image.cols, image.rows);
+    draw_objects(image, batch_objects_.at(i), &batch_detections_.at(i));
+    batch_image_sizes_.at(i) = image.size();
+  });
 }
 
 cv::Mat ObjectDetection::static_resize(cv::Mat &img) {
+  cv::Mat out(input_dimensions_.height, input_dimensions_.width, CV_8UC3);
+  static_resize(img, &out);
+  return out;
+}
+
+void ObjectDetection::static_resize(const cv::Mat &img, cv::Mat *out) {
   float r = std::min(input_dimensions_.width / (img.cols * 1.0),
                      input_dimensions_.height / (img.rows * 1.0));  // TODO(simon) Magic number.
   int unpad_w = r * img.cols;
   int unpad_h = r * img.rows;
-  cv::Mat re(unpad_h, unpad_w, CV_8UC3);
-  cv::resize(img, re, re.size());
-  cv::Mat out(input_dimensions_.height,
-              input_dimensions_.width,
-              CV_8UC3,
-              cv::Scalar(114, 114, 114));  // TODO(simon) Magic number.
-  re.copyTo(out(cv::Rect(0, 0, re.cols, re.rows)));
-  return out;
+  const cv::Scalar padding(114, 114, 114);  // TODO(simon) Magic number.
+
+  //! Resized in place into the top left of out, only the padding right and below it is filled.
+  cv::Mat resized = (*out)(cv::Rect(0, 0, unpad_w, unpad_h));
+  cv::resize(img, resized, resized.size());
+  if (rgb_input_) {
+    cv::cvtColor(resized, resized, cv::COLOR_RGB2BGR);
+  }
+  (*out)(cv::Rect(unpad_w, 0, out->cols - unpad_w, unpad_h)).setTo(padding);
+  (*out)(cv::Rect(0, unpad_h, out->cols, out->rows - unpad_h)).setTo(padding);
 }
 
-void ObjectDetection::blobFromImage(cv::Mat &img, InferenceEngine::Blob::Ptr &blob) {
+void ObjectDetection::blobFromImage(cv::Mat &img, InferenceEngine::Blob::Ptr &blob, size_t batch_index) {
   int channels = 3;  // TODO(simon) Magic number.
   int img_h = img.rows;
   int img_w = img.cols;
@@ -89,7 +218,7 @@ void ObjectDetection::blobFromImage(cv::Mat &img, InferenceEngine::Blob::Ptr &bl
   // locked memory holder should be alive all time while access to its buffer happens
   auto mblobHolder = mblob->wmap();
 
-  float *blob_data = mblobHolder.as<float *>();
+  float *blob_data = mblobHolder.as<float *>() + batch_index * channels * img_w * img_h;
 
   for (size_t c = 0; c < channels; c++) {  // TODO(simon) Magic number.
     for (size_t h = 0; h < img_h; h++) {  // TODO(simon) Magic number.
@@ -106,14 +235,8 @@ void ObjectDetection::decode_outputs(const float *prob,
                                      const int img_w,
                                      const int img_h) {
   std::vector<Object> proposals;
-  std::vector<int> strides = inference_stride_;
-  std::vector<GridAndStride> grid_strides;
 
-  generate_grids_and_stride(input_dimensions_.width,
-                            input_dimensions_.height,
-                            strides,
-                            grid_strides);
-  generate_yolox_proposals(grid_strides, prob, bbox_conf_threshold_, proposals);
+  (this->*proposal_decoder_)(prob, bbox_conf_threshold_, &proposals);
 
   if (proposals.size() > 0) {
     qsort_descent_inplace(proposals,
@@ -163,10 +286,87 @@ void ObjectDetection::generate_grids_and_stride(const int target_w,
   }
 }
 
-void ObjectDetection::generate_yolox_proposals(std::vector<GridAndStride> grid_strides,
+void ObjectDetection::setup_proposal_decoder() {
+  grid_strides_.clear();
+  std::vector<int> strides = inference_stride_;
+  generate_grids_and_stride(input_dimensions_.width,
+                            input_dimensions_.height,
+                            strides,
+                            grid_strides_);
+  select_proposal_decoder();
+}
+
+void ObjectDetection::select_proposal_decoder() {
+  proposal_decoder_ = &ObjectDetection::generate_yolox_proposals_generic;
+  if (inference_stride_ != std::vector<int>{8, 16, 32}) {  // TODO(simon) Magic number.
+    return;
+  }
+  switch (num_classes_) {  //! Add a case to specialize for another model.
+    case 1:
+      proposal_decoder_ = &ObjectDetection::generate_yolox_proposals_fixed<1, 8, 16, 32>;
+      break;
+    case 2:
+      proposal_decoder_ = &ObjectDetection::generate_yolox_proposals_fixed<2, 8, 16, 32>;
+      break;
+    default:
+      break;
+  }
+}
+
+bool ObjectDetection::check_proposal_decoder(uint32_t number_of_outputs, uint32_t seed, float prob_threshold) {
+  setup_proposal_decoder();
+  const size_t output_size = grid_strides_.size() * (num_classes_ + 5);  // TODO(simon) Magic number.
+
+  //! Box offsets around the cell, log sizes around one stride and scores that cross the threshold.
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> offset_distribution(-1, 2);  // TODO(simon) Magic number.
+  std::uniform_real_distribution<float> log_size_distribution(-3, 3);  // TODO(simon) Magic number.
+  std::uniform_real_distribution<float> score_distribution(0, 1);  // TODO(simon) Magic number.
+  std::vector<float> output(output_size);
+  std::vector<Object> selected_objects;
+  std::vector<Object> generic_objects;
+
+  for (uint32_t n = 0; n < number_of_outputs; ++n) {
+    for (size_t i = 0; i < output_size; ++i) {
+      const size_t field = i % (num_classes_ + 5);  // TODO(simon) Magic number.
+      output[i] = field < 2 ? offset_distribution(generator)  // TODO(simon) Magic number.
+          : field < 4 ? log_size_distribution(generator) : score_distribution(generator);  // TODO(simon) Magic number.
+    }
+
+    selected_objects.clear();
+    generic_objects.clear();
+    (this->*proposal_decoder_)(output.data(), prob_threshold, &selected_objects);
+    generate_yolox_proposals_generic(output.data(), prob_threshold, &generic_objects);
+
+    if (selected_objects.size() != generic_objects.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < selected_objects.size(); ++i) {
+      const Object &a = selected_objects.at(i);
+      const Object &b = generic_objects.at(i);
+      if (std::memcmp(&a.rect, &b.rect, sizeof(a.rect)) != 0 || a.label != b.label
+          || std::memcmp(&a.prob, &b.prob, sizeof(a.prob)) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool ObjectDetection::is_proposal_decoder_specialized() const {
+  return proposal_decoder_ != &ObjectDetection::generate_yolox_proposals_generic;
+}
+
+void ObjectDetection::generate_yolox_proposals_generic(const float *feat_ptr,
+                                                       float prob_threshold,
+                                                       std::vector<Object> *objects) const {
+  generate_yolox_proposals(grid_strides_, feat_ptr, prob_threshold, *objects);
+}
+
+void ObjectDetection::generate_yolox_proposals(const std::vector<GridAndStride> &grid_strides,
                                                const float *feat_ptr,
                                                float prob_threshold,
-                                               std::vector<Object> &objects) {
+                                               std::vector<Object> &objects) const {
   const int num_anchors = grid_strides.size();
 
   for (int anchor_idx = 0; anchor_idx < num_anchors; anchor_idx++) {  // TODO(simon) Magic number.
@@ -233,17 +433,8 @@ void ObjectDetection::qsort_descent_inplace(std::vector<Object> &faceobjects,
     }
   }
 
-#pragma omp parallel sections
-  {
-#pragma omp section
-    {
-      if (left < j) qsort_descent_inplace(faceobjects, left, j);
-    }
-#pragma omp section
-    {
-      if (i < right) qsort_descent_inplace(faceobjects, i, right);
-    }
-  }
+  if (left < j) qsort_descent_inplace(faceobjects, left, j);
+  if (i < right) qsort_descent_inplace(faceobjects, i, right);
 }
 void ObjectDetection::nms_sorted_bboxes(const std::vector<Object> &faceobjects,
                                         std::vector<int> &picked,
@@ -282,18 +473,31 @@ float ObjectDetection::intersection_area(const Object &a, const Object &b) {
   return inter.area();
 }
 
-void ObjectDetection::draw_objects(const cv::Mat &bgr, const std::vector<Object> &objects) {
+void ObjectDetection::draw_objects(const cv::Mat &bgr,
+                                   const std::vector<Object> &objects,
+                                   std::vector<object_detection_output> *detections) {
   static const char
       *class_names[] = {  // TODO(simon) Class names should be set in the configuration.
       "pallet"
   };
 
-  detection_output_struct_.clear();
-  detection_output_struct_.resize(objects.size());
+  detections->clear();
+  detections->resize(objects.size());
 
   for (size_t i = 0; i < objects.size(); i++) {   // TODO(simon) Magic number.
     const Object &obj = objects[i];
 
+    // obj.rect.x, obj.rect.y, obj.rect.width, obj.rect.height
+    detections->at(i).x = obj.rect.x;
+    detections->at(i).y = obj.rect.y;
+    detections->at(i).width = obj.rect.width;
+    detections->at(i).height = obj.rect.height;
+    detections->at(i).confidence = static_cast<double>(obj.prob);
+
+    if (!draw_detections_) {
+      continue;
+    }
+
     cv::Scalar color = bounding_box_color_;
     float c_mean = cv::mean(color)[0];  // TODO(simon) Magic number.
     cv::Scalar txt_color;
@@ -330,61 +534,122 @@ void ObjectDetection::draw_objects(const cv::Mat &bgr, const std::vector<Object>
                            cv::Size(label_size.width, label_size.height + baseLine)),
                   txt_bk_color,
                   -1);  // TODO(simon) Magic number.
-    // obj.rect.x, obj.rect.y, obj.rect.width, obj.rect.height
-    detection_output_struct_.at(i).x = obj.rect.x;
-    detection_output_struct_.at(i).y = obj.rect.y;
-    detection_output_struct_.at(i).width = obj.rect.width;
-    detection_output_struct_.at(i).height = obj.rect.height;
-    detection_output_struct_.at(i).confidence = static_cast<double>(obj.prob);
-
     cv::putText(bgr, text, cv::Point(x, y + label_size.height),
                 cv::FONT_HERSHEY_SIMPLEX, 0.4, txt_color, 1);  // TODO(simon) Magic number.
   }
 }
 
 object_detection_output ObjectDetection::get_detection() {
+  return select_detection(detection_output_struct_, image_size_);
+}
+
+object_detection_output ObjectDetection::get_detection(size_t batch_index) {
+  return select_detection(batch_detections_.at(batch_index), batch_image_sizes_.at(batch_index));
+}
+
+object_detection_output ObjectDetection::select_detection(const std::vector<object_detection_output> &detections,
+                                                          const cv::Size &image_size) {
   double max_confidence = 0;
   double max_areal = 0;
   double max_bbox_score = 0;  // TODO(simon) Magic number.
   int iterator_max_confidence = 0;  // TODO(simon) Magic number.
-  uint32_t image_width =
-      1280;  // TODO(simon) Set this as an input image_.cols  // TODO(simon) Magic number.
-  uint32_t image_height =
-      720;  // TODO(simon) Set this as an input image_.rows  // TODO(simon) Magic number.
+  uint32_t image_width = image_size.width;
+  uint32_t image_height = image_size.height;
 
 
-  if (!detection_output_struct_.empty()) {  // TODO(simon) Implement pallet selection with enum pallet_selection_method from PoseEstimation.h
-    for (int i = 0; i < detection_output_struct_.size(); ++i) {  // TODO(simon) Magic number.
-//      if (detection_output_struct_.at(i).confidence > max_confidence){
-//        max_confidence = detection_output_struct_.at(i).confidence; // TODO(simon) Select for max confidence
+  if (!detections.empty()) {  // TODO(simon) Implement pallet selection with enum pallet_selection_method from PoseEstimation.h
+    for (int i = 0; i < detections.size(); ++i) {  // TODO(simon) Magic number.
+//      if (detections.at(i).confidence > max_confidence){
+//        max_confidence = detections.at(i).confidence; // TODO(simon) Select for max confidence
 //        iterator_max_confidence = i;
 //      }
-//      if (detection_output_struct_.at(i).width * detection_output_struct_.at(i).height > max_areal){
-//        max_areal = detection_output_struct_.at(i).width * detection_output_struct_.at(i).height; // TODO(simon) Select for largest size
+//      if (detections.at(i).width * detections.at(i).height > max_areal){
+//        max_areal = detections.at(i).width * detections.at(i).height; // TODO(simon) Select for largest size
 //        iterator_max_confidence = i;
 //      }
-//      if (detection_output_struct_.at(i).y + detection_output_struct_.at(i).height > max_areal){
-//        max_areal = detection_output_struct_.at(i).y + detection_output_struct_.at(i).height; // TODO(simon) Select for lowest detected position
+//      if (detections.at(i).y + detections.at(i).height > max_areal){
+//        max_areal = detections.at(i).y + detections.at(i).height; // TODO(simon) Select for lowest detected position
 //        iterator_max_confidence = i;
 //      }
-      if (box_filtering(image_width, image_height, detection_output_struct_, i) > max_bbox_score) {// TODO(simon) Select for lowest detected position and most center.
-        max_bbox_score = box_filtering(image_width, image_height, detection_output_struct_, i);
+      if (box_filtering(image_width, image_height, detections, i) > max_bbox_score) {// TODO(simon) Select for lowest detected position and most center.
+        max_bbox_score = box_filtering(image_width, image_height, detections, i);
         iterator_max_confidence = i;
       }
     }
   }
 
-  if (!detection_output_struct_.empty()) {
-    return detection_output_struct_.at(iterator_max_confidence);
+  if (!detections.empty()) {
+    return detections.at(iterator_max_confidence);
   }
   object_detection_output non_detect{1, 1, 1, 1, 1.0};  // TODO(simon) Magic number.
 
 
   return non_detect;
 }
+const std::vector<object_detection_output> &ObjectDetection::get_detections() const {
+  return detection_output_struct_;
+}
+const std::vector<object_detection_output> &ObjectDetection::get_batch_detections(size_t batch_index) const {
+  return batch_detections_.at(batch_index);
+}
+void ObjectDetection::set_draw_detections(bool draw_detections) {
+  draw_detections_ = draw_detections;
+}
 void ObjectDetection::set_model_path(std::string path) {
   model_path_ = path;
 }
+void ObjectDetection::set_network_settings(const std::string &device_name,
+                                           uint16_t number_of_classes) {
+  device_name_ = device_name;
+  num_classes_ = number_of_classes;
+}
+void ObjectDetection::set_model_cache_directory(const std::string &relative_path) {
+  if (relative_path.empty()) {
+    model_cache_path_.clear();
+    return;
+  }
+  model_cache_path_ = std::filesystem::current_path().parent_path() / relative_path;
+}
+double ObjectDetection::get_startup_time_ms() const {
+  return startup_time_ms_;
+}
+bool ObjectDetection::is_cache_written_since(std::filesystem::file_time_type time) const {
+  std::error_code error;
+  for (const auto &entry : std::filesystem::directory_iterator(model_cache_path_, error)) {
+    if (entry.last_write_time(error) >= time) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::shared_ptr<InferenceEngine::Core> ObjectDetection::shared_inference_core() {
+  static std::shared_ptr<InferenceEngine::Core> core = std::make_shared<InferenceEngine::Core>();
+  return core;
+}
+void ObjectDetection::set_network_input_dimensions(uint16_t width, uint16_t height) {
+  const int largest_stride = *std::max_element(inference_stride_.begin(), inference_stride_.end());
+  input_dimensions_.width = std::max(largest_stride, width - width % largest_stride);
+  input_dimensions_.height = std::max(largest_stride, height - height % largest_stride);
+
+  if (input_dimensions_.width != width || input_dimensions_.height != height) {
+    std::cerr << "Network input " << width << "x" << height << " is not a multiple of " << largest_stride
+              << ", using " << input_dimensions_.width << "x" << input_dimensions_.height << std::endl;
+  }
+}
+void ObjectDetection::set_inference_threads(uint16_t number_of_threads, bool bind_threads) {
+  inference_threads_ = number_of_threads;
+  bind_inference_threads_ = bind_threads;
+}
+void ObjectDetection::set_u8_input(bool u8_input) {
+  u8_input_ = u8_input;
+}
+void ObjectDetection::set_rgb_input(bool rgb_input) {
+  rgb_input_ = rgb_input;
+}
+void ObjectDetection::set_batch_size(uint16_t batch_size) {
+  batch_size_ = std::max<uint16_t>(1, batch_size);
+}
 void ObjectDetection::set_object_detection_settings(float nms_threshold,
                                                     float bbox_conf_threshold) {
   nms_threshold_ = nms_threshold;  // Default 0.45
@@ -392,16 +657,16 @@ void ObjectDetection::set_object_detection_settings(float nms_threshold,
 }
 double ObjectDetection::box_filtering(double image_width,  // TODO(simon) Filtering of selecting the middle most down box
                                       double image_height,
-                                      std::vector<object_detection_output> detection,
+                                      const std::vector<object_detection_output> &detection,
                                       uint16_t i) {
   double height_fraction_score = 0;
   double width_fraction_score = 0;
   double width_fraction_bias = 0.2;  //! Added constant  // TODO(simon) Magic number.
 
-  std::vector<double> bbox_center_bottom = {static_cast<double>(detection_output_struct_.at(i).x) +
-      static_cast<double>(detection_output_struct_.at(i).width) / 2,
-                                            static_cast<double>(detection_output_struct_.at(i).y) +
-                                                static_cast<double>(detection_output_struct_.at(i).height)};
+  std::vector<double> bbox_center_bottom = {static_cast<double>(detection.at(i).x) +
+      static_cast<double>(detection.at(i).width) / 2,
+                                            static_cast<double>(detection.at(i).y) +
+                                                static_cast<double>(detection.at(i).height)};
 
   height_fraction_score = bbox_center_bottom.at(1) / image_height;  // TODO(simon) Magic number.
 
@@ -12,10 +12,18 @@
 #include <filesystem>
 #include <algorithm>
 #include <utility>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <cstring>
 
 #include <inference_engine.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "ThreadPool/ThreadPool.h"
+
 struct dimensions {
   int width;
   int height;
@@ -45,9 +53,9 @@ class ObjectDetection {  // TODO(simon) Add Doxygen documentation.
  public:
   //! Variables
 
-  static constexpr uint16_t number_of_classes_ = 1; // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr uint16_t network_input_dimensions_wh_[2] = {640, 640}; // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr char inference_device_name_[] = "CPU"; // TODO(simon) Unconst this and implement in configuration file.
+  static constexpr uint16_t number_of_classes_ = 1;  //! Default, overridden by set_network_settings.
+  static constexpr uint16_t network_input_dimensions_wh_[2] = {640, 640};  //! Default, overridden by set_network_input_dimensions.
+  static constexpr char inference_device_name_[] = "CPU";  //! Default, overridden by set_network_settings.
 
   const std::vector<int> inference_stride_ = {8, 16, 32};  // TODO(simon) Unconst this and implement in configuration file.
   const cv::Scalar bounding_box_color_ = {100, 100, 100};  // TODO(simon) Unconst this and implement in configuration file.
@@ -61,17 +69,69 @@ class ObjectDetection {  // TODO(simon) Add Doxygen documentation.
 
   void run_object_detection(cv::Mat &image);  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
 
+  //! One inference for up to batch size images, e.g. one frame of every camera or consecutive frames of a
+  //! recording. Detections are drawn on the images. With a thread pool the letterboxing and decoding of the images
+  //! run in parallel. Detections are the same as running the images one by one.
+  void run_object_detection_batch(const std::vector<cv::Mat *> &images, ThreadPool *thread_pool = nullptr);
+
   void set_model_path(std::string path);
 
   void set_object_detection_settings(float nms_threshold, float bbox_conf_threshold);
 
+  void set_network_settings(const std::string &device_name, uint16_t number_of_classes);
+
+  //! Reshapes the network at setup. Both sides are rounded down to a multiple of the largest stride.
+  void set_network_input_dimensions(uint16_t width, uint16_t height);
+
+  void set_inference_threads(uint16_t number_of_threads, bool bind_threads);  //! 0 leaves the plugin default.
+
+  void set_batch_size(uint16_t batch_size);  //! Reshapes the network at setup.
+
+  //! Declares the network input U8 NHWC at setup. Frames are letterboxed straight into the input blob and the
+  //! plugin converts them to the network precision, instead of writing a float blob on the host.
+  void set_u8_input(bool u8_input);
+
+  //! Images handed in are RGB, as delivered by the camera. The channels are swapped after the letterbox resize, on
+  //! the network sized image, instead of converting the full frame first. Drawn detections get swapped colors.
+  void set_rgb_input(bool rgb_input);
+
+  void set_model_cache_directory(const std::string &relative_path);  //! Empty disables the compiled model cache.
+
+  double get_startup_time_ms() const;
+
+  //! One Core per process, so plugins and compiled kernels are shared by all detectors.
+  static std::shared_ptr<InferenceEngine::Core> shared_inference_core();
+
   object_detection_output get_detection();
 
+  object_detection_output get_detection(size_t batch_index);  //! Selected detection of one image of the last batch.
+
+  const std::vector<object_detection_output> &get_detections() const;  //! All detections after NMS.
+
+  //! All detections after NMS of one image of the last batch.
+  const std::vector<object_detection_output> &get_batch_detections(size_t batch_index) const;
+
+  void set_draw_detections(bool draw_detections);
+
+  //! Decodes number_of_outputs random network outputs, for the current class count and input dimensions, with the
+  //! decoder selected at setup and with the generic one. Returns false unless the proposals are bit identical. Needs
+  //! no model, see src/proposal_decoder_check.cc.
+  bool check_proposal_decoder(uint32_t number_of_outputs, uint32_t seed, float prob_threshold);
+
+  bool is_proposal_decoder_specialized() const;
+
  private:   // TODO(simon) Add magic numbers from ObjectDetection.cc here with "static constexpr" as prefix.
   cv::Mat static_resize(cv::Mat &img);  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
 
+  void static_resize(const cv::Mat &img, cv::Mat *out);  //! Letterboxes into out, already of the input dimensions.
+
+  void setup_u8_input();
+
+  bool is_cache_written_since(std::filesystem::file_time_type time) const;  //! Any file in the model cache directory.
+
   void blobFromImage(cv::Mat &img,
-                     InferenceEngine::Blob::Ptr &blob);  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
+                     InferenceEngine::Blob::Ptr &blob,  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
+                     size_t batch_index = 0);
 
   void decode_outputs(const float *prob,
                       std::vector<Object> &objects,  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
@@ -84,10 +144,30 @@ class ObjectDetection {  // TODO(simon) Add Doxygen documentation.
                                  std::vector<int> &strides,  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
                                  std::vector<GridAndStride> &grid_strides);  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
 
-  void generate_yolox_proposals(std::vector<GridAndStride> grid_strides,
+  void generate_yolox_proposals(const std::vector<GridAndStride> &grid_strides,
                                 const float *feat_ptr,
                                 float prob_threshold,
-                                std::vector<Object> &objects);  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
+                                std::vector<Object> &objects) const;  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
+
+  using ProposalDecoder = void (ObjectDetection::*)(const float *, float, std::vector<Object> *) const;
+
+  //! Builds the grid for the input dimensions and selects the decoder.
+  void setup_proposal_decoder();
+
+  //! Picks a decoder specialized on the class count and strides of the model, or the generic one.
+  void select_proposal_decoder();
+
+  void generate_yolox_proposals_generic(const float *feat_ptr, float prob_threshold, std::vector<Object> *objects) const;
+
+  //! Same proposals as the generic decoder, with the grid walked stride by stride instead of looked up, the class loop
+  //! unrolled and the box only decoded for anchors above the threshold.
+  template<int NumClasses, int... Strides>
+  void generate_yolox_proposals_fixed(const float *feat_ptr, float prob_threshold, std::vector<Object> *objects) const;
+
+  template<int NumClasses, int Stride>
+  const float *generate_yolox_proposals_stride(const float *feat_ptr,
+                                               float prob_threshold,
+                                               std::vector<Object> *objects) const;
 
   void qsort_descent_inplace(std::vector<Object> &objects);  // TODO(simon) Check if this is a non-const reference. If so, make const or use a pointer.
 
@@ -101,25 +181,41 @@ class ObjectDetection {  // TODO(simon) Add Doxygen documentation.
 
   inline float intersection_area(const Object &a, const Object &b);
 
-  void draw_objects(const cv::Mat &bgr, const std::vector<Object> &objects);
+  void draw_objects(const cv::Mat &bgr,
+                    const std::vector<Object> &objects,
+                    std::vector<object_detection_output> *detections);
+
+  //! The boxes are scored by their position in the image they were detected in.
+  object_detection_output select_detection(const std::vector<object_detection_output> &detections,
+                                           const cv::Size &image_size);
 
   double box_filtering(double image_width,
                        double image_height,
-                       std::vector<object_detection_output> detection,
+                       const std::vector<object_detection_output> &detection,
                        uint16_t i);
 
   //! Settings
 
   float nms_threshold_;
   float bbox_conf_threshold_;
-  int num_classes_;
-  dimensions input_dimensions_;
+  int num_classes_ = number_of_classes_;
+  dimensions input_dimensions_ = {network_input_dimensions_wh_[width_id_], network_input_dimensions_wh_[height_id_]};
+  std::vector<GridAndStride> grid_strides_;  //! Built once at setup for the selected input dimensions.
+  ProposalDecoder proposal_decoder_ = &ObjectDetection::generate_yolox_proposals_generic;
   std::string model_path_;
   std::string input_model_path_;
-  std::string device_name_;
+  std::string device_name_ = inference_device_name_;
+  std::string model_cache_path_;
+  double startup_time_ms_ = 0;
+  bool draw_detections_ = true;
+  uint16_t inference_threads_ = 0;
+  uint16_t batch_size_ = 1;
+  bool u8_input_ = false;
+  bool rgb_input_ = false;
+  bool bind_inference_threads_ = false;
 
   //! OpenVino
-  InferenceEngine::Core ie_;
+  std::shared_ptr<InferenceEngine::Core> ie_ = shared_inference_core();
   InferenceEngine::CNNNetwork network_;
   InferenceEngine::InputInfo::Ptr input_info_;
   InferenceEngine::DataPtr output_info_;
@@ -132,6 +228,57 @@ class ObjectDetection {  // TODO(simon) Add Doxygen documentation.
   std::string output_name_;
 
   std::vector<object_detection_output> detection_output_struct_;
+  cv::Size image_size_;  //! Size of the image of detection_output_struct_.
+  cv::Mat input_buffer_;  //! U8 NHWC input blob memory, batch_size images stacked vertically.
+  std::vector<cv::Mat> input_images_;  //! One view into input_buffer_ per image of the batch.
+  std::vector<cv::Mat> batch_resized_images_;
+  std::vector<std::vector<Object>> batch_objects_;
+  std::vector<std::vector<object_detection_output>> batch_detections_;
+  std::vector<cv::Size> batch_image_sizes_;
 };
 
+template<int NumClasses, int... Strides>
+void ObjectDetection::generate_yolox_proposals_fixed(const float *feat_ptr,
+                                                     float prob_threshold,
+                                                     std::vector<Object> *objects) const {
+  //! The anchors of the strides follow each other in the output, each stride returns where the next one starts.
+  ((feat_ptr = generate_yolox_proposals_stride<NumClasses, Strides>(feat_ptr, prob_threshold, objects)), ...);
+}
+
+template<int NumClasses, int Stride>
+const float *ObjectDetection::generate_yolox_proposals_stride(const float *feat_ptr,
+                                                              float prob_threshold,
+                                                              std::vector<Object> *objects) const {
+  constexpr int anchor_size = NumClasses + 5;  // TODO(simon) Magic number.
+  const int num_grid_w = input_dimensions_.width / Stride;
+  const int num_grid_h = input_dimensions_.height / Stride;
+
+  for (int grid1 = 0; grid1 < num_grid_h; grid1++) {
+    for (int grid0 = 0; grid0 < num_grid_w; grid0++, feat_ptr += anchor_size) {
+      const float box_objectness = feat_ptr[4];  // TODO(simon) Magic number.
+      for (int class_idx = 0; class_idx < NumClasses; class_idx++) {
+        const float box_prob = box_objectness * feat_ptr[5 + class_idx];  // TODO(simon) Magic number.
+        if (box_prob <= prob_threshold) {
+          continue;
+        }
+        //! Same expressions as the generic decoder, so the boxes are bit identical.
+        float x_center = (feat_ptr[0] + grid0) * Stride;
+        float y_center = (feat_ptr[1] + grid1) * Stride;
+        float w = exp(feat_ptr[2]) * Stride;
+        float h = exp(feat_ptr[3]) * Stride;
+
+        Object obj;
+        obj.rect.x = x_center - w * 0.5f;  // TODO(simon) Magic number.
+        obj.rect.y = y_center - h * 0.5f;  // TODO(simon) Magic number.
+        obj.rect.width = w;
+        obj.rect.height = h;
+        obj.label = class_idx;
+        obj.prob = box_prob;
+        objects->emplace_back(obj);
+      }
+    }
+  }
+  return feat_ptr;
+}
+
 #endif  // INCLUDE_OBJECTDETECTION_OBJECTDETECTION_OBJECTDETECTION_H_
@@ -0,0 +1,144 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "PalletFaceSolver/PalletFaceSolver.h"
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/Geometry>
+
+#include <cmath>
+
+void PalletFaceSolver::set_solver_settings(uint16_t ransac_iterations,
+                                           double distance_threshold_meter,
+                                           uint16_t refinement_iterations) {
+  ransac_iterations_ = ransac_iterations;
+  distance_threshold_meter_ = distance_threshold_meter;
+  refinement_iterations_ = refinement_iterations;
+}
+
+template<typename PointT>
+bool PalletFaceSolver::solve(const pcl::PointCloud<PointT> &cloud,
+                             const std::vector<float> &ground_coefficients,
+                             std::vector<float> *face_coefficients) {
+  if (ground_coefficients.size() != number_of_plane_coefficients_) {
+    return false;
+  }
+  Eigen::Vector3f ground_normal(ground_coefficients[0], ground_coefficients[1], ground_coefficients[2]);
+  const float ground_normal_norm = ground_normal.norm();
+  if (ground_normal_norm <= 0) {
+    return false;
+  }
+  ground_normal /= ground_normal_norm;
+  const float ground_offset = ground_coefficients[3] / ground_normal_norm;
+
+  //! In-plane basis of the ground, any pair orthogonal to the normal.
+  const Eigen::Vector3f first_axis = ground_normal.unitOrthogonal();
+  const Eigen::Vector3f second_axis = ground_normal.cross(first_axis);
+
+  projected_points_.clear();
+  for (const auto &point : cloud.points) {
+    const Eigen::Vector3f position(point.x, point.y, point.z);
+    if (!position.allFinite() || position.z() <= 0
+        || std::abs(ground_normal.dot(position) + ground_offset) < distance_threshold_meter_) {
+      continue;
+    }
+    projected_points_.emplace_back(first_axis.dot(position), second_axis.dot(position));
+  }
+
+  Eigen::Vector2f line_normal;
+  float line_offset;
+  if (!fit_line(projected_points_, &line_normal, &line_offset)) {
+    return false;
+  }
+  refine_line(projected_points_, &line_normal, &line_offset);
+
+  //! The line n . q = c in ground coordinates is the plane (n1 * e1 + n2 * e2) . p - c = 0.
+  Eigen::Vector4f face;
+  face.head<3>() = line_normal.x() * first_axis + line_normal.y() * second_axis;
+  face.w() = -line_offset;
+  if (face.z() < 0) {
+    face = -face;
+  }
+
+  face_coefficients->assign(face.data(), face.data() + number_of_plane_coefficients_);
+  return true;
+}
+
+template bool PalletFaceSolver::solve<pcl::PointXYZ>(const pcl::PointCloud<pcl::PointXYZ> &,
+                                                     const std::vector<float> &,
+                                                     std::vector<float> *);
+template bool PalletFaceSolver::solve<pcl::PointNormal>(const pcl::PointCloud<pcl::PointNormal> &,
+                                                        const std::vector<float> &,
+                                                        std::vector<float> *);
+
+bool PalletFaceSolver::fit_line(const Points2d &points, Eigen::Vector2f *line_normal, float *line_offset) {
+  if (points.size() < minimum_line_inliers_) {
+    return false;
+  }
+
+  std::uniform_int_distribution<size_t> random_index(0, points.size() - 1);
+  size_t best_number_of_inliers = 0;
+
+  for (uint16_t iteration = 0; iteration < ransac_iterations_; ++iteration) {
+    const Eigen::Vector2f &first_sample = points[random_index(random_generator_)];
+    const Eigen::Vector2f &second_sample = points[random_index(random_generator_)];
+    const Eigen::Vector2f direction = second_sample - first_sample;
+    if (direction.norm() < minimum_sample_distance_meter_) {
+      continue;
+    }
+
+    const Eigen::Vector2f normal = Eigen::Vector2f(-direction.y(), direction.x()).normalized();
+    const float offset = normal.dot(first_sample);
+
+    size_t number_of_inliers = 0;
+    for (const auto &point : points) {
+      if (std::abs(normal.dot(point) - offset) < distance_threshold_meter_) {
+        number_of_inliers++;
+      }
+    }
+    if (number_of_inliers > best_number_of_inliers) {
+      best_number_of_inliers = number_of_inliers;
+      *line_normal = normal;
+      *line_offset = offset;
+    }
+  }
+
+  return best_number_of_inliers >= minimum_line_inliers_;
+}
+
+void PalletFaceSolver::refine_line(const Points2d &points, Eigen::Vector2f *line_normal, float *line_offset) {
+  const float cutoff = tukey_scale_ * distance_threshold_meter_;
+
+  for (uint16_t iteration = 0; iteration < refinement_iterations_; ++iteration) {
+    float weight_sum = 0;
+    Eigen::Vector2f weighted_mean = Eigen::Vector2f::Zero();
+    std::vector<float> &weights = weights_;
+    weights.resize(points.size());
+
+    for (size_t i = 0; i < points.size(); ++i) {
+      const float residual = (line_normal->dot(points[i]) - *line_offset) / cutoff;
+      weights[i] = std::abs(residual) < 1 ? (1 - residual * residual) * (1 - residual * residual) : 0;
+      weight_sum += weights[i];
+      weighted_mean += weights[i] * points[i];
+    }
+    if (weight_sum <= 0) {
+      return;
+    }
+    weighted_mean /= weight_sum;
+
+    Eigen::Matrix2f covariance = Eigen::Matrix2f::Zero();
+    for (size_t i = 0; i < points.size(); ++i) {
+      const Eigen::Vector2f centered = points[i] - weighted_mean;
+      covariance += weights[i] * centered * centered.transpose();
+    }
+
+    //! The line normal is the direction of least spread, eigenvalues are sorted in increasing order.
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix2f> eigen_solver(covariance);
+    Eigen::Vector2f normal = eigen_solver.eigenvectors().col(0);
+    if (normal.dot(*line_normal) < 0) {
+      normal = -normal;
+    }
+    *line_normal = normal;
+    *line_offset = normal.dot(weighted_mean);
+  }
+}
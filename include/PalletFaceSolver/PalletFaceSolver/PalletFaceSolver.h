@@ -0,0 +1,55 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_PALLETFACESOLVER_PALLETFACESOLVER_PALLETFACESOLVER_H_
+#define INCLUDE_PALLETFACESOLVER_PALLETFACESOLVER_PALLETFACESOLVER_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+//! Fits the pallet face as a plane perpendicular to a known ground plane. The points are projected onto the ground
+//! plane, a 2D line is found with RANSAC and refined with iteratively reweighted least squares, and the face is the
+//! plane through that line along the ground normal. One rotational degree of freedom instead of three.
+class PalletFaceSolver {
+ public:
+  void set_solver_settings(uint16_t ransac_iterations,
+                           double distance_threshold_meter,
+                           uint16_t refinement_iterations);
+
+  //! Writes the face plane (a, b, c, d) with the normal pointing away from the camera. Points closer than the
+  //! distance threshold to the ground plane are ignored. Returns false if no line has enough inliers.
+  template<typename PointT>
+  bool solve(const pcl::PointCloud<PointT> &cloud,
+             const std::vector<float> &ground_coefficients,
+             std::vector<float> *face_coefficients);
+
+ private:
+  using Points2d = std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f>>;
+
+  bool fit_line(const Points2d &points, Eigen::Vector2f *line_normal, float *line_offset);
+
+  //! Weighted total least squares line with Tukey weights, starting from the RANSAC line.
+  void refine_line(const Points2d &points, Eigen::Vector2f *line_normal, float *line_offset);
+
+  static constexpr uint8_t number_of_plane_coefficients_ = 4;
+  static constexpr uint8_t minimum_line_inliers_ = 10;
+  static constexpr float minimum_sample_distance_meter_ = 0.01;
+  static constexpr float tukey_scale_ = 2;  //! Residuals beyond this many distance thresholds get zero weight.
+
+  uint16_t ransac_iterations_ = 50;
+  double distance_threshold_meter_ = 0.02;
+  uint16_t refinement_iterations_ = 5;
+
+  std::mt19937 random_generator_{0};  //! Fixed seed, so a recorded run is reproducible.
+  Points2d projected_points_;
+  std::vector<float> weights_;
+};
+
+#endif  // INCLUDE_PALLETFACESOLVER_PALLETFACESOLVER_PALLETFACESOLVER_H_
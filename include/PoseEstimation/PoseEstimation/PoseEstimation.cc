@@ -3,17 +3,72 @@
 
 #include "PoseEstimation/PoseEstimation.h"
 
+PoseEstimation::PoseEstimation(Configuration &configuration, uint16_t source_id, SharedDetector *shared_detector)
+    : configuration_(configuration),
+      settings_(configuration.get_settings()),
+      tunable_(configuration.get_tunable_settings()),
+      source_id_(source_id),
+      shared_detector_(shared_detector) {
+  if (source_id_ < settings_.sources.size()) {
+    source_ = settings_.sources.at(source_id_);
+  }
+  //! OpenCV and PCL windows are not thread safe, only the first camera, run on the main thread, shows them.
+  enable_visualization_ = settings_.enable_visualization && source_id_ == 0;
+}
+
 void PoseEstimation::run_pose_estimation() {
+  tunable_ = configuration_.get_tunable_settings();
+  if (shared_detector_ != nullptr) {
+    shared_detector_->set_object_detection_settings(tunable_->object_detection_nms_threshold,
+                                                    tunable_->object_detection_bbox_conf_threshold);
+  } else {
+    object_detection_object_.set_object_detection_settings(tunable_->object_detection_nms_threshold,
+                                                           tunable_->object_detection_bbox_conf_threshold);
+  }
+
+  if (++frames_since_configuration_check_ >= settings_.configuration_reload_check_interval_frames &&
+      (!configuration_reload_task_.valid() ||
+          configuration_reload_task_.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+    frames_since_configuration_check_ = 0;
+    configuration_reload_task_ = thread_pool_.submit([this]() {
+      return configuration_.reload_tunable_settings_if_changed();
+    });
+  }
+
   rs2::frameset frames = p.wait_for_frames();
   rs2::video_frame image = frames.get_color_frame();
   rs2::depth_frame depth = frames.get_depth_frame();
+  latency_monitor_.begin_frame(image, depth, &frame_context_);
+  frame_recorder_.begin_frame(image, depth);  //! Before the color image is converted in place.
 
-  realsense_points_ = realsense_pointcloud_.calculate(depth);
-  pcl_points_ = points_to_pcl(realsense_points_);
+  const int w = image.as<rs2::video_frame>().get_width();
+  const int h = image.as<rs2::video_frame>().get_height();
 
-  detection_output_struct_ = object_detection_object_.get_detection();
+  cv::Mat cv_image(cv::Size(w, h),
+                   CV_8UC3,
+                   (void *) image.get_data(),  // TODO(simon) Using C-style cast.  Use reinterpret_cast<void *>(...) instead.
+                   cv::Mat::AUTO_STEP);
+  if (convert_color_frame_) {
+    cv::cvtColor(cv_image, cv_image, cv::COLOR_RGB2BGR);
+  }
+
+  image_ = cv_image;
+
+  calculate_aruco(frame_context_.frame_number);
+  frame_context_.mark(kMarker);
+
+  //! The detection runs on this frame's image before any depth is touched, so the depth stages below only do work
+  //! for a detection that can give a pose.
+  if (shared_detector_ != nullptr) {
+    shared_detector_->run_object_detection(source_id_, image_);
+    detection_output_struct_ = shared_detector_->get_detection(source_id_);
+  } else {
+    object_detection_object_.run_object_detection(image_);
+    detection_output_struct_ = object_detection_object_.get_detection();
+  }
+  frame_context_.mark(kDetection);
 
-  if (std::chrono::system_clock::now() > start_debug_time_ && enable_debug_mode_) {
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
     std::cout << " X: " << detection_output_struct_.x
               << " Y: " << detection_output_struct_.y
               << " Width: " << detection_output_struct_.width
@@ -21,91 +76,332 @@ void PoseEstimation::run_pose_estimation() {
               << " Conf: " << detection_output_struct_.confidence << std::endl;
   }
 
-  calculate_3d_crop();
-  edit_pointcloud();
+  has_detection_ = detection_output_struct_.width > tunable_->minimum_object_detection_width_pixels &&
+      detection_output_struct_.height > tunable_->minimum_object_detection_height_pixels;
+  const bool has_detection = has_detection_;
+  const bool crop_from_depth = settings_.enable_roi_alignment && camera_alignment_.is_setup();
+
+  //! The full cloud is only needed by the viewer and by the frustum crop, the ROI alignment crops the depth frame
+  //! directly.
+  camera_alignment_.update_depth_stream(depth);
+  if (enable_visualization_ || (has_detection && !crop_from_depth)) {
+    calculate_pointcloud(depth);
+  } else {
+    pcl_points_ = nullptr;
+  }
+  frame_context_.mark(kPointCloud);
+
+  ground_sample_ = nullptr;
+  if (has_detection) {
+    calculate_3d_crop();
+    edit_pointcloud(depth);
+    if (settings_.enable_ground_plane_prior && ground_plane_.is_calibrated()) {
+      calculate_ground_sample(depth);
+    }
+  } else {
+    cloud_pallet_ = frame_arena_.acquire_cloud<pcl::PointXYZ>();
+    frustum_filter_inliers_.clear();
+    square_frustum_detection_points_.clear();
+  }
+  frame_context_.mark(kCrop);
 
-  if (std::chrono::system_clock::now() > start_debug_time_ && enable_debug_mode_) {
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
     std::cout << "cloud_pallet_->size(): " << cloud_pallet_->size() << std::endl;
   }
 
-  if (detection_output_struct_.width > minimum_object_detection_width_pixels_ &&
-      detection_output_struct_.height > minimum_object_detection_height_pixels_ &&
-      wait_with_ransac_for_ > minimum_iterations_before_ransac_) {
+  if (has_detection && wait_with_ransac_for_ > minimum_iterations_before_ransac_) {
     calculate_ransac();
   }
-  if (ransac_model_coefficients_.size() > minimum_ransac_coefficients_) {
+  pose_vector_valid_ = false;
+  pose_quality_metrics_ = PoseQualityMetrics();
+  pose_quality_metrics_.roi_points = static_cast<uint32_t>(cloud_pallet_->size());
+  if (has_plane_fits()) {
     calculate_pose_vector();
+    calculate_pose_quality();
   }
   wait_with_ransac_for_++;
+  frame_context_.mark(kPlaneFit);
+
+  pose_filter_accepted_ = false;
+  if (settings_.enable_pose_filter && pose_vector_valid_) {
+    pose_filter_.set_filter_settings(tunable_->pose_filter_process_noise_acceleration,
+                                     tunable_->pose_filter_process_noise_yaw_acceleration,
+                                     tunable_->pose_filter_measurement_noise_position_meter,
+                                     tunable_->pose_filter_measurement_noise_yaw_radians,
+                                     tunable_->pose_filter_gate_threshold,
+                                     tunable_->pose_filter_maximum_consecutive_rejections,
+                                     tunable_->pose_filter_maximum_prediction_horizon_seconds);
+    const Eigen::Vector3d position(plane_frustum_vector_intersect_.x,
+                                   plane_frustum_vector_intersect_.y,
+                                   plane_frustum_vector_intersect_.z);
+    const double yaw_radians = std::atan2(pose_vector_end_point_.x - plane_frustum_vector_intersect_.x,
+                                          pose_vector_end_point_.z - plane_frustum_vector_intersect_.z);
+    pose_filter_accepted_ = pose_filter_.update(frame_context_.timestamp_seconds, position, yaw_radians);
+
+    if (!pose_filter_accepted_ && settings_.enable_debug_mode) {
+      std::cout << "Pose filter rejected the measurement" << std::endl;
+    }
+  }
+  frame_context_.mark(kPoseFilter);
 
-  view_pointcloud();
-
-  const int w = image.as<rs2::video_frame>().get_width();
-  const int h = image.as<rs2::video_frame>().get_height();
-
-  cv::Mat cv_image(cv::Size(w, h),
-                   CV_8UC3,
-                   (void *) image.get_data(),  // TODO(simon) Using C-style cast.  Use reinterpret_cast<void *>(...) instead.
-                   cv::Mat::AUTO_STEP);
-  cv::cvtColor(cv_image, cv_image, cv::COLOR_BGR2RGB);
-
-  image_ = cv_image;
-
-  calculate_aruco();
-  object_detection_object_.run_object_detection(image_);
   calculate_pose();
+  calculate_ground_truth_vector();
+  if (enable_visualization_) {
+    view_pointcloud();
+  }
 
-  log_data(image.get_frame_number());
-  cv::imshow(opencv_image_window_name_, cv_image);
-  cv::waitKey(cv_waitkey_delay_);
+  publish_pose_result();
+  log_data(frame_context_.frame_number);
+  pose_export_.publish_preview(cv_image, frame_context_.frame_number);
+  if (enable_visualization_) {
+    cv::imshow(opencv_image_window_name_, cv_image);
+    cv::waitKey(cv_waitkey_delay_);
+  }
 
-  ransac_model_coefficients_.clear();
+  clear_plane_fits();
+
+  size_t frame_arena_new_buffers = frame_arena_.reset();
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
+    std::cout << "Frame arena new buffers: " << frame_arena_new_buffers
+              << ", buffers: " << frame_arena_.get_number_of_buffers() << std::endl;
+  }
 }
 
-void PoseEstimation::setup_pose_estimation() {
-  rosbag_path_ = std::filesystem::current_path().parent_path() / rosbag_relative_path_;
+bool PoseEstimation::setup_pose_estimation() {
+  rosbag_path_ = std::filesystem::current_path().parent_path() /
+      (source_.rosbag_relative_path.empty() ? settings_.rosbag_relative_path : source_.rosbag_relative_path);
 
-  if (load_from_rosbag) {
+  rs2::pipeline_profile profile;
+  if (settings_.load_from_rosbag) {
     std::cout << "Loaded rosbag: " << rosbag_path_ << std::endl;
     rs2::config cfg;
-    cfg.enable_device_from_file(rosbag_path_, !single_run_);
-    auto profile = p.start(cfg);
+    cfg.enable_device_from_file(rosbag_path_, !settings_.single_run);
+    profile = p.start(cfg);
     auto dev = profile.get_device();
 
     if (auto p = dev.as<rs2::playback>()) {
       p.set_real_time(realsense_skip_frames_);
     }
 
-  } else if (!load_from_rosbag) {
-    p.start();
+  } else if (!settings_.load_from_rosbag) {
+    rs2::config cfg;
+    if (!source_.serial_number.empty()) {
+      cfg.enable_device(source_.serial_number);
+    }
+    rs2::config default_cfg = cfg;
+    //! Asking for the format and size the pipeline works on saves converting and resizing every frame on the host.
+    if (settings_.capture_color_format != "BGR8" && settings_.capture_color_format != "RGB8") {
+      std::cerr << "Unknown color format " << settings_.capture_color_format << ", using BGR8" << std::endl;
+    }
+    cfg.enable_stream(RS2_STREAM_COLOR,
+                      settings_.capture_color_width,
+                      settings_.capture_color_height,
+                      settings_.capture_color_format == "RGB8" ? RS2_FORMAT_RGB8 : RS2_FORMAT_BGR8,
+                      settings_.capture_color_fps);
+    cfg.enable_stream(RS2_STREAM_DEPTH);
+    if (cfg.can_resolve(p)) {
+      profile = p.start(cfg);
+    } else {
+      std::cerr << "Color stream " << settings_.capture_color_format << " " << settings_.capture_color_width << "x"
+                << settings_.capture_color_height << " not supported, using the device default" << std::endl;
+      profile = p.start(default_cfg);
+    }
+  }
+  if (!source_.name.empty()) {
+    std::cout << "Source " << source_id_ << ": " << source_.name << std::endl;
+  }
+
+  camera_alignment_.setup_camera_alignment(profile, &thread_pool_);
+
+  //! RGB frames are only converted to BGR as a whole when something shows them or another camera's detector needs
+  //! them. Otherwise the detector swaps the channels of its letterboxed copy and the tag search of its gray copy.
+  color_format_ = profile.get_stream(RS2_STREAM_COLOR).format();
+  if (color_format_ != RS2_FORMAT_RGB8 && color_format_ != RS2_FORMAT_BGR8) {
+    std::cerr << "Unsupported color format " << rs2_format_to_string(color_format_) << std::endl;
   }
+  show_color_frame_ = enable_visualization_ ||
+      (settings_.enable_pose_export && settings_.pose_export_preview_format != "NONE");
+  convert_color_frame_ = color_format_ == RS2_FORMAT_RGB8 && (show_color_frame_ || shared_detector_ != nullptr);
+  const bool rgb_color_frame = color_format_ == RS2_FORMAT_RGB8 && !convert_color_frame_;
 
-  if (enable_logger_) {
-    std::ofstream LoggerFile(std::filesystem::current_path().parent_path() / "log/data_out.csv");
-    LoggerFile << "frame,p_x,p_y,p_z,p_r,p_p,p_y,a_x,a_y,a_z,a_r,a_p,a_y" << std::endl;
+  if (settings_.enable_logger) {
+    std::ofstream LoggerFile(std::filesystem::current_path().parent_path() /
+      source_relative_path(settings_.logger_file_save_relative_path));
+    LoggerFile << "frame,p_x,p_y,p_z,p_r,p_p,p_y,a_x,a_y,a_z,a_r,a_p,a_y,f_t,f_x,f_y,f_z,f_yaw" << std::endl;
     LoggerFile.close();
   }
 
   set_camera_parameters();
 
-  object_detection_object_.set_model_path(object_detection_model_relative_path_);
-  object_detection_object_.set_object_detection_settings(object_detection_nms_threshold_,
-                                                         object_detection_bbox_conf_threshold_);
-  object_detection_object_.setup_object_detection();
-  pcl::visualization::PCLVisualizer::Ptr
-      viewer(new pcl::visualization::PCLVisualizer(pcl_window_name_));
-  viewer_ = viewer;
+  if (settings_.enable_ground_plane_prior) {
+    ground_plane_.setup_ground_plane((std::filesystem::current_path().parent_path() /
+                                         source_relative_path(settings_.ground_plane_calibration_relative_path))
+                                         .string(),
+                                     settings_.ground_plane_calibration_frames,
+                                     settings_.ground_plane_maximum_tilt_radians,
+                                     settings_.ground_plane_force_calibration);
+  }
+
+  if (settings_.pallet_face_solver != "PCL" && settings_.pallet_face_solver != "GROUND_CONSTRAINED") {
+    std::cerr << "Unknown pallet face solver " << settings_.pallet_face_solver << ", using PCL" << std::endl;
+  }
+
+  if (settings_.aruco_evaluation_mode == "TRACKED") {
+    marker_tracker_.set_detector_settings(settings_.aruco_adaptive_threshold_window_min,
+                                          settings_.aruco_adaptive_threshold_window_max,
+                                          settings_.aruco_adaptive_threshold_window_step);
+    marker_tracker_.set_roi_margin_ratio(settings_.aruco_roi_margin_ratio);
+    marker_tracker_.set_rgb_input(rgb_color_frame);
+    marker_tracker_.setup_marker_tracker(dictionary_,
+                                         example_camera_matrix_,
+                                         example_dist_coefficients_,
+                                         settings_.april_tag_marker_length_meter);
+  } else if (settings_.aruco_evaluation_mode != "FULL_FRAME") {
+    std::cerr << "Unknown aruco evaluation mode " << settings_.aruco_evaluation_mode << ", using FULL_FRAME"
+              << std::endl;
+  }
+
+  pose_publisher_.setup_pose_publisher();
+
+  if (shared_detector_ == nullptr) {
+    thread_pool_.setup_thread_pool(settings_.thread_pool_number_of_threads,
+                                   settings_.thread_pool_pin_threads,
+                                   settings_.thread_pool_core_ids);
+  } else {
+    //! Every camera pins to its own slice of the core ids.
+    const uint16_t number_of_threads = get_threads_per_source(settings_);
+    std::vector<int> core_ids;
+    for (uint16_t i = 0; i < number_of_threads && !settings_.thread_pool_core_ids.empty(); ++i) {
+      core_ids.emplace_back(settings_.thread_pool_core_ids.at(
+          (source_id_ * number_of_threads + i) % settings_.thread_pool_core_ids.size()));
+    }
+    thread_pool_.setup_thread_pool(number_of_threads, settings_.thread_pool_pin_threads, core_ids);
+  }
+
+  if (settings_.enable_pose_export) {
+    pose_export_.setup_pose_export(source_relative_path(settings_.pose_export_shared_memory_name),
+                                   settings_.pose_export_preview_format,
+                                   settings_.pose_export_preview_width,
+                                   settings_.pose_export_preview_jpeg_quality,
+                                   &thread_pool_);
+  }
+
+  latency_monitor_.setup_latency_monitor(profile, settings_.latency_enable_global_time,
+                                         settings_.latency_report_interval_frames);
+
+  if (settings_.enable_frame_recorder &&
+      frame_recorder_.setup_frame_recorder(profile,
+                                           settings_.frame_recorder_buffer_seconds,
+                                           (std::filesystem::current_path().parent_path() /
+                                               settings_.frame_recorder_directory_relative_path).string(),
+                                           settings_.frame_recorder_minimum_seconds_between_captures,
+                                           source_id_)) {
+    FrameRecorder::install_signal_trigger();
+  }
+
+  if (shared_detector_ == nullptr) {
+    if (!setup_object_detection(&object_detection_object_, settings_, *tunable_,
+                                thread_pool_.get_number_of_threads(), 1)) {
+      return false;
+    }
+    object_detection_object_.set_rgb_input(rgb_color_frame);
+    object_detection_object_.set_draw_detections(show_color_frame_);
+  }
+  if (enable_visualization_) {
+    pcl::visualization::PCLVisualizer::Ptr
+        viewer(new pcl::visualization::PCLVisualizer(pcl_window_name_));
+    viewer_ = viewer;
+  }
 
   std::cout << "Setup" << std::endl;
+  return true;
+}
+
+bool PoseEstimation::setup_object_detection(ObjectDetection *object_detection,
+                                            const Settings &settings,
+                                            const TunableSettings &tunable_settings,
+                                            uint16_t number_of_threads,
+                                            uint16_t batch_size) {
+  std::string model_relative_path;
+  if (!select_model_relative_path(settings, &model_relative_path)) {
+    return false;
+  }
+  std::cout << "Object detection model (" << settings.object_detection_model_precision << "): "
+            << model_relative_path << std::endl;
+
+  object_detection->set_inference_threads(number_of_threads, settings.thread_pool_pin_threads);
+  object_detection->set_model_path(model_relative_path);
+  object_detection->set_network_settings(settings.inference_device_name,
+                                         settings.number_of_classes);
+  object_detection->set_network_input_dimensions(settings.network_input_width,
+                                                 settings.network_input_height);
+  object_detection->set_batch_size(batch_size);
+  object_detection->set_u8_input(settings.object_detection_input_precision == "U8");
+  object_detection->set_model_cache_directory(settings.model_cache_relative_path);
+  object_detection->set_object_detection_settings(tunable_settings.object_detection_nms_threshold,
+                                                  tunable_settings.object_detection_bbox_conf_threshold);
+  object_detection->setup_object_detection();
+  return true;
+}
+
+uint16_t PoseEstimation::get_threads_per_source(const Settings &settings) {
+  const size_t number_of_shares = settings.sources.size() + 1;
+  return static_cast<uint16_t>(std::max<size_t>(1, settings.thread_pool_number_of_threads / number_of_shares));
 }
 
-void PoseEstimation::calculate_aruco() {
-  cv::aruco::detectMarkers(image_,
-                           dictionary_,
-                           markerCorners_,
-                           markerIds_,
-                           parameters_,
-                           rejectedCandidates_);
+uint16_t PoseEstimation::get_shared_detector_threads(const Settings &settings) {
+  const size_t source_threads = get_threads_per_source(settings) * settings.sources.size();
+  return static_cast<uint16_t>(settings.thread_pool_number_of_threads > source_threads
+                               ? settings.thread_pool_number_of_threads - source_threads : 1);
+}
+
+bool PoseEstimation::select_model_relative_path(const Settings &settings, std::string *model_relative_path) {
+  if (settings.object_detection_model_precision == "FP32") {
+    *model_relative_path = settings.object_detection_model_relative_path;
+    return true;
+  }
+  if (settings.object_detection_model_precision != "INT8") {
+    std::cerr << "Unknown object_detection.model_precision, expected FP32 or INT8: "
+              << settings.object_detection_model_precision << std::endl;
+    return false;
+  }
+  if (!std::filesystem::exists(std::filesystem::current_path().parent_path() /
+      settings.object_detection_int8_model_relative_path)) {
+    std::cerr << "INT8 model not found, set object_detection.model_precision to FP32 to run without it: "
+              << settings.object_detection_int8_model_relative_path << std::endl;
+    return false;
+  }
+  *model_relative_path = settings.object_detection_int8_model_relative_path;
+  return true;
+}
+
+std::string PoseEstimation::source_relative_path(const std::string &relative_path) const {
+  if (source_.name.empty()) {
+    return relative_path;
+  }
+  std::filesystem::path path(relative_path);
+  path.replace_filename(path.stem().string() + "_" + source_.name + path.extension().string());
+  return path.string();
+}
+
+void PoseEstimation::calculate_aruco(uint64_t frame_number) {
+  if (settings_.aruco_evaluation_mode == "TRACKED") {
+    marker_tracker_.submit_frame(image_, frame_number);
+    tracked_marker_ = marker_tracker_.get_latest_result();
+    markerCorners_.clear();
+    markerIds_.clear();
+    if (tracked_marker_.valid) {
+      markerCorners_.emplace_back(tracked_marker_.corners.begin(), tracked_marker_.corners.end());
+      markerIds_.emplace_back(tracked_marker_.marker_id);
+    }
+  } else {
+    cv::aruco::detectMarkers(image_,
+                             dictionary_,
+                             markerCorners_,
+                             markerIds_,
+                             parameters_,
+                             rejectedCandidates_);
+  }
 
   if (markerCorners_.size() > minimum_marker_corners_) {
     cv::drawMarker(image_,
@@ -125,13 +421,20 @@ void PoseEstimation::calculate_aruco() {
 
 void PoseEstimation::calculate_pose() {
   std::vector<cv::Vec3d> rvecs, tvecs, object_points;
-  cv::aruco::estimatePoseSingleMarkers(markerCorners_,
-                                       april_tag_marker_length_meter_,
-                                       example_camera_matrix_,
-                                       example_dist_coefficients_,
-                                       rvecs,
-                                       tvecs,
-                                       object_points);  // TODO(simon) Magic number.
+  if (settings_.aruco_evaluation_mode == "TRACKED") {
+    if (tracked_marker_.valid) {  //! Pose was already estimated on the tracker thread.
+      rvecs.emplace_back(tracked_marker_.rvec);
+      tvecs.emplace_back(tracked_marker_.tvec);
+    }
+  } else {
+    cv::aruco::estimatePoseSingleMarkers(markerCorners_,
+                                         settings_.april_tag_marker_length_meter,
+                                         example_camera_matrix_,
+                                         example_dist_coefficients_,
+                                         rvecs,
+                                         tvecs,
+                                         object_points);  // TODO(simon) Magic number.
+  }
   // TODO(simon) Set marker size as parameter. 0.175 0.535
 
   if (!rvecs.empty() && !tvecs.empty()) {
@@ -140,7 +443,7 @@ void PoseEstimation::calculate_pose() {
     cv::Mat z_axis(1, 3, CV_64F, z_axis_data);  // TODO(simon) Magic number.
     cv::Rodrigues(rvecs, Rot, Jacob);
 
-    if (enable_debug_mode_) {
+    if (settings_.enable_debug_mode) {
       std::cout << "z_axis: " << z_axis << std::endl;
       std::cout << "Rot: " << Rot << std::endl;
     }
@@ -153,6 +456,8 @@ void PoseEstimation::calculate_pose() {
 
     rvecs_ = rvecs;
     tvecs_ = tvecs;
+    ground_truth_frame_number_ = settings_.aruco_evaluation_mode == "TRACKED" ? tracked_marker_.frame_number
+                                                                              : frame_context_.frame_number;
 
     rotation << "[" << rvecs.at(0)[0] << ", " << rvecs.at(0)[1] << ", " << rvecs.at(0)[2]
              << "]";  // TODO(simon) Magic number.
@@ -178,11 +483,11 @@ void PoseEstimation::calculate_pose() {
                         example_dist_coefficients_,
                         rvecs,
                         tvecs,
-                        april_tag_marker_length_meter_ / 2);  // TODO(simon) Magic number.
+                        settings_.april_tag_marker_length_meter / 2);  // TODO(simon) Magic number.
   }
 }
 
-void PoseEstimation::set_camera_parameters() {  // TODO(simon) Not in use.
+void PoseEstimation::set_camera_parameters() {
   camera_matrix_.resize(9);  // TODO(simon) Magic number.
   dist_coefficients_.resize(5);  // TODO(simon) Magic number.
 
@@ -200,6 +505,24 @@ void PoseEstimation::set_camera_parameters() {  // TODO(simon) Not in use.
   dist_coefficients_.at(2) = -0.00164696;  // TODO(simon) Magic number.
   dist_coefficients_.at(3) = 0.000623876;  // TODO(simon) Magic number.
   dist_coefficients_.at(4) = 0.466404;  // TODO(simon) Magic number.
+
+  if (camera_alignment_.is_setup()) {  //! Calibration of the running device replaces the l515 defaults above.
+    const rs2_intrinsics &color_intrinsics = camera_alignment_.get_color_intrinsics();
+
+    zed_k_matrix_[0] = color_intrinsics.fx;
+    zed_k_matrix_[1] = color_intrinsics.fy;
+    zed_k_matrix_[2] = color_intrinsics.ppx;
+    zed_k_matrix_[3] = color_intrinsics.ppy;
+
+    camera_matrix_.at(0) = example_camera_matrix_data[0] = color_intrinsics.fx;
+    camera_matrix_.at(2) = example_camera_matrix_data[2] = color_intrinsics.ppx;
+    camera_matrix_.at(4) = example_camera_matrix_data[4] = color_intrinsics.fy;
+    camera_matrix_.at(5) = example_camera_matrix_data[5] = color_intrinsics.ppy;
+
+    for (int i = iterations_start_at_; i < dist_coefficients_.size(); ++i) {  //! k1, k2, p1, p2, k3 in both.
+      dist_coefficients_.at(i) = example_dist_coefficients_data[i] = color_intrinsics.coeffs[i];
+    }
+  }
 }
 
 pcl::PointCloud<pcl::PointXYZ>::Ptr PoseEstimation::points_to_pcl(const rs2::points &points) {
@@ -219,13 +542,75 @@ pcl::PointCloud<pcl::PointXYZ>::Ptr PoseEstimation::points_to_pcl(const rs2::poi
   }
   return cloud;
 }
-void PoseEstimation::edit_pointcloud() {
-  pcl::FrustumCulling<pcl::PointXYZ> frustum_filter;
+void PoseEstimation::calculate_pointcloud(const rs2::depth_frame &depth) {
+  if (camera_alignment_.is_setup()) {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = frame_arena_.acquire_cloud<pcl::PointXYZ>();
+    camera_alignment_.back_project_depth(depth, cloud.get());
+    pcl_points_ = cloud;
+  } else {
+    realsense_points_ = realsense_pointcloud_.calculate(depth);
+    pcl_points_ = points_to_pcl(realsense_points_);
+  }
+}
+
+void PoseEstimation::calculate_ground_sample(const rs2::depth_frame &depth) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr ground_sample = frame_arena_.acquire_cloud<pcl::PointXYZ>();
+  ground_sample_ = ground_sample;
 
-  pcl::PointCloud<pcl::PointXYZ>::Ptr local_cloud(new pcl::PointCloud<pcl::PointXYZ>);
-  pcl::PointCloud<pcl::PointXYZ>::Ptr local_pallet(new pcl::PointCloud<pcl::PointXYZ>);
+  const cv::Rect floor_roi = cv::Rect(detection_output_struct_.x,
+                                      detection_output_struct_.y + detection_output_struct_.height,
+                                      detection_output_struct_.width,
+                                      detection_output_struct_.height) & cv::Rect(0, 0, image_.cols, image_.rows);
+  if (floor_roi.empty()) {
+    return;
+  }
+
+  if (settings_.enable_roi_alignment && camera_alignment_.is_setup()) {
+    camera_alignment_.crop_roi(depth,
+                               floor_roi,
+                               tunable_->pcl_frustum_filter_near_plane_distance_meter,
+                               tunable_->pcl_frustum_filter_far_plane_distance_meter,
+                               ground_sample.get(),
+                               frame_arena_.acquire_indices().get());
+    return;
+  }
+
+  //! The frustum crop path projects the full cloud with the color pinhole model, the floor region does the same on a
+  //! strided subset.
+  const size_t stride = std::max<size_t>(1, pcl_points_->size() / ground_sample_candidate_points_);
+  for (size_t i = 0; i < pcl_points_->size(); i += stride) {
+    const pcl::PointXYZ &point = pcl_points_->points[i];
+    if (!std::isfinite(point.z) || point.z <= 0) {
+      continue;
+    }
+    const double u = zed_k_matrix_[0] * point.x / point.z + zed_k_matrix_[2];  // TODO(simon) Magic number.
+    const double v = zed_k_matrix_[1] * point.y / point.z + zed_k_matrix_[3];  // TODO(simon) Magic number.
+    if (u >= floor_roi.x && u < floor_roi.x + floor_roi.width && v >= floor_roi.y
+        && v < floor_roi.y + floor_roi.height) {
+      ground_sample->push_back(point);
+    }
+  }
+}
+
+void PoseEstimation::edit_pointcloud(const rs2::depth_frame &depth) {
+  if (settings_.enable_roi_alignment && camera_alignment_.is_setup()) {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr local_pallet = frame_arena_.acquire_cloud<pcl::PointXYZ>();
+    camera_alignment_.crop_roi(depth,
+                               cv::Rect(detection_output_struct_.x,
+                                        detection_output_struct_.y,
+                                        detection_output_struct_.width,
+                                        detection_output_struct_.height),
+                               tunable_->pcl_frustum_filter_near_plane_distance_meter,
+                               tunable_->pcl_frustum_filter_far_plane_distance_meter,
+                               local_pallet.get(),
+                               &frustum_filter_inliers_);
+    cloud_pallet_ = local_pallet;
+    return;
+  }
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr local_cloud = pcl_points_;
+  pcl::PointCloud<pcl::PointXYZ>::Ptr local_pallet = frame_arena_.acquire_cloud<pcl::PointXYZ>();
 
-  local_cloud = pcl_points_;
   frustum_filter_inliers_.clear();
 
   Eigen::Matrix4f camera_pose;
@@ -248,7 +633,7 @@ void PoseEstimation::edit_pointcloud() {
   double angle_zx =
       std::acos((z_inverse.dot(center_frustum_zx)) / (z_inverse.norm() * center_frustum_zx.norm()));
 
-  if (std::chrono::system_clock::now() > start_debug_time_ && enable_debug_mode_) {
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
     std::cout << "\n ROTATION: \n " << std::endl;
     std::cout << "angle_zy: " << angle_zy << std::endl;
     std::cout << "angle_zx: " << angle_zx << std::endl;
@@ -291,25 +676,136 @@ void PoseEstimation::edit_pointcloud() {
       std::sin(rot_green_rad), 0, std::cos(rot_green_rad), 0,  // TODO(simon) Magic number.
       0, 0, 0, 1;  // TODO(simon) Magic number.
 
-  frustum_filter.setInputCloud(local_cloud);
-  frustum_filter.setCameraPose(camera_pose * rotation_red_pos_ccw
-                                   * rotation_green_pos_cw);  // frustum_filter.setCameraPose(camera_pose*cam2robot*rotation_red_pos_ccw*rotation_green_pos_cw);
-  frustum_filter.setNearPlaneDistance(pcl_frustum_filter_near_plane_distance_meter_);
-  frustum_filter.setFarPlaneDistance(pcl_frustum_filter_far_plane_distance_meter_);
-  frustum_filter.setVerticalFOV(fov_v_rad_ * rad_to_deg_);
-  frustum_filter.setHorizontalFOV(fov_h_rad_ * rad_to_deg_);
-  frustum_filter.filter(*local_pallet);
-  frustum_filter.filter(frustum_filter_inliers_);
+  const Eigen::Matrix4f frustum_camera_pose = camera_pose * rotation_red_pos_ccw
+      * rotation_green_pos_cw;  // frustum_filter.setCameraPose(camera_pose*cam2robot*rotation_red_pos_ccw*rotation_green_pos_cw);
+
+  FrustumCrop frustum_crop;
+  frustum_crop.set_frustum(frustum_camera_pose,
+                           fov_v_rad_,
+                           fov_h_rad_,
+                           std::max(tunable_->pcl_frustum_filter_near_plane_distance_meter,
+                                    minimum_frustum_near_plane_distance_meter_),
+                           tunable_->pcl_frustum_filter_far_plane_distance_meter);
+
+  //! The cloud is organized like the depth image, only the rows and columns the frustum projects to are scanned. An
+  //! unorganized cloud is scanned whole, as rows of one chunk each.
+  const rs2_intrinsics depth_intrinsics = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+  size_t row_width = frustum_filter_chunk_size_points_;
+  cv::Rect scan_roi(0, 0, static_cast<int>(row_width),
+                    static_cast<int>((local_cloud->size() + row_width - 1) / row_width));
+  if (local_cloud->isOrganized() && local_cloud->width == static_cast<uint32_t>(depth_intrinsics.width)
+      && local_cloud->height == static_cast<uint32_t>(depth_intrinsics.height)) {
+    row_width = local_cloud->width;
+    scan_roi = calculate_frustum_depth_roi(frustum_crop, depth_intrinsics);
+  }
+
+  //! Crop the rows in chunks on the thread pool, every chunk writes its points and indices, then gather in order.
+  const size_t rows_per_chunk = std::max<size_t>(1, frustum_filter_chunk_size_points_ / std::max(scan_roi.width, 1));
+  const size_t number_of_chunks = (scan_roi.height + rows_per_chunk - 1) / rows_per_chunk;
+  if (frustum_filter_chunk_inliers_.size() < number_of_chunks) {  //! Kept between frames for capacity.
+    frustum_filter_chunk_inliers_.resize(number_of_chunks);
+    frustum_filter_chunk_points_.resize(number_of_chunks);
+  }
+
+  thread_pool_.parallel_for(0, number_of_chunks, 1, [&](size_t chunk_begin, size_t chunk_end) {
+    for (size_t chunk = chunk_begin; chunk < chunk_end; ++chunk) {
+      frustum_filter_chunk_inliers_.at(chunk).clear();
+      frustum_filter_chunk_points_.at(chunk).clear();
+      const size_t row_begin = scan_roi.y + chunk * rows_per_chunk;
+      const size_t row_end = std::min<size_t>(scan_roi.y + scan_roi.height, row_begin + rows_per_chunk);
+      for (size_t row = row_begin; row < row_end; ++row) {
+        frustum_crop.crop(*local_cloud,
+                          row * row_width + scan_roi.x,
+                          row * row_width + scan_roi.x + scan_roi.width,
+                          &frustum_filter_chunk_points_.at(chunk),
+                          &frustum_filter_chunk_inliers_.at(chunk));
+      }
+    }
+  });
+
+  for (size_t chunk = 0; chunk < number_of_chunks; ++chunk) {
+    const std::vector<int> &inliers = frustum_filter_chunk_inliers_.at(chunk);
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = frustum_filter_chunk_points_.at(chunk);
+    frustum_filter_inliers_.insert(frustum_filter_inliers_.end(), inliers.begin(), inliers.end());
+    local_pallet->points.insert(local_pallet->points.end(), points.begin(), points.end());
+  }
+  local_pallet->header = local_cloud->header;
+  local_pallet->width = local_pallet->points.size();
+  local_pallet->height = 1;
+  local_pallet->is_dense = local_cloud->is_dense;
 
   cloud_pallet_ = local_pallet;
 
-  if (std::chrono::system_clock::now() > start_debug_time_ && enable_debug_mode_) {
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
     std::cout << "local_pallet->size() " << local_pallet->size() << std::endl;
     std::cout << "cloud_pallet_->size() " << cloud_pallet_->size() << std::endl;
     std::cout << "local_cloud->size() " << local_cloud->size() << std::endl;
   }
 }
 
+cv::Rect PoseEstimation::calculate_frustum_depth_roi(const FrustumCrop &frustum_crop,
+                                                     const rs2_intrinsics &depth_intrinsics) const {
+  const cv::Rect depth_frame(0, 0, depth_intrinsics.width, depth_intrinsics.height);
+  if (!frustum_crop.get_position().isZero()) {
+    return depth_frame;
+  }
+
+  //! The edges of the far rectangle bound its projection, the inside projects between them.
+  const std::array<Eigen::Vector3f, 4> &far_corners = frustum_crop.get_far_corners();
+  float min_u = FLT_MAX, min_v = FLT_MAX, max_u = -FLT_MAX, max_v = -FLT_MAX;
+  for (size_t corner = 0; corner < far_corners.size(); ++corner) {
+    const Eigen::Vector3f &edge_begin = far_corners.at(corner);
+    const Eigen::Vector3f &edge_end = far_corners.at((corner + 1) % far_corners.size());
+    for (int sample = 0; sample < frustum_roi_edge_samples_; ++sample) {
+      const Eigen::Vector3f point =
+          edge_begin + (edge_end - edge_begin) * (static_cast<float>(sample) / frustum_roi_edge_samples_);
+      if (point.z() <= 0) {
+        return depth_frame;
+      }
+      const float depth_point[3] = {point.x(), point.y(), point.z()};
+      float depth_pixel[2];
+      rs2_project_point_to_pixel(depth_pixel, &depth_intrinsics, depth_point);
+
+      min_u = std::min(min_u, depth_pixel[0]);
+      min_v = std::min(min_v, depth_pixel[1]);
+      max_u = std::max(max_u, depth_pixel[0]);
+      max_v = std::max(max_v, depth_pixel[1]);
+    }
+  }
+
+  const cv::Rect depth_roi(cv::Point(static_cast<int>(std::floor(min_u)) - frustum_roi_margin_pixels_,
+                                     static_cast<int>(std::floor(min_v)) - frustum_roi_margin_pixels_),
+                           cv::Point(static_cast<int>(std::ceil(max_u)) + frustum_roi_margin_pixels_,
+                                     static_cast<int>(std::ceil(max_v)) + frustum_roi_margin_pixels_));
+  return depth_roi & depth_frame;
+}
+
+void PoseEstimation::calculate_ground_truth_vector() {
+  if (rvecs_.empty() || tvecs_.empty()) {
+    return;
+  }
+  std::vector<double> ground_truth_vector_converted
+      (ground_truth_vector_.begin<double>(), ground_truth_vector_.end<double>());
+
+  converted_ground_truth_vector_.at(x_position_id_) = tvecs_.at(first_)[x_position_id_];
+  converted_ground_truth_vector_.at(y_position_id_) = tvecs_.at(first_)[y_position_id_];
+  converted_ground_truth_vector_.at(z_position_id_) = tvecs_.at(first_)[z_position_id_];
+  converted_ground_truth_vector_.at(end_x_position_id_) =
+      -ground_truth_vector_converted.at(x_position_id_);
+  converted_ground_truth_vector_.at(end_y_position_id_) =
+      ground_truth_vector_converted.at(y_position_id_);
+  converted_ground_truth_vector_.at(end_z_position_id_) =
+      -ground_truth_vector_converted.at(z_position_id_);
+
+  if (settings_.enable_debug_mode) {
+    for (int i = iterations_start_at_; i < converted_ground_truth_vector_.size();
+         ++i) {  // TODO(simon) Magic number.
+      std::cout << "converted_ground_truth_vector_.at(" << i << ")"
+                << converted_ground_truth_vector_.at(i) << std::endl;
+    }
+  }
+}
+
 void PoseEstimation::view_pointcloud() {
   if (first_run_) {
     viewer_->setBackgroundColor(pcl_background_color_rgb_[red_color_id_],
@@ -329,14 +825,13 @@ void PoseEstimation::view_pointcloud() {
     first_run_ = false;
   }
 
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr final_cloud_view(new pcl::PointCloud<pcl::PointXYZRGB>);
-
-  final_cloud_view->clear();
   viewer_->removeAllShapes();
   viewer_->removeAllPointClouds();
   viewer_->removeCoordinateSystem(apriltag_coordinate_system_reference_name_,
                                   pcl_viewport_id_);  // TODO(simon) Magic number.
 
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr final_cloud_view = frame_arena_.acquire_cloud<pcl::PointXYZRGB>();
+
   pcl::copyPointCloud(*pcl_points_, *final_cloud_view);
 
   for (int i = iterations_start_at_; i < final_cloud_view->points.size(); ++i) {
@@ -357,38 +852,14 @@ void PoseEstimation::view_pointcloud() {
                          pcl_viewport_id_);  //! Everything with color  // TODO(simon) Magic number.
 
   if (!rvecs_.empty() && !tvecs_.empty()) {
-    Eigen::Affine3f rotation;
-
-    pcl::PointXYZ startpoint = pcl::PointXYZ(tvecs_.at(first_)[x_position_id_],
-                                             tvecs_.at(first_)[y_position_id_],
-                                             tvecs_.at(first_)[z_position_id_]);
-    std::vector<double> ground_truth_vector_converted
-        (ground_truth_vector_.begin<double>(), ground_truth_vector_.end<double>());
-
-    pcl::PointXYZ endpoint = pcl::PointXYZ(tvecs_.at(first_)[x_position_id_]
-                                               - ground_truth_vector_converted.at(x_position_id_),  // TODO(simon) Testing remove "*2" Justering er ikke linjær
-                                           tvecs_.at(first_)[y_position_id_]
-                                               + ground_truth_vector_converted.at(y_position_id_),
-                                           tvecs_.at(first_)[z_position_id_]
-                                               - ground_truth_vector_converted.at(z_position_id_));
-
-    converted_ground_truth_vector_.at(x_position_id_) = tvecs_.at(first_)[x_position_id_];
-    converted_ground_truth_vector_.at(y_position_id_) = tvecs_.at(first_)[y_position_id_];
-    converted_ground_truth_vector_.at(z_position_id_) = tvecs_.at(first_)[z_position_id_];
-    converted_ground_truth_vector_.at(end_x_position_id_) =
-        -ground_truth_vector_converted.at(x_position_id_);
-    converted_ground_truth_vector_.at(end_y_position_id_) =
-        ground_truth_vector_converted.at(y_position_id_);
-    converted_ground_truth_vector_.at(end_z_position_id_) =
-        -ground_truth_vector_converted.at(z_position_id_);
-
-    if (enable_debug_mode_) {
-      for (int i = iterations_start_at_; i < converted_ground_truth_vector_.size();
-           ++i) {  // TODO(simon) Magic number.
-        std::cout << "converted_ground_truth_vector_.at(" << i << ")"
-                  << converted_ground_truth_vector_.at(i) << std::endl;
-      }
-
+    pcl::PointXYZ startpoint = pcl::PointXYZ(converted_ground_truth_vector_.at(x_position_id_),
+                                             converted_ground_truth_vector_.at(y_position_id_),
+                                             converted_ground_truth_vector_.at(z_position_id_));
+    pcl::PointXYZ endpoint = pcl::PointXYZ(startpoint.x + converted_ground_truth_vector_.at(end_x_position_id_),  // TODO(simon) Testing remove "*2" Justering er ikke linjær
+                                           startpoint.y + converted_ground_truth_vector_.at(end_y_position_id_),
+                                           startpoint.z + converted_ground_truth_vector_.at(end_z_position_id_));
+
+    if (settings_.enable_debug_mode) {
       std::cout << "ENDPOINT: " << endpoint << std::endl;
     }
 
@@ -401,17 +872,19 @@ void PoseEstimation::view_pointcloud() {
                      pcl_viewport_id_);
   }
 
-  if (std::chrono::system_clock::now() > start_debug_time_ && enable_debug_mode_) {
-    std::cout << "square_frustum_detection_points_.at(0)" << square_frustum_detection_points_.at(0)
-              << std::endl;  // TODO(simon) Magic number.
-    std::cout << "square_frustum_detection_points_.at(1)" << square_frustum_detection_points_.at(1)
-              << std::endl;  // TODO(simon) Magic number.
-    std::cout << "square_frustum_detection_points_.at(2)" << square_frustum_detection_points_.at(2)
-              << std::endl;  // TODO(simon) Magic number.
-    std::cout << "square_frustum_detection_points_.at(3)" << square_frustum_detection_points_.at(3)
-              << std::endl;  // TODO(simon) Magic number.
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
+    if (!square_frustum_detection_points_.empty()) {  //! Empty on frames without a detection.
+      std::cout << "square_frustum_detection_points_.at(0)" << square_frustum_detection_points_.at(0)
+                << std::endl;  // TODO(simon) Magic number.
+      std::cout << "square_frustum_detection_points_.at(1)" << square_frustum_detection_points_.at(1)
+                << std::endl;  // TODO(simon) Magic number.
+      std::cout << "square_frustum_detection_points_.at(2)" << square_frustum_detection_points_.at(2)
+                << std::endl;  // TODO(simon) Magic number.
+      std::cout << "square_frustum_detection_points_.at(3)" << square_frustum_detection_points_.at(3)
+                << std::endl;  // TODO(simon) Magic number.
+    }
     start_debug_time_ = std::chrono::system_clock::now();
-    start_debug_time_ += std::chrono::seconds(debug_print_after_seconds_);
+    start_debug_time_ += std::chrono::seconds(settings_.debug_print_after_seconds);
   }
 
   if (!square_frustum_detection_points_.empty()) {
@@ -505,15 +978,15 @@ void PoseEstimation::calculate_3d_crop() {
   detection_from_image_center_.clear();
   square_frustum_detection_points_.clear();
   for (int i = iterations_start_at_; i < number_of_object_detection_corner_vectors_; ++i) {
-    detection_from_image_center_.emplace_back((detection_point_vec.at(i) - image_center)
-                                                  / zed_k_matrix_[0]);  // TODO(simon) Get K matrix from intel realsense; The difference bwetween this is too spall  // TODO(simon) Magic number.
+    detection_from_image_center_.emplace_back((detection_point_vec.at(i) - image_center).cwiseQuotient(
+        Eigen::Vector2d(zed_k_matrix_[0], zed_k_matrix_[1])));  // TODO(simon) Get K matrix from intel realsense; The difference bwetween this is too spall  // TODO(simon) Magic number.
     square_frustum_detection_points_.emplace_back(
         detection_from_image_center_.at(i).x() * detection_vector_scale_,
         detection_from_image_center_.at(i).y() * detection_vector_scale_,
         detection_vector_scale_);
   }
 
-  if (std::chrono::system_clock::now() > start_debug_time_ && enable_debug_mode_) {
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
     for (int i = iterations_start_at_; i < number_of_object_detection_corner_vectors_; ++i) {
       std::cout << "image_center X: " << image_center << std::endl;
       std::cout << "detection_point_vec.at(i): " << detection_point_vec.at(i) << std::endl;
@@ -568,7 +1041,7 @@ void PoseEstimation::calculate_3d_crop() {
   fov_h_rad_ = angle_01;
   fov_v_rad_ = angle_02;
 
-  if (std::chrono::system_clock::now() > start_debug_time_ && enable_debug_mode_) {
+  if (std::chrono::system_clock::now() > start_debug_time_ && settings_.enable_debug_mode) {
     std::cout << "detection_point_vec_0: " << detection_point_vec.at(0).x() << " "
               << detection_point_vec.at(0).y() << std::endl;  // TODO(simon) Magic number.
     std::cout << "detection_point_vec_1: " << detection_point_vec.at(1).x() << " "
@@ -580,55 +1053,91 @@ void PoseEstimation::calculate_3d_crop() {
   }
 }
 
+void PoseEstimation::clear_plane_fits() {
+  ransac_model_coefficients_.clear();
+  first_ransac_model_coefficients_.clear();
+  second_ransac_model_coefficients_.clear();
+  output_cloud_with_normals_ = nullptr;
+  extracted_cloud_with_normals_ = nullptr;
+}
+
+bool PoseEstimation::has_plane_fits() const {
+  return first_ransac_model_coefficients_.size() == plane_coefficients_
+      && ransac_model_coefficients_.size() == plane_coefficients_
+      && second_ransac_model_coefficients_.size() == plane_coefficients_;
+}
+
 void PoseEstimation::calculate_ransac() {
-  pcl::ModelCoefficients::Ptr first_coefficients(new pcl::ModelCoefficients);
-  pcl::PointIndices::Ptr first_inliers(new pcl::PointIndices);
+  clear_plane_fits();
+
+  pcl::ModelCoefficients::Ptr first_coefficients = frame_arena_.acquire_model_coefficients();
+  pcl::PointIndices::Ptr first_inliers = frame_arena_.acquire_point_indices();
+  pcl::PointCloud<pcl::PointXYZ>::Ptr final = frame_arena_.acquire_cloud<pcl::PointXYZ>();
+  pcl::IndicesPtr test_inliers = frame_arena_.acquire_indices();
 
   pcl::SACSegmentation<pcl::PointXYZ> seg;
   seg.setOptimizeCoefficients(true);
 
   seg.setModelType(pcl::SACMODEL_PLANE);
-  seg.setEpsAngle(ransac_eps_angle_radians_);
+  seg.setEpsAngle(tunable_->ransac_eps_angle_radians);
   seg.setMethodType(pcl::SAC_RANSAC);
-  seg.setMaxIterations(ransac_max_iterations_);
-  seg.setDistanceThreshold(first_ransac_distance_threshold_meter_);
+  seg.setMaxIterations(tunable_->ransac_max_iterations);
+  seg.setDistanceThreshold(tunable_->first_ransac_distance_threshold_meter);
 
-  if (enable_debug_mode_) {
+  if (settings_.enable_debug_mode) {
     std::cout << "First RANSAC" << std::endl;
     std::cout << "cloud_pallet_ size: " << cloud_pallet_->size() << std::endl;
   }
 
-  if (cloud_pallet_->size()
-      > minimum_points_for_ransac_) {
-    seg.setInputCloud(cloud_pallet_);
-    seg.segment(*first_inliers, *first_coefficients);
+  //! With a calibrated ground plane the first RANSAC is replaced by a sparse inlier check on the floor below the
+  //! pallet, it only runs on failure.
+  const bool ground_plane_verified = settings_.enable_ground_plane_prior
+      && ground_plane_.is_calibrated()
+      && cloud_pallet_->size() > tunable_->minimum_points_for_ransac
+      && ground_sample_ != nullptr
+      && ground_plane_.verify(*ground_sample_,
+                              tunable_->ground_plane_verification_sample_size,
+                              tunable_->ground_plane_verification_distance_threshold_meter,
+                              tunable_->ground_plane_minimum_inlier_ratio);
+  if (ground_plane_verified) {
+    first_ransac_model_coefficients_ = ground_plane_.get_coefficients();
+  } else if (settings_.enable_ground_plane_prior && ground_plane_.is_calibrated() && settings_.enable_debug_mode) {
+    std::cout << "Ground plane verification failed, refitting" << std::endl;
+  }
 
-    first_ransac_model_coefficients_.clear();
-    for (int i = iterations_start_at_; i < first_coefficients->values.size(); ++i) {
-      first_ransac_model_coefficients_.emplace_back(first_coefficients->values.at(i));
-    }
+  final_ = final;  //! Stays empty when the verified ground plane skips the first RANSAC.
 
-    pcl::PointCloud<pcl::PointXYZ>::Ptr final(new pcl::PointCloud<pcl::PointXYZ>);
-    std::vector<int> test_inliers;
-    pcl::SampleConsensusModelPlane<pcl::PointXYZ>::Ptr
-        model_p(new pcl::SampleConsensusModelPlane<pcl::PointXYZ>(cloud_pallet_));
+  //! The first RANSAC and the surface normal sampling only read cloud_pallet_, score them concurrently.
+  std::future<void> first_ransac_task =
+      thread_pool_.submit([this, &seg, &first_inliers, &first_coefficients, &final, &test_inliers,
+                              ground_plane_verified]() {
+    if (!ground_plane_verified && cloud_pallet_->size()
+        > tunable_->minimum_points_for_ransac) {
+      seg.setInputCloud(cloud_pallet_);
+      seg.segment(*first_inliers, *first_coefficients);
 
-    pcl::RandomSampleConsensus<pcl::PointXYZ> ransac(model_p);
-    ransac.setDistanceThreshold(second_ransac_distance_threshold_meter_);
-    ransac.computeModel();
-    ransac.getInliers(test_inliers);
+      for (int i = iterations_start_at_; i < first_coefficients->values.size(); ++i) {
+        first_ransac_model_coefficients_.emplace_back(first_coefficients->values.at(i));
+      }
 
-    pcl::copyPointCloud(*cloud_pallet_, test_inliers, *final);
-    final_ = final;
-  }
+      pcl::SampleConsensusModelPlane<pcl::PointXYZ>::Ptr
+          model_p(new pcl::SampleConsensusModelPlane<pcl::PointXYZ>(cloud_pallet_));
 
-  pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
+      pcl::RandomSampleConsensus<pcl::PointXYZ> ransac(model_p);
+      ransac.setDistanceThreshold(tunable_->second_ransac_distance_threshold_meter);
+      ransac.computeModel();
+      ransac.getInliers(*test_inliers);
 
-  pcl::PointCloud<pcl::PointNormal>::Ptr
-      input_cloud_with_normals(new pcl::PointCloud<pcl::PointNormal>);
-  pcl::PointCloud<pcl::PointNormal>::Ptr
-      output_cloud_with_normals(new pcl::PointCloud<pcl::PointNormal>);
-  pcl::PointCloud<pcl::PointNormal>::Ptr final_with_normals(new pcl::PointCloud<pcl::PointNormal>);
+      pcl::copyPointCloud(*cloud_pallet_, *test_inliers, *final);
+    }
+  });
+
+  pcl::PointIndices::Ptr inliers = frame_arena_.acquire_point_indices();
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr input_cloud_with_normals = frame_arena_.acquire_cloud<pcl::PointNormal>();
+  pcl::PointCloud<pcl::PointNormal>::Ptr output_cloud_with_normals = frame_arena_.acquire_cloud<pcl::PointNormal>();
+  pcl::PointCloud<pcl::PointNormal>::Ptr final_with_normals = frame_arena_.acquire_cloud<pcl::PointNormal>();
+  pcl::IndicesPtr temp_index = frame_arena_.acquire_indices();
 
   input_cloud_with_normals->clear();
   output_cloud_with_normals->clear();
@@ -642,7 +1151,7 @@ void PoseEstimation::calculate_ransac() {
     input_cloud_with_normals->points.at(i).z = cloud_pallet_->at(i).z;
   }
 
-  if (enable_debug_mode_) {
+  if (settings_.enable_debug_mode) {
     std::cout << "Sampling surface normals" << std::endl;
     std::cout << "input_cloud_with_normals size: " << input_cloud_with_normals->size() << std::endl;
   }
@@ -650,20 +1159,19 @@ void PoseEstimation::calculate_ransac() {
 
 //!  Sampling surface normals
   if (input_cloud_with_normals->size()
-      > minimum_points_for_sampling_surface_normals_) {
+      > tunable_->minimum_points_for_sampling_surface_normals) {
     pcl::SamplingSurfaceNormal<pcl::PointNormal> sample_surface_normal;
     sample_surface_normal.setInputCloud(input_cloud_with_normals);
-    sample_surface_normal.setSample(sample_surface_normal_sample_size_);
-    sample_surface_normal.setRatio(sample_surface_normal_ratio_);  // TODO(simon) Setting that is required to be a parameter.  // TODO(simon) Magic number.
+    sample_surface_normal.setSample(tunable_->sample_surface_normal_sample_size);
+    sample_surface_normal.setRatio(tunable_->sample_surface_normal_ratio);  // TODO(simon) Setting that is required to be a parameter.  // TODO(simon) Magic number.
     sample_surface_normal.filter(*output_cloud_with_normals);
 
     output_cloud_with_normals_ = output_cloud_with_normals;
     final_with_normals_ = final_with_normals;
 
-    std::vector<int> temp_index;
     pcl::removeNaNNormalsFromPointCloud(*output_cloud_with_normals_,
                                         *output_cloud_with_normals_,
-                                        temp_index);
+                                        *temp_index);
 
     int counter = 0;  // TODO(simon) Magic number.
 
@@ -683,32 +1191,47 @@ void PoseEstimation::calculate_ransac() {
       }
     }
   }
+  first_ransac_task.get();
+
+  if (settings_.enable_ground_plane_prior && !ground_plane_verified && !first_coefficients->values.empty()
+      && ground_plane_.add_fit(first_ransac_model_coefficients_,
+                               tunable_->ground_plane_stable_angle_radians,
+                               tunable_->ground_plane_stable_distance_meter,
+                               tunable_->ground_plane_recalibration_failed_frames)) {
+    //! Saved on the pool with a copy of the plane, the vision thread does not wait for the disk.
+    if (ground_plane_save_task_.valid()) {
+      ground_plane_save_task_.wait();
+    }
+    ground_plane_save_task_ = thread_pool_.submit(
+        [calibration_path = ground_plane_.get_calibration_path(), coefficients = ground_plane_.get_coefficients()]() {
+          return GroundPlane::save_calibration(calibration_path, coefficients);
+        });
+  }
 
   //! RANSAC
-  if (input_cloud_with_normals->size()
-      > minimum_points_for_ransac_) {  // TODO(simon) 10 should be set as input parameter.  // TODO(simon) Magic number.
+  if (output_cloud_with_normals_ != nullptr && input_cloud_with_normals->size()
+      > tunable_->minimum_points_for_ransac) {  // TODO(simon) 10 should be set as input parameter.  // TODO(simon) Magic number.
     pcl::SACSegmentationFromNormals<pcl::PointNormal, pcl::PointNormal> segmentation;
-    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
+    pcl::ModelCoefficients::Ptr coefficients = frame_arena_.acquire_model_coefficients();
 
     segmentation.setOptimizeCoefficients(true);
     segmentation.setModelType(pcl::SACMODEL_NORMAL_PLANE);  // TODO(simon) Test with different models SACMODEL_PLANE | SACMODEL_NORMAL_PLANE | SACMODEL_PERPENDICULAR_PLANE
     segmentation.setMethodType(pcl::SAC_RANSAC);
-    segmentation.setMaxIterations(maximum_iterations_for_segmentation_);
-    segmentation.setDistanceThreshold(segmentation_distance_threshold_meter_);
+    segmentation.setMaxIterations(tunable_->maximum_iterations_for_segmentation);
+    segmentation.setDistanceThreshold(tunable_->segmentation_distance_threshold_meter);
 
-    if (enable_debug_mode_) {
+    if (settings_.enable_debug_mode) {
       std::cout << "Inbetween " << std::endl;
       std::cout << "input_cloud_with_normals size: " << input_cloud_with_normals->size()
                 << std::endl;
     }
 
-    segmentation.setEpsAngle(segmentation_eps_angle_radians_);
+    segmentation.setEpsAngle(tunable_->segmentation_eps_angle_radians);
     segmentation.setInputCloud(output_cloud_with_normals_);
     segmentation.setInputNormals(output_cloud_with_normals_);
 
     segmentation.segment(*inliers, *coefficients);
 
-    ransac_model_coefficients_.clear();
     for (int i = iterations_start_at_; i < coefficients->values.size();
          ++i) {
       ransac_model_coefficients_.emplace_back(coefficients->values.at(i));
@@ -717,10 +1240,10 @@ void PoseEstimation::calculate_ransac() {
 
   //! Extract filter
 
-  if (output_cloud_with_normals_->size()
-      > minimum_points_for_ransac_) {
+  if (output_cloud_with_normals_ != nullptr && output_cloud_with_normals_->size()
+      > tunable_->minimum_points_for_ransac) {
     pcl::PointCloud<pcl::PointNormal>::Ptr
-        extracted_cloud_with_normals(new pcl::PointCloud<pcl::PointNormal>);
+        extracted_cloud_with_normals = frame_arena_.acquire_cloud<pcl::PointNormal>();
     // Extract all points
     pcl::ExtractIndices<pcl::PointNormal> extract_filter;
     extract_filter.setInputCloud(output_cloud_with_normals_);
@@ -731,32 +1254,49 @@ void PoseEstimation::calculate_ransac() {
     extracted_cloud_with_normals_ = extracted_cloud_with_normals;
   }
 
-  //! RANSAC 2
-  if (extracted_cloud_with_normals_->size()
-      > minimum_points_for_ransac_) {
+  //! RANSAC 2, or the face as a line on the ground plane. The PCL fit is kept as the fallback. The constraint needs
+  //! a floor from this frame, verified or fitted and level, and the dominant ROI plane is not always the floor.
+  const bool ground_is_floor = ground_plane_verified
+      || GroundPlane::is_level(first_ransac_model_coefficients_, settings_.ground_plane_maximum_tilt_radians);
+  bool pallet_face_solved = false;
+  if (settings_.pallet_face_solver == "GROUND_CONSTRAINED" && ground_is_floor
+      && extracted_cloud_with_normals_ != nullptr
+      && extracted_cloud_with_normals_->size() > tunable_->minimum_points_for_ransac) {
+    pallet_face_solver_.set_solver_settings(tunable_->pallet_face_ransac_iterations,
+                                            tunable_->pallet_face_distance_threshold_meter,
+                                            tunable_->pallet_face_refinement_iterations);
+    pallet_face_solved = pallet_face_solver_.solve(*extracted_cloud_with_normals_,
+                                                   first_ransac_model_coefficients_,
+                                                   &second_ransac_model_coefficients_);
+    if (!pallet_face_solved && settings_.enable_debug_mode) {
+      std::cout << "Ground constrained pallet face fit failed, using PCL" << std::endl;
+    }
+  }
+
+  if (!pallet_face_solved && extracted_cloud_with_normals_ != nullptr
+      && extracted_cloud_with_normals_->size() > tunable_->minimum_points_for_ransac) {
     pcl::SACSegmentationFromNormals<pcl::PointNormal, pcl::PointNormal> second_segmentation;
-    pcl::ModelCoefficients::Ptr second_coefficients(new pcl::ModelCoefficients);
-    pcl::PointIndices::Ptr second_inliers(new pcl::PointIndices);
+    pcl::ModelCoefficients::Ptr second_coefficients = frame_arena_.acquire_model_coefficients();
+    pcl::PointIndices::Ptr second_inliers = frame_arena_.acquire_point_indices();
 
     second_segmentation.setOptimizeCoefficients(true);
     second_segmentation.setModelType(pcl::SACMODEL_NORMAL_PLANE);  // TODO(simon) Test with different models SACMODEL_PLANE | SACMODEL_NORMAL_PLANE | SACMODEL_PERPENDICULAR_PLANE
     second_segmentation.setMethodType(pcl::SAC_RANSAC);
-    second_segmentation.setMaxIterations(maximum_iterations_for_segmentation_);
-    second_segmentation.setDistanceThreshold(segmentation_distance_threshold_meter_);
+    second_segmentation.setMaxIterations(tunable_->maximum_iterations_for_segmentation);
+    second_segmentation.setDistanceThreshold(tunable_->segmentation_distance_threshold_meter);
 
-    if (enable_debug_mode_) {
+    if (settings_.enable_debug_mode) {
       std::cout << "second_segmentation " << std::endl;
       std::cout << "extracted_cloud_with_normals_ size: " << extracted_cloud_with_normals_->size()
                 << std::endl;
     }
 
-    second_segmentation.setEpsAngle(segmentation_eps_angle_radians_);
+    second_segmentation.setEpsAngle(tunable_->segmentation_eps_angle_radians);
     second_segmentation.setInputCloud(extracted_cloud_with_normals_);
     second_segmentation.setInputNormals(extracted_cloud_with_normals_);
 
     second_segmentation.segment(*second_inliers, *second_coefficients);
 
-    second_ransac_model_coefficients_.clear();
     for (int i = iterations_start_at_; i < second_coefficients->values.size();
          ++i) {  // TODO(simon) Magic number.
       second_ransac_model_coefficients_.emplace_back(second_coefficients->values.at(i));
@@ -808,13 +1348,13 @@ void PoseEstimation::calculate_pose_vector() {
   distance_scalar = (plane_orgin.dot(plane_normal_vector)) /
       (center_frustum_vector.dot(plane_normal_vector));
 
-  if (enable_debug_mode_) {
+  if (settings_.enable_debug_mode) {
     std::cout << "distance_scalar: " << distance_scalar << std::endl;
   }
 
   plane_vector_intersect = center_frustum_vector * distance_scalar;
 
-  if (enable_debug_mode_) {
+  if (settings_.enable_debug_mode) {
     std::cout << "plane_vector_intersect: " << plane_vector_intersect << std::endl;
   }
 
@@ -828,6 +1368,14 @@ void PoseEstimation::calculate_pose_vector() {
   plane_frustum_vector_intersect_.y = plane_vector_intersect.y();
   plane_frustum_vector_intersect_.z = plane_vector_intersect.z();
 
+  //! The PCL fit returns the face normal with either sign, point it away from the camera like the ground constrained
+  //! solver does.
+  if (second_ransac_model_coefficients_.at(plane_normal_z_id_) < 0) {  // TODO(simon) Magic number.
+    for (float &coefficient : second_ransac_model_coefficients_) {
+      coefficient = -coefficient;
+    }
+  }
+
   if (second_ransac_model_coefficients_.at(plane_normal_z_id_)
       > 0) {  // TODO(simon) required.  // TODO(simon) Magic number.
     pose_vector_end_point_.x = plane_vector_intersect.x()
@@ -836,15 +1384,144 @@ void PoseEstimation::calculate_pose_vector() {
         + (-1 * first_ransac_model_coefficients_.at(plane_normal_z_id_));
     pose_vector_end_point_.z = plane_vector_intersect.z()
         + second_ransac_model_coefficients_.at(plane_normal_z_id_);
-  } else if (ransac_model_coefficients_.at(plane_normal_z_id_) < 0) {  // TODO(simon) Magic number.
+    pose_vector_valid_ = true;
+  } else if (settings_.enable_debug_mode) {
+    std::cout << "Pallet face normal is perpendicular to the view direction" << std::endl;
+  }
+}
+
+void PoseEstimation::calculate_pose_quality() {
+  pose_quality_.set_quality_settings(tunable_->pose_quality_distance_threshold_meter,
+                                     tunable_->pose_quality_full_confidence_roi_points,
+                                     tunable_->pose_quality_maximum_plane_angle_deviation_radians);
+  //! The face is the plane that sets the pose direction, from the PCL fit or the ground constrained solver.
+  pose_quality_metrics_ = pose_quality_.evaluate(*cloud_pallet_,
+                                                 first_ransac_model_coefficients_,
+                                                 second_ransac_model_coefficients_);
+
+  if (settings_.enable_debug_mode) {
+    std::cout << "Pose quality: roi points " << pose_quality_metrics_.roi_points
+              << ", ground inliers " << pose_quality_metrics_.ground_inlier_ratio
+              << ", face inliers " << pose_quality_metrics_.face_inlier_ratio
+              << ", face rms " << pose_quality_metrics_.face_residual_rms_meter
+              << ", plane angle " << pose_quality_metrics_.plane_angle_radians
+              << ", confidence " << pose_quality_metrics_.confidence << std::endl;
+  }
+
+  //! A rejected pose is published as invalid and never reaches the pose filter.
+  if (pose_vector_valid_ && pose_quality_metrics_.confidence < tunable_->minimum_pose_confidence) {
+    pose_vector_valid_ = false;
+    if (settings_.enable_debug_mode) {
+      std::cout << "Pose rejected, confidence " << pose_quality_metrics_.confidence << std::endl;
+    }
+  }
+}
+
+FilteredPose PoseEstimation::get_filtered_pose() const {
+  return pose_filter_.get_pose();
+}
+
+FilteredPose PoseEstimation::predict_pose(double timestamp_seconds) const {
+  return pose_filter_.predict(timestamp_seconds);
+}
+
+FilteredPose PoseEstimation::predict_pose_at_host_time(double host_time_seconds) const {
+  const double offset_seconds = host_to_frame_time_offset_seconds_.load(std::memory_order_relaxed);
+  if (std::isnan(offset_seconds)) {
+    return FilteredPose();
+  }
+  return pose_filter_.predict(host_time_seconds + offset_seconds);
+}
+
+PosePublisher &PoseEstimation::get_pose_publisher() {
+  return pose_publisher_;
+}
+
+void PoseEstimation::trigger_capture() {
+  frame_recorder_.trigger_capture(capture::kApi);
+}
+
+const LatencyMonitor &PoseEstimation::get_latency_monitor() const {
+  return latency_monitor_;
+}
+
+bool PoseEstimation::get_ground_truth(Eigen::Vector3d *position, Eigen::Vector3d *direction,
+                                      uint64_t *frame_number) const {
+  if (rvecs_.empty() || tvecs_.empty()) {
+    return false;
+  }
+  *frame_number = ground_truth_frame_number_;
+  *position = Eigen::Vector3d(converted_ground_truth_vector_.at(x_position_id_),
+                              converted_ground_truth_vector_.at(y_position_id_),
+                              converted_ground_truth_vector_.at(z_position_id_));
+  *direction = Eigen::Vector3d(converted_ground_truth_vector_.at(end_x_position_id_),
+                               converted_ground_truth_vector_.at(end_y_position_id_),
+                               converted_ground_truth_vector_.at(end_z_position_id_));
+  return true;
+}
+
+void PoseEstimation::publish_pose_result() {
+  latency_monitor_.end_frame(&frame_context_);
+  host_to_frame_time_offset_seconds_.store(frame_context_.timestamp_mapping == kUnmapped
+                                               ? std::numeric_limits<double>::quiet_NaN()
+                                               : frame_context_.timestamp_seconds - frame_context_.sensor_time_seconds,
+                                           std::memory_order_relaxed);
+
+  PoseResult result;
+  result.timestamp_seconds = frame_context_.timestamp_seconds;
+  result.sensor_time_seconds = frame_context_.sensor_time_seconds;
+  result.frame_number = frame_context_.frame_number;
+  result.timestamp_mapping = frame_context_.timestamp_mapping;
+  result.latency_seconds = static_cast<float>(latency_monitor_.get_pose_latency_seconds());
+  result.source_id = source_id_;
+  result.valid = pose_vector_valid_;
+  result.detection_confidence = detection_output_struct_.confidence;
+  result.pose_confidence = pose_quality_metrics_.confidence;
+  result.roi_points = pose_quality_metrics_.roi_points;
+  result.ground_inlier_ratio = pose_quality_metrics_.ground_inlier_ratio;
+  result.face_inlier_ratio = pose_quality_metrics_.face_inlier_ratio;
+  result.face_residual_rms_meter = pose_quality_metrics_.face_residual_rms_meter;
+  result.plane_angle_radians = pose_quality_metrics_.plane_angle_radians;
+
+  if (pose_vector_valid_) {
+    result.position[x_position_id_] = plane_frustum_vector_intersect_.x;
+    result.position[y_position_id_] = plane_frustum_vector_intersect_.y;
+    result.position[z_position_id_] = plane_frustum_vector_intersect_.z;
+    result.direction[x_position_id_] = pose_vector_end_point_.x - plane_frustum_vector_intersect_.x;
+    result.direction[y_position_id_] = pose_vector_end_point_.y - plane_frustum_vector_intersect_.y;
+    result.direction[z_position_id_] = pose_vector_end_point_.z - plane_frustum_vector_intersect_.z;
+    result.yaw_radians = std::atan2(result.direction[x_position_id_], result.direction[z_position_id_]);
+  }
+
+  if (settings_.enable_pose_filter) {
+    const FilteredPose filtered_pose = pose_filter_.get_pose();
+    result.filtered_valid = filtered_pose.valid;
+    for (int i = iterations_start_at_; i < 3; ++i) {  // TODO(simon) Magic number.
+      result.filtered_position[i] = static_cast<float>(filtered_pose.position[i]);
+    }
+    result.filtered_yaw_radians = static_cast<float>(filtered_pose.yaw_radians);
+  }
+
+  pose_publisher_.publish(result);
+  pose_export_.publish(result);
+
+  frame_recorder_.end_frame(result, {detection_output_struct_.x, detection_output_struct_.y,
+                                     detection_output_struct_.width, detection_output_struct_.height});
+  //! Only a pallet that is seen but gets no pose, or a rejected one, counts. Frames without a detection are the
+  //! normal empty scene and end the run.
+  detected_frames_without_pose_ = has_detection_ && !pose_vector_valid_ ? detected_frames_without_pose_ + 1 : 0;
+  if (settings_.frame_recorder_trigger_invalid_pose_frames > 0 &&
+      detected_frames_without_pose_ == settings_.frame_recorder_trigger_invalid_pose_frames) {
+    frame_recorder_.trigger_capture(capture::kPoseQuality);
   }
 }
 
 void PoseEstimation::log_data(uint32_t frame) {
-  if (enable_logger_ && ransac_model_coefficients_.size() > 1 && tvecs_.size() >= 1
+  if (settings_.enable_logger && has_plane_fits() && tvecs_.size() >= 1
       && rvecs_.size() >= 1) {  // TODO(simon) Magic number.
+    const FilteredPose filtered_pose = pose_filter_.get_pose();
     std::ofstream LoggerFile(std::filesystem::current_path().parent_path() /
-      logger_file_save_relative_path_, std::ios_base::app | std::ios_base::out);
+      source_relative_path(settings_.logger_file_save_relative_path), std::ios_base::app | std::ios_base::out);
 
     LoggerFile << frame << ","
                << plane_frustum_vector_intersect_.x << ","
@@ -852,18 +1529,25 @@ void PoseEstimation::log_data(uint32_t frame) {
                << plane_frustum_vector_intersect_.z << ","
                << second_ransac_model_coefficients_.at(plane_normal_x_id_) << ","
                << (-1 * first_ransac_model_coefficients_.at(plane_normal_z_id_)) << ","
-               << second_ransac_model_coefficients_.at(plane_normal_z_id_) << ","
-               << converted_ground_truth_vector_.at(0) << ","  // TODO(simon) Magic number.
-               << converted_ground_truth_vector_.at(1) << ","  // TODO(simon) Magic number.
-               << converted_ground_truth_vector_.at(2) << ","  // TODO(simon) Magic number.
-               << converted_ground_truth_vector_.at(3) << ","  // TODO(simon) Magic number.
-               << converted_ground_truth_vector_.at(4) << ","  // TODO(simon) Magic number.
-               << converted_ground_truth_vector_.at(5)  // TODO(simon) Magic number.
+               << second_ransac_model_coefficients_.at(plane_normal_z_id_) << ",";
+    //! The ground truth columns stay empty unless the tag was seen in this frame, the tracker can lag behind.
+    if (ground_truth_frame_number_ == frame_context_.frame_number) {
+      for (double value : converted_ground_truth_vector_) {
+        LoggerFile << value << ",";
+      }
+    } else {
+      LoggerFile << std::string(converted_ground_truth_vector_.size(), ',');
+    }
+    LoggerFile << std::fixed << std::setprecision(6) << filtered_pose.timestamp_seconds << std::defaultfloat << ","
+               << filtered_pose.position.x() << ","
+               << filtered_pose.position.y() << ","
+               << filtered_pose.position.z() << ","
+               << filtered_pose.yaw_radians
                << std::endl;
     LoggerFile.close();
   } else {
     std::ofstream LoggerFile(std::filesystem::current_path().parent_path() /
-      logger_file_save_relative_path_, std::ios_base::app | std::ios_base::out);
+      source_relative_path(settings_.logger_file_save_relative_path), std::ios_base::app | std::ios_base::out);
 
     LoggerFile << frame << std::endl;
     LoggerFile.close();
@@ -12,14 +12,21 @@
 #include <pcl/filters/sampling_surface_normal.h>
 #include <pcl/conversions.h>
 #include <pcl/ModelCoefficients.h>
-#include <pcl/filters/frustum_culling.h>
 #include <pcl/io/pcd_io.h>
 #include <jsoncpp/json/json.h>
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <array>
+#include <atomic>
+#include <cfloat>
+#include <limits>
+#include <numeric>
 #include <chrono>
 #include <thread>
 #include <fstream>
+#include <iomanip>
 #include <string>
 #include <vector>
 
@@ -27,27 +34,86 @@
 #include "opencv2/opencv.hpp"
 #include "opencv2/aruco.hpp"
 
+#include "CameraAlignment/CameraAlignment.h"
+#include "Configuration/Configuration.h"
+#include "FrameArena/FrameArena.h"
+#include "FrameRecorder/FrameRecorder.h"
+#include "FrustumCrop/FrustumCrop.h"
+#include "GroundPlane/GroundPlane.h"
+#include "LatencyMonitor/LatencyMonitor.h"
+#include "MarkerTracker/MarkerTracker.h"
 #include "ObjectDetection/ObjectDetection.h"
+#include "PalletFaceSolver/PalletFaceSolver.h"
+#include "PoseExport/PoseExport.h"
+#include "PoseFilter/PoseFilter.h"
+#include "PoseQuality/PoseQuality.h"
+#include "PosePublisher/PosePublisher.h"
+#include "SharedDetector/SharedDetector.h"
+#include "ThreadPool/ThreadPool.h"
 
 #ifndef INCLUDE_POSEESTIMATION_POSEESTIMATION_POSEESTIMATION_H_
 #define INCLUDE_POSEESTIMATION_POSEESTIMATION_POSEESTIMATION_H_
 
 class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
  public:
+  //! source_id selects the camera in settings.sources. With a shared_detector the camera hands its frames to that
+  //! detector instead of setting up a network of its own.
+  explicit PoseEstimation(Configuration &configuration, uint16_t source_id = 0,
+                          SharedDetector *shared_detector = nullptr);
+
   void run_pose_estimation();
 
-  void setup_pose_estimation();
+  //! Returns false if the pipeline cannot run as configured, e.g. the configured INT8 model is missing.
+  bool setup_pose_estimation();
 
- private:
-  //! Variables
-  static constexpr char rosbag_relative_path_[] =
-      "data/20220327_162128_2meter_with_light_standing_aruco_90_deg_slow_move.bag";  // TODO(simon) Unconst this and implement in configuration file.
+  //! Latest filtered pose, safe to call from other threads.
+  FilteredPose get_filtered_pose() const;
+
+  //! Filtered pose extrapolated to timestamp_seconds, in the time base of the color frame timestamps
+  //! (PoseResult::timestamp_seconds, the camera domain). Safe to call from other threads, e.g. a controller running
+  //! faster than the camera.
+  FilteredPose predict_pose(double timestamp_seconds) const;
+
+  //! predict_pose at a host system clock time in seconds since epoch, mapped through the offset between the frame
+  //! and sensor time of the latest frame. Not valid while the timestamps cannot be mapped, e.g. during playback.
+  FilteredPose predict_pose_at_host_time(double host_time_seconds) const;
+
+  //! Latest PoseResult of every frame for in-process consumers, lock-free to poll or delivered to callbacks.
+  PosePublisher &get_pose_publisher();
+
+  //! Writes the frames kept by the frame recorder to a capture file in the background. Safe to call from other
+  //! threads, does nothing if the recorder is disabled.
+  void trigger_capture();
+
+  //! Latency histograms from the sensor exposure to the published pose and of every stage. The histograms can be
+  //! read from other threads.
+  const LatencyMonitor &get_latency_monitor() const;
 
-  static constexpr uint16_t minimum_object_detection_width_pixels_ = 10;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr uint16_t minimum_object_detection_height_pixels_ = 10;  // TODO(simon) Unconst this and implement in configuration file.
+  //! AprilTag position and face normal of the last frame the tag was seen in, in the same frame as the pose.
+  //! frame_number is that frame, compare it with PoseResult::frame_number before pairing the two: the tracked
+  //! evaluation mode lags behind. Returns false before the tag has been seen.
+  bool get_ground_truth(Eigen::Vector3d *position, Eigen::Vector3d *direction, uint64_t *frame_number) const;
 
+  //! Configures and sets up an object detection network from the settings, shared with the multi camera setup.
+  //! Returns false if the model selected by object_detection.model_precision cannot be used.
+  static bool setup_object_detection(ObjectDetection *object_detection,
+                                     const Settings &settings,
+                                     const TunableSettings &tunable_settings,
+                                     uint16_t number_of_threads,
+                                     uint16_t batch_size);
+
+  //! Model selected by object_detection.model_precision. Never falls back to FP32 when INT8 is configured, a missing
+  //! INT8 model or an unknown precision returns false.
+  static bool select_model_relative_path(const Settings &settings, std::string *model_relative_path);
+
+  //! thread_pool.number_of_threads is the budget of the whole process. With several cameras it is split evenly
+  //! between the cameras and the shared detector, which also gets the remainder.
+  static uint16_t get_threads_per_source(const Settings &settings);
+  static uint16_t get_shared_detector_threads(const Settings &settings);
+
+ private:
+  //! Variables
   static constexpr uint8_t minimum_iterations_before_ransac_ = 10;
-  static constexpr uint8_t minimum_ransac_coefficients_ = 3;
   static constexpr uint8_t minimum_marker_corners_ = 0;
 
   static constexpr uint8_t cv_waitkey_delay_ = 1;
@@ -63,13 +129,8 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   static constexpr uint8_t iterations_start_at_ = 0;
 
   static constexpr bool realsense_skip_frames_ = false;
-  static constexpr float object_detection_nms_threshold_ = 0.3;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr float object_detection_bbox_conf_threshold_ = 0.1;  // TODO(simon) Unconst this and implement in configuration file.
   static constexpr uint8_t number_of_object_detection_corner_vectors_ = 4;
 
-  static constexpr char object_detection_model_relative_path_[] =
-      "models/yolox_s_only_pallet_294epoch_o10/yolox_s_only_pallet_294epoch_o10.xml";  // TODO(simon) Unconst this and implement in configuration file.
-
   static constexpr char pcl_window_name_[] = "3D Viewer";  // TODO(simon) Unconst this and implement in configuration file.
   static constexpr uint8_t pcl_viewport_id_ = 0;
   static constexpr double pcl_background_color_rgb_[3] = {0, 0, 0};  // TODO(simon) Unconst this and implement in configuration file.
@@ -87,9 +148,6 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   static constexpr char pose_vector_reference_name_[] = "pose_vector";
   static constexpr char opencv_image_window_name_[] = "Output";
 
-  static constexpr float pcl_frustum_filter_near_plane_distance_meter_ = 0;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr float pcl_frustum_filter_far_plane_distance_meter_ = 15;  // TODO(simon) Unconst this and implement in configuration file.
-
   static constexpr uint8_t first_ = 0;
   static constexpr uint8_t second_ = 1;
   static constexpr uint8_t third_ = 2;
@@ -104,6 +162,7 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   static constexpr uint8_t plane_normal_y_id_ = 1;
   static constexpr uint8_t plane_normal_z_id_ = 2;
   static constexpr uint8_t plane_hessian_component_id_ = 3;
+  static constexpr uint8_t plane_coefficients_ = 4;
 
   static constexpr uint8_t red_color_id_ = 0;
   static constexpr uint8_t green_color_id_ = 1;
@@ -111,31 +170,20 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
 
   static constexpr float rad_to_deg_ = 57.2958;
 
+  static constexpr uint32_t ground_sample_candidate_points_ = 16384;  //! Full cloud points tested per frame.
+
 //  static const cv::Scalar(0, 0, 255) april_tag_marker_color_;// = {0,0,255}; //cv::Scalar(0,0,255);
-  static constexpr float april_tag_marker_length_meter_ = 0.535;  // TODO(simon) Unconst this and implement in configuration file.
   pcl::PointXYZ pcl_point_origin_xyz_ = pcl::PointXYZ(0, 0, 0);
   static constexpr double selected_point_color_rgb_[3] = {255,255,0};  // TODO(simon) Unconst this and implement in configuration file.
   static constexpr double center_frustum_vector_color_rgb_[3] = {255, 0, 0};  // TODO(simon) Unconst this and implement in configuration file.
   static constexpr double ground_truth_vector_color_rgb_[3] = {0,0,255};  // TODO(simon) Unconst this and implement in configuration file.
   static constexpr double pose_vector_color_rgb_[3] = {0,255,0};  // TODO(simon) Unconst this and implement in configuration file.
 
-  static constexpr double ransac_eps_angle_radians_ = 0.1;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr uint16_t ransac_max_iterations_ = 50;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr double first_ransac_distance_threshold_meter_ = 0.001;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr double second_ransac_distance_threshold_meter_ = 0.0001;  // TODO(simon) Unconst this and implement in configuration file.
-
-  static constexpr uint16_t sample_surface_normal_sample_size_ = 50;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr float sample_surface_normal_ratio_ = 0.5;  // TODO(simon) Unconst this and implement in configuration file.
-
-  static constexpr uint16_t minimum_points_for_ransac_ = 10; // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr uint16_t minimum_points_for_sampling_surface_normals_ = 10; // TODO(simon) Unconst this and implement in configuration file.
-
-  static constexpr uint16_t maximum_iterations_for_segmentation_ = 500;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr double segmentation_distance_threshold_meter_ = 0.1;  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr double segmentation_eps_angle_radians_ = 0.1;  // TODO(simon) Unconst this and implement in configuration file.
-
-  static constexpr char logger_file_save_relative_path_[] = "log/data_out.csv";  // TODO(simon) Unconst this and implement in configuration file.
-  static constexpr uint64_t debug_print_after_seconds_ = 5;  // TODO(simon) Unconst this and implement in configuration file.
+  static constexpr uint32_t frustum_filter_chunk_size_points_ = 16384;
+  static constexpr uint8_t frustum_roi_edge_samples_ = 8;  //! Per far plane edge, the distortion bends the edges.
+  static constexpr uint8_t frustum_roi_margin_pixels_ = 2;
+  //! Invalid depth pixels are (0, 0, 0), a near plane at the camera keeps them wherever they are in the image.
+  static constexpr float minimum_frustum_near_plane_distance_meter_ = 0.01;  // TODO(simon) Magic number.
 
   //! Pallet selection method
   enum pallet_selection_method {  // TODO(simon) Implement pallet selection.
@@ -146,34 +194,74 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   };
 
   //! Aruco functions
-  void calculate_aruco();
+  void calculate_aruco(uint64_t frame_number);
 
   void calculate_pose();
 
   void set_camera_parameters();
 
   //! Pose estimation functions
-  void edit_pointcloud();
+  //! Full depth frame to pcl_points_, only run when a later stage needs it.
+  void calculate_pointcloud(const rs2::depth_frame &depth);
+
+  void edit_pointcloud(const rs2::depth_frame &depth);
+
+  //! Depth pixels whose rays can pass through the frustum, with a margin. The full frame if the frustum does not
+  //! start at the depth camera or reaches behind it.
+  cv::Rect calculate_frustum_depth_roi(const FrustumCrop &frustum_crop, const rs2_intrinsics &depth_intrinsics) const;
+
+  //! Points of the image region below the detection, the same height as the box, in the frame of cloud_pallet_.
+  void calculate_ground_sample(const rs2::depth_frame &depth);
 
   void calculate_ransac();
 
+  //! Forgets the planes and clouds of the previous frame, a fit that is skipped leaves its plane empty.
+  void clear_plane_fits();
+
+  //! The ground, the pallet front and the face were all fitted in this frame.
+  bool has_plane_fits() const;
+
   void calculate_pose_vector();
 
+  //! Scores the planes of the pose and rejects it below minimum_pose_confidence.
+  void calculate_pose_quality();
+
   void calculate_3d_crop();
 
   pcl::PointCloud<pcl::PointXYZ>::Ptr points_to_pcl(const rs2::points &points);
 
+  void calculate_ground_truth_vector();
+
   void view_pointcloud();
 
   void log_data(uint32_t frame);
 
-  bool load_from_rosbag = true;  //! Select if input should be recorder rosbag or direct from camera.  // TODO(simon): Implement in configuration file.
-  bool single_run_ = true;  // TODO(simon): Implement in configuration file.
-  bool enable_logger_ = true;  // TODO(simon): Implement in configuration file.
-  bool enable_debug_mode_ = false;  // TODO(simon): Implement in configuration file.
+  //! Configuration
+  Configuration &configuration_;
+  const Settings &settings_;
+  std::shared_ptr<const TunableSettings> tunable_;  //! Snapshot taken at the start of every frame.
+  std::future<bool> configuration_reload_task_;
+  uint32_t frames_since_configuration_check_ = 0;
+
+  //! Camera source
+  std::string source_relative_path(const std::string &relative_path) const;  //! Adds "_<source name>" to the stem.
+
+  uint16_t source_id_ = 0;
+  SourceSettings source_;  //! Empty when settings.sources is, the single camera case.
+  bool enable_visualization_ = false;
+
+  //! Threads
+  ThreadPool thread_pool_;  //! Shared by the point cloud stages, sized to match the inference threads.
+
+  //! Memory
+  FrameArena frame_arena_;  //! Point cloud buffers recycled between frames, reset at the end of every frame.
 
   //! Camera
   rs2::pipeline p;
+  CameraAlignment camera_alignment_;
+  rs2_format color_format_ = RS2_FORMAT_RGB8;
+  bool show_color_frame_ = false;  //! The annotated color frame goes to a window or the export preview.
+  bool convert_color_frame_ = true;  //! RGB frames are converted to BGR in place every frame.
   cv::Mat image_;
   std::string rosbag_path_;
 
@@ -187,6 +275,9 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   std::vector<std::vector<cv::Point2f>> markerCorners_, rejectedCandidates_;
   std::vector<int> markerIds_;
 
+  MarkerTracker marker_tracker_;  //! Used when aruco_evaluation_mode is TRACKED.
+  MarkerResult tracked_marker_;
+
   float example_camera_matrix_data[9] = {907.114, 0, 662.66, 0, 907.605, 367.428, 0, 0, 1};  // TODO(simon) Get K matrix from camera.
   cv::Mat example_camera_matrix_ = cv::Mat(3, 3, CV_32F, example_camera_matrix_data);
 
@@ -205,10 +296,12 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   cv::Mat ground_truth_vector_;
 
   std::vector<double> converted_ground_truth_vector_ = {0, 0, 0, 0, 0, 0};
+  uint64_t ground_truth_frame_number_ = 0;  //! Frame the tag of rvecs_ and tvecs_ was seen in.
 
   //! Object detection
   ObjectDetection object_detection_object_;
   ObjectDetection pallet_void_object_detection_object_;
+  SharedDetector *shared_detector_ = nullptr;
 
   object_detection_output detection_output_struct_;
   object_detection_output pallet_void_detection_output_struct_;
@@ -217,7 +310,7 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   //! Point cloud
   rs2::pointcloud realsense_pointcloud_;
   rs2::points realsense_points_;
-  boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> pcl_points_;
+  pcl::PointCloud<pcl::PointXYZ>::Ptr pcl_points_;
   pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_ptr_;
   pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_pallet_;
   pcl::PointCloud<pcl::PointNormal>::Ptr output_cloud_with_normals_;
@@ -232,13 +325,19 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   bool first_run_ = true;
 
   //! Plane_estimation
-  std::vector<float> ransac_model_coefficients_;
-  std::vector<float> first_ransac_model_coefficients_;
-  std::vector<float> second_ransac_model_coefficients_;
+  std::vector<float> ransac_model_coefficients_;  //! The center vector hits this plane at the pose position.
+  std::vector<float> first_ransac_model_coefficients_;  //! Ground.
+  GroundPlane ground_plane_;
+  pcl::PointCloud<pcl::PointXYZ>::Ptr ground_sample_;  //! Floor below the detection, verifies the ground plane.
+  std::future<bool> ground_plane_save_task_;
+  PalletFaceSolver pallet_face_solver_;
+  std::vector<float> second_ransac_model_coefficients_;  //! Pallet face, its normal is the pose direction.
   pcl::PointIndices::Ptr inliers_;
   std::vector<int> frustum_filter_inliers_;
+  std::vector<std::vector<int>> frustum_filter_chunk_inliers_;
+  std::vector<pcl::PointCloud<pcl::PointXYZ>::VectorType> frustum_filter_chunk_points_;
   double zed_k_matrix_[4] = {907.114, 907.605, 662.66,  // TODO(simon) Not full K-matrix.
-                             367.428};  // TODO(simon) Get K matrix from camera. This is from Realsense l515. (fx, fy, cx, cy)
+                             367.428};  //! Realsense l515 defaults, replaced by the color intrinsics of the device. (fx, fy, cx, cy)
   std::vector<Eigen::Vector2d> detection_from_image_center_;
   double detection_vector_scale_ = 3;
   float fov_v_rad_;
@@ -255,6 +354,30 @@ class PoseEstimation {  // TODO(simon) Add Doxygen documentation.
   pcl::PointXYZ plane_vector_intersect_;
   pcl::PointXYZ plane_frustum_vector_intersect_;
   pcl::PointXYZ pose_vector_end_point_;
+  bool pose_vector_valid_ = false;  //! pose_vector_end_point_ was updated by the last calculate_pose_vector.
+
+  //! Pose quality
+  PoseQuality pose_quality_;
+  PoseQualityMetrics pose_quality_metrics_;
+
+  //! Pose filter
+  PoseFilter pose_filter_;
+  bool pose_filter_accepted_ = false;
+  //! Frame timestamp minus host sensor time of the latest mapped frame, NaN while unmapped.
+  std::atomic<double> host_to_frame_time_offset_seconds_{std::numeric_limits<double>::quiet_NaN()};
+
+  //! Latency
+  LatencyMonitor latency_monitor_;
+  FrameContext frame_context_;  //! Frame in progress.
+
+  //! Results
+  void publish_pose_result();
+
+  PosePublisher pose_publisher_;
+  PoseExport pose_export_;
+  FrameRecorder frame_recorder_;
+  bool has_detection_ = false;  //! The detection of this frame is large enough to estimate a pose from.
+  uint32_t detected_frames_without_pose_ = 0;  //! Consecutive frames with a detection but no accepted pose.
 };
 
 #endif  // INCLUDE_POSEESTIMATION_POSEESTIMATION_POSEESTIMATION_H_
@@ -0,0 +1,178 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "PoseExport/PoseExport.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+PoseExport::~PoseExport() {
+  shutdown();
+}
+
+bool PoseExport::setup_pose_export(const std::string &shared_memory_name,
+                                   const std::string &preview_format,
+                                   uint16_t preview_width,
+                                   uint8_t preview_jpeg_quality,
+                                   ThreadPool *thread_pool) {
+  shared_memory_name_ = shared_memory_name;
+  preview_width_ = preview_width;
+  preview_jpeg_quality_ = preview_jpeg_quality;
+  thread_pool_ = thread_pool;
+
+  if (preview_format == "JPEG") {
+    preview_format_ = pose_export::kJpeg;
+  } else if (preview_format == "RAW") {
+    preview_format_ = pose_export::kRawBgr;
+  } else {
+    preview_format_ = pose_export::kNone;
+  }
+
+  //! An object left by a writer that did not shut down holds stale sequences, always start from a new one. Readers
+  //! still mapping the old object keep their view of it.
+  shm_unlink(shared_memory_name_.c_str());
+  int file_descriptor = shm_open(shared_memory_name_.c_str(), O_CREAT | O_EXCL | O_RDWR,
+                                 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (file_descriptor < 0) {
+    std::cerr << "Pose export disabled, shm_open " << shared_memory_name_ << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  if (ftruncate(file_descriptor, sizeof(pose_export::SharedMemory)) != 0) {
+    std::cerr << "Pose export disabled, ftruncate: " << std::strerror(errno) << std::endl;
+    close(file_descriptor);
+    return false;
+  }
+  void *address = mmap(nullptr, sizeof(pose_export::SharedMemory), PROT_READ | PROT_WRITE, MAP_SHARED,
+                       file_descriptor, 0);
+  close(file_descriptor);
+  if (address == MAP_FAILED) {
+    std::cerr << "Pose export disabled, mmap: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  //! A new object is zero filled by ftruncate, cleared again so the sequences start at zero regardless. The magic is
+  //! published last.
+  std::memset(address, 0, sizeof(pose_export::SharedMemory));
+  shared_memory_ = new(address) pose_export::SharedMemory;
+  pose_export::SharedHeader &header = shared_memory_->header;
+  header.magic.store(0, std::memory_order_relaxed);
+  header.layout_version = pose_export::layout_version;
+  header.ring_capacity = pose_export::ring_capacity;
+  header.record_size = sizeof(pose_export::PoseRecord);
+  header.write_count.store(0, std::memory_order_relaxed);
+  header.writer_alive.store(1, std::memory_order_relaxed);
+  header.magic.store(pose_export::magic, std::memory_order_release);
+
+  std::cout << "Pose export: /dev/shm" << shared_memory_name_ << ", " << sizeof(pose_export::SharedMemory)
+            << " bytes" << std::endl;
+  return true;
+}
+
+void PoseExport::publish(const PoseResult &result) {
+  if (shared_memory_ == nullptr) {
+    return;
+  }
+
+  pose_export::PoseRecord record{};
+  record.timestamp_seconds = result.timestamp_seconds;
+  record.frame_number = result.frame_number;
+  record.flags = (result.valid ? pose_export::kPoseValid : 0)
+      | (result.filtered_valid ? pose_export::kFilteredPoseValid : 0);
+  record.source_id = result.source_id;
+  std::memcpy(record.position, result.position, sizeof(record.position));
+  std::memcpy(record.direction, result.direction, sizeof(record.direction));
+  record.yaw_radians = result.yaw_radians;
+  std::memcpy(record.filtered_position, result.filtered_position, sizeof(record.filtered_position));
+  record.filtered_yaw_radians = result.filtered_yaw_radians;
+  record.detection_confidence = result.detection_confidence;
+  record.pose_confidence = result.pose_confidence;
+  record.roi_points = result.roi_points;
+  record.ground_inlier_ratio = result.ground_inlier_ratio;
+  record.face_inlier_ratio = result.face_inlier_ratio;
+  record.face_residual_rms_meter = result.face_residual_rms_meter;
+  record.plane_angle_radians = result.plane_angle_radians;
+  record.timestamp_mapping = result.timestamp_mapping;
+  record.sensor_time_seconds = result.sensor_time_seconds;
+  record.latency_seconds = result.latency_seconds;
+
+  pose_export::SharedHeader &header = shared_memory_->header;
+  const uint64_t write_count = header.write_count.load(std::memory_order_relaxed);
+  pose_export::write_record(&shared_memory_->records[write_count % pose_export::ring_capacity], record);
+  header.write_count.store(write_count + 1, std::memory_order_release);
+  pose_export::wake_readers(&header.notify);
+}
+
+void PoseExport::publish_preview(const cv::Mat &image, uint64_t frame_number) {
+  if (shared_memory_ == nullptr || preview_format_ == pose_export::kNone || image.empty()
+      || preview_busy_.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+
+  const double scale = std::min(1.0, static_cast<double>(preview_width_) / image.cols);
+  cv::resize(image, preview_image_, cv::Size(), scale, scale, cv::INTER_AREA);
+
+  if (thread_pool_ != nullptr) {
+    thread_pool_->submit([this, frame_number]() { write_preview(frame_number); });
+  } else {
+    write_preview(frame_number);
+  }
+}
+
+void PoseExport::shutdown() {
+  if (shared_memory_ == nullptr) {
+    return;
+  }
+  while (preview_busy_.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  shared_memory_->header.writer_alive.store(0, std::memory_order_release);
+  pose_export::wake_readers(&shared_memory_->header.notify);
+
+  munmap(shared_memory_, sizeof(pose_export::SharedMemory));
+  shm_unlink(shared_memory_name_.c_str());  //! Mapped readers keep their view, new readers will not attach.
+  shared_memory_ = nullptr;
+}
+
+bool PoseExport::is_setup() const {
+  return shared_memory_ != nullptr;
+}
+
+void PoseExport::write_preview(uint64_t frame_number) {
+  const unsigned char *data = preview_image_.data;
+  size_t size_bytes = preview_image_.total() * preview_image_.elemSize();
+
+  if (preview_format_ == pose_export::kJpeg) {
+    cv::imencode(".jpg", preview_image_, preview_buffer_, {cv::IMWRITE_JPEG_QUALITY, preview_jpeg_quality_});
+    data = preview_buffer_.data();
+    size_bytes = preview_buffer_.size();
+  } else if (!preview_image_.isContinuous()) {
+    preview_image_ = preview_image_.clone();
+    data = preview_image_.data;
+  }
+
+  if (size_bytes <= pose_export::preview_capacity_bytes) {
+    pose_export::PreviewSlot &preview = shared_memory_->preview;
+    const uint64_t sequence = preview.sequence.load(std::memory_order_relaxed);
+    preview.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    preview.format = preview_format_;
+    preview.width = preview_image_.cols;
+    preview.height = preview_image_.rows;
+    preview.size_bytes = size_bytes;
+    preview.frame_number = frame_number;
+    std::memcpy(preview.data, data, size_bytes);
+    preview.sequence.store(sequence + 2, std::memory_order_release);
+    pose_export::wake_readers(&shared_memory_->header.notify);
+  }
+
+  preview_busy_.store(false, std::memory_order_release);
+}
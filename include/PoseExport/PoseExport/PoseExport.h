@@ -0,0 +1,58 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_POSEEXPORT_POSEEXPORT_POSEEXPORT_H_
+#define INCLUDE_POSEEXPORT_POSEEXPORT_POSEEXPORT_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+
+#include "PoseExport/PoseExportLayout.h"
+#include "PosePublisher/PosePublisher.h"
+#include "ThreadPool/ThreadPool.h"
+
+//! Writer side of the shared memory export. Pose records go into a ring in a POSIX shared memory object and an
+//! optional downscaled preview image into a single slot; readers are woken with a shared futex. See
+//! PoseExportLayout.h for the layout, and src/pose_shm_reader.cc for a reader.
+class PoseExport {
+ public:
+  ~PoseExport();
+
+  //! preview_format is NONE, JPEG or RAW. Returns false and stays disabled if the shared memory can not be created.
+  bool setup_pose_export(const std::string &shared_memory_name,
+                         const std::string &preview_format,
+                         uint16_t preview_width,
+                         uint8_t preview_jpeg_quality,
+                         ThreadPool *thread_pool);
+
+  void publish(const PoseResult &result);
+
+  //! Downscales on the calling thread, encodes and copies on the thread pool. Skipped while the previous preview
+  //! is still being written.
+  void publish_preview(const cv::Mat &image, uint64_t frame_number);
+
+  void shutdown();
+
+  bool is_setup() const;
+
+ private:
+  void write_preview(uint64_t frame_number);
+
+  std::string shared_memory_name_;
+  pose_export::SharedMemory *shared_memory_ = nullptr;
+
+  pose_export::PreviewFormat preview_format_ = pose_export::kNone;
+  uint16_t preview_width_ = 320;
+  uint8_t preview_jpeg_quality_ = 70;
+  ThreadPool *thread_pool_ = nullptr;
+
+  cv::Mat preview_image_;
+  std::vector<unsigned char> preview_buffer_;
+  std::atomic<bool> preview_busy_{false};
+};
+
+#endif  // INCLUDE_POSEEXPORT_POSEEXPORT_POSEEXPORT_H_
@@ -0,0 +1,152 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_POSEEXPORT_POSEEXPORT_POSEEXPORTLAYOUT_H_
+#define INCLUDE_POSEEXPORT_POSEEXPORT_POSEEXPORTLAYOUT_H_
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//! Memory layout of the shared memory pose export. Shared by the writer and by readers in other processes, so it
+//! only depends on the standard library. Any change to the structs below must increase layout_version.
+namespace pose_export {
+
+constexpr uint32_t magic = 0x50534531;  //! "PSE1"
+constexpr uint32_t layout_version = 5;
+constexpr uint32_t ring_capacity = 64;
+constexpr uint32_t preview_capacity_bytes = 1 << 20;
+
+enum PreviewFormat : uint32_t {
+  kNone = 0,
+  kJpeg = 1,
+  kRawBgr = 2,
+};
+
+enum RecordFlags : uint32_t {
+  kPoseValid = 1 << 0,
+  kFilteredPoseValid = 1 << 1,
+};
+
+struct PoseRecord {
+  double timestamp_seconds;
+  uint64_t frame_number;
+  uint32_t flags;
+  uint32_t source_id;  //! Camera in the configured sources, 0 with a single camera.
+  float position[3];
+  float direction[3];
+  float yaw_radians;
+  float filtered_position[3];
+  float filtered_yaw_radians;
+  float detection_confidence;
+  float pose_confidence;
+  uint32_t roi_points;
+  float ground_inlier_ratio;
+  float face_inlier_ratio;
+  float face_residual_rms_meter;
+  float plane_angle_radians;
+  uint32_t timestamp_mapping;  //! 0 unmapped, 1 global time, 2 host arrival time, 3 device clock with offset.
+  double sensor_time_seconds;  //! Exposure on the system clock, seconds since epoch.
+  float latency_seconds;  //! From the exposure to the record being written.
+};
+
+constexpr size_t record_words = (sizeof(PoseRecord) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+//! One ring entry with its own seqlock. The sequence is odd while the writer is inside the slot.
+struct alignas(64) RecordSlot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> words[record_words];
+};
+
+struct alignas(64) PreviewSlot {
+  std::atomic<uint64_t> sequence;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t size_bytes;
+  uint64_t frame_number;
+  unsigned char data[preview_capacity_bytes];
+};
+
+struct alignas(64) SharedHeader {
+  std::atomic<uint32_t> magic;  //! Written last by the writer, a reader must not trust the rest before it is set.
+  uint32_t layout_version;
+  uint32_t ring_capacity;
+  uint32_t record_size;
+  std::atomic<uint64_t> write_count;  //! Records written so far, the newest is in slot (write_count - 1) % capacity.
+  std::atomic<uint32_t> notify;  //! Futex word, increased after every record and preview.
+  std::atomic<uint32_t> writer_alive;
+};
+
+struct SharedMemory {
+  SharedHeader header;
+  RecordSlot records[ring_capacity];
+  PreviewSlot preview;
+};
+
+static_assert(std::is_trivially_copyable_v<PoseRecord>, "PoseRecord is copied word by word");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared atomics must be lock free to be address free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared atomics must be lock free to be address free");
+
+inline void write_record(RecordSlot *slot, const PoseRecord &record) {
+  uint64_t words[record_words] = {};
+  std::memcpy(words, &record, sizeof(PoseRecord));
+
+  const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < record_words; ++i) {
+    slot->words[i].store(words[i], std::memory_order_relaxed);
+  }
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+//! Slot sequence once record record_index is complete, every write to a slot adds 2.
+inline uint64_t expected_sequence(uint64_t record_index) {
+  return 2 * (record_index / ring_capacity + 1);
+}
+
+//! Returns false if the writer was inside the slot or the slot does not hold record record_index. The caller decides
+//! whether to retry, a sequence past expected_sequence means the record was overwritten.
+inline bool read_record(const RecordSlot &slot, uint64_t record_index, PoseRecord *record) {
+  uint64_t words[record_words];
+  const uint64_t sequence_before = slot.sequence.load(std::memory_order_acquire);
+  if (sequence_before != expected_sequence(record_index)) {
+    return false;
+  }
+  for (size_t i = 0; i < record_words; ++i) {
+    words[i] = slot.words[i].load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.sequence.load(std::memory_order_relaxed) != sequence_before) {
+    return false;
+  }
+  std::memcpy(record, words, sizeof(PoseRecord));
+  return true;
+}
+
+//! Shared futex, readers in other processes wait on it, so no FUTEX_PRIVATE_FLAG.
+inline void wake_readers(std::atomic<uint32_t> *notify) {
+  notify->fetch_add(1, std::memory_order_release);
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(notify), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+//! Blocks while notify still holds expected_value, at most timeout_ms.
+inline void wait_for_writer(std::atomic<uint32_t> *notify, uint32_t expected_value, uint32_t timeout_ms) {
+  timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000;  // NOLINT(runtime/int)
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(notify), FUTEX_WAIT, expected_value, &timeout, nullptr, 0);
+}
+
+}  // namespace pose_export
+
+#endif  // INCLUDE_POSEEXPORT_POSEEXPORT_POSEEXPORTLAYOUT_H_
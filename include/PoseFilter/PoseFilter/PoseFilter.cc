@@ -0,0 +1,169 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "PoseFilter/PoseFilter.h"
+
+#include <Eigen/LU>
+
+#include <algorithm>
+#include <cmath>
+
+void PoseFilter::set_filter_settings(double process_noise_acceleration,
+                                     double process_noise_yaw_acceleration,
+                                     double measurement_noise_position_meter,
+                                     double measurement_noise_yaw_radians,
+                                     double gate_threshold,
+                                     uint16_t maximum_consecutive_rejections,
+                                     double maximum_prediction_horizon_seconds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  process_noise_acceleration_ = process_noise_acceleration;
+  process_noise_yaw_acceleration_ = process_noise_yaw_acceleration;
+  measurement_noise_position_meter_ = measurement_noise_position_meter;
+  measurement_noise_yaw_radians_ = measurement_noise_yaw_radians;
+  gate_threshold_ = gate_threshold;
+  maximum_consecutive_rejections_ = maximum_consecutive_rejections;
+  maximum_prediction_horizon_seconds_ = maximum_prediction_horizon_seconds;
+}
+
+bool PoseFilter::update(double timestamp_seconds, const Eigen::Vector3d &position, double yaw_radians) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Measurement measurement;
+  measurement << position, wrap_angle(yaw_radians);
+
+  //! A frame repeated by playback carries no new information, the state and covariance are kept.
+  if (is_initialized_ && timestamp_seconds == timestamp_seconds_) {
+    return false;
+  }
+
+  //! A rosbag that loops or a restarted stream goes back in time, start over.
+  if (!is_initialized_ || timestamp_seconds < timestamp_seconds_
+      || consecutive_rejections_ >= maximum_consecutive_rejections_) {
+    initialize(timestamp_seconds, measurement);
+    return true;
+  }
+
+  State state = state_;
+  Covariance covariance = covariance_;
+  predict_state(timestamp_seconds - timestamp_seconds_, &state, &covariance);
+
+  Measurement innovation = measurement - state.head<measurement_size_>();
+  innovation(yaw_id_) = wrap_angle(innovation(yaw_id_));
+
+  Eigen::Matrix<double, measurement_size_, measurement_size_> measurement_covariance =
+      Eigen::Matrix<double, measurement_size_, measurement_size_>::Zero();
+  measurement_covariance.diagonal() << Eigen::Vector3d::Constant(
+      measurement_noise_position_meter_ * measurement_noise_position_meter_),
+      measurement_noise_yaw_radians_ * measurement_noise_yaw_radians_;
+
+  const Eigen::Matrix<double, measurement_size_, measurement_size_> innovation_covariance =
+      covariance.topLeftCorner<measurement_size_, measurement_size_>() + measurement_covariance;
+  const Eigen::Matrix<double, measurement_size_, measurement_size_> innovation_covariance_inverse =
+      innovation_covariance.inverse();
+
+  const double mahalanobis_distance_squared = innovation.transpose() * innovation_covariance_inverse * innovation;
+  if (mahalanobis_distance_squared > gate_threshold_) {
+    consecutive_rejections_++;
+    return false;
+  }
+  consecutive_rejections_ = 0;
+
+  //! H selects the first four states, so P H^T is the left block of P.
+  const Eigen::Matrix<double, state_size_, measurement_size_> gain =
+      covariance.leftCols<measurement_size_>() * innovation_covariance_inverse;
+  state += gain * innovation;
+  state(yaw_id_) = wrap_angle(state(yaw_id_));
+  covariance -= gain * covariance.topRows<measurement_size_>();
+  covariance = 0.5 * (covariance + covariance.transpose());  //! Keep it symmetric.
+
+  state_ = state;
+  covariance_ = covariance;
+  timestamp_seconds_ = timestamp_seconds;
+  return true;
+}
+
+FilteredPose PoseFilter::get_pose() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!is_initialized_) {
+    return FilteredPose();
+  }
+  return to_pose(timestamp_seconds_, state_, covariance_);
+}
+
+FilteredPose PoseFilter::predict(double timestamp_seconds) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!is_initialized_) {
+    return FilteredPose();
+  }
+
+  const double delta_seconds =
+      std::clamp(timestamp_seconds - timestamp_seconds_, 0.0, maximum_prediction_horizon_seconds_);
+  State state = state_;
+  Covariance covariance = covariance_;
+  predict_state(delta_seconds, &state, &covariance);
+  return to_pose(timestamp_seconds_ + delta_seconds, state, covariance);
+}
+
+void PoseFilter::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  is_initialized_ = false;
+  consecutive_rejections_ = 0;
+}
+
+void PoseFilter::initialize(double timestamp_seconds, const Measurement &measurement) {
+  state_.setZero();
+  state_.head<measurement_size_>() = measurement;
+
+  covariance_.setZero();
+  covariance_.diagonal() << Eigen::Vector3d::Constant(
+      measurement_noise_position_meter_ * measurement_noise_position_meter_),
+      measurement_noise_yaw_radians_ * measurement_noise_yaw_radians_,
+      Eigen::Vector4d::Constant(initial_velocity_variance_);
+
+  timestamp_seconds_ = timestamp_seconds;
+  consecutive_rejections_ = 0;
+  is_initialized_ = true;
+}
+
+void PoseFilter::predict_state(double delta_seconds, State *state, Covariance *covariance) const {
+  if (delta_seconds <= 0) {
+    return;
+  }
+
+  Covariance transition = Covariance::Identity();
+  transition.topRightCorner<measurement_size_, measurement_size_>().diagonal().setConstant(delta_seconds);
+
+  //! Piecewise constant white acceleration, per axis [dt^4/4, dt^3/2; dt^3/2, dt^2] * q^2.
+  const double dt2 = delta_seconds * delta_seconds;
+  const double dt3 = dt2 * delta_seconds;
+  const double dt4 = dt3 * delta_seconds;
+  Covariance process_noise = Covariance::Zero();
+  for (int i = 0; i < measurement_size_; ++i) {
+    const double noise = i == yaw_id_ ? process_noise_yaw_acceleration_ : process_noise_acceleration_;
+    const double variance = noise * noise;
+    process_noise(i, i) = dt4 / 4 * variance;
+    process_noise(i, i + measurement_size_) = dt3 / 2 * variance;
+    process_noise(i + measurement_size_, i) = dt3 / 2 * variance;
+    process_noise(i + measurement_size_, i + measurement_size_) = dt2 * variance;
+  }
+
+  *state = transition * *state;
+  (*state)(yaw_id_) = wrap_angle((*state)(yaw_id_));
+  *covariance = transition * *covariance * transition.transpose() + process_noise;
+}
+
+FilteredPose PoseFilter::to_pose(double timestamp_seconds, const State &state, const Covariance &covariance) const {
+  FilteredPose pose;
+  pose.timestamp_seconds = timestamp_seconds;
+  pose.position = state.head<3>();
+  pose.yaw_radians = state(yaw_id_);
+  pose.velocity = state.segment<3>(measurement_size_);
+  pose.yaw_rate_radians_per_second = state(yaw_id_ + measurement_size_);
+  pose.position_standard_deviation_meter = std::sqrt(covariance.topLeftCorner<3, 3>().trace());
+  pose.valid = true;
+  return pose;
+}
+
+double PoseFilter::wrap_angle(double angle_radians) {
+  return std::atan2(std::sin(angle_radians), std::cos(angle_radians));
+}
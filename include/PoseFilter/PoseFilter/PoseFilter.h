@@ -0,0 +1,80 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_POSEFILTER_POSEFILTER_POSEFILTER_H_
+#define INCLUDE_POSEFILTER_POSEFILTER_POSEFILTER_H_
+
+#include <cstdint>
+#include <mutex>
+
+#include <Eigen/Core>
+
+struct FilteredPose {
+  double timestamp_seconds = 0;
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();  //! Camera frame, meter.
+  double yaw_radians = 0;  //! Rotation of the pallet face about the camera y axis.
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  double yaw_rate_radians_per_second = 0;
+  double position_standard_deviation_meter = 0;
+  bool valid = false;
+};
+
+//! Constant velocity Kalman filter over position and yaw with Mahalanobis gating of the measurements. The vision
+//! loop feeds it, and any thread can read the latest pose or extrapolate it to a future timestamp.
+class PoseFilter {
+ public:
+  void set_filter_settings(double process_noise_acceleration,
+                           double process_noise_yaw_acceleration,
+                           double measurement_noise_position_meter,
+                           double measurement_noise_yaw_radians,
+                           double gate_threshold,
+                           uint16_t maximum_consecutive_rejections,
+                           double maximum_prediction_horizon_seconds);
+
+  //! Returns false if the measurement was rejected by the gate or repeats the timestamp of the last update. After too
+  //! many rejections in a row the filter is restarted from the next measurement, so a real jump is followed instead
+  //! of being gated forever. Only a timestamp that goes back restarts it too.
+  bool update(double timestamp_seconds, const Eigen::Vector3d &position, double yaw_radians);
+
+  FilteredPose get_pose() const;
+
+  //! Extrapolated pose at timestamp_seconds, in the time base of the measurements. Clamped to the prediction horizon.
+  FilteredPose predict(double timestamp_seconds) const;
+
+  void reset();
+
+ private:
+  static constexpr int state_size_ = 8;  //! x, y, z, yaw, vx, vy, vz, yaw rate.
+  static constexpr int measurement_size_ = 4;  //! x, y, z, yaw.
+  static constexpr int yaw_id_ = 3;
+  static constexpr double initial_velocity_variance_ = 1;  // TODO(simon) Magic number.
+
+  using State = Eigen::Matrix<double, state_size_, 1>;
+  using Covariance = Eigen::Matrix<double, state_size_, state_size_>;
+  using Measurement = Eigen::Matrix<double, measurement_size_, 1>;
+
+  void initialize(double timestamp_seconds, const Measurement &measurement);
+
+  void predict_state(double delta_seconds, State *state, Covariance *covariance) const;
+
+  FilteredPose to_pose(double timestamp_seconds, const State &state, const Covariance &covariance) const;
+
+  static double wrap_angle(double angle_radians);
+
+  double process_noise_acceleration_ = 0.5;
+  double process_noise_yaw_acceleration_ = 0.5;
+  double measurement_noise_position_meter_ = 0.02;
+  double measurement_noise_yaw_radians_ = 0.05;
+  double gate_threshold_ = 13.28;  //! Chi-square, 4 degrees of freedom, 99 %.
+  uint16_t maximum_consecutive_rejections_ = 5;
+  double maximum_prediction_horizon_seconds_ = 0.5;
+
+  mutable std::mutex mutex_;
+  bool is_initialized_ = false;
+  double timestamp_seconds_ = 0;
+  State state_ = State::Zero();
+  Covariance covariance_ = Covariance::Identity();
+  uint16_t consecutive_rejections_ = 0;
+};
+
+#endif  // INCLUDE_POSEFILTER_POSEFILTER_POSEFILTER_H_
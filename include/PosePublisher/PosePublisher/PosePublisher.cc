@@ -0,0 +1,123 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "PosePublisher/PosePublisher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+PosePublisher::~PosePublisher() {
+  shutdown();
+}
+
+void PosePublisher::setup_pose_publisher() {
+  if (dispatcher_.joinable()) {
+    return;
+  }
+  stop_ = false;
+  dispatcher_ = std::thread(&PosePublisher::dispatcher_loop, this);
+}
+
+void PosePublisher::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(dispatch_mutex_);
+    stop_ = true;
+  }
+  dispatch_condition_.notify_all();
+  if (dispatcher_.joinable()) {
+    dispatcher_.join();
+  }
+}
+
+void PosePublisher::publish(const PoseResult &result) {
+  uint64_t words[number_of_words_] = {};
+  std::memcpy(words, &result, sizeof(PoseResult));
+
+  const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < number_of_words_; ++i) {
+    words_[i].store(words[i], std::memory_order_relaxed);
+  }
+  sequence_.store(sequence + 2, std::memory_order_release);
+
+  { std::lock_guard<std::mutex> lock(dispatch_mutex_); }  //! Orders the notify after a waiting dispatcher's check.
+  dispatch_condition_.notify_one();
+}
+
+bool PosePublisher::read_latest(PoseResult *result) const {
+  uint64_t words[number_of_words_];
+  uint64_t sequence_before;
+  uint64_t sequence_after;
+
+  do {
+    sequence_before = sequence_.load(std::memory_order_acquire);
+    if (sequence_before & 1) {
+      continue;  //! The writer only holds the odd sequence for a few stores.
+    }
+    for (size_t i = 0; i < number_of_words_; ++i) {
+      words[i] = words_[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    sequence_after = sequence_.load(std::memory_order_relaxed);
+  } while ((sequence_before & 1) || sequence_before != sequence_after);
+
+  if (sequence_before == 0) {
+    return false;
+  }
+  std::memcpy(result, words, sizeof(PoseResult));
+  return true;
+}
+
+uint64_t PosePublisher::get_sequence() const {
+  return sequence_.load(std::memory_order_acquire) / 2;
+}
+
+int PosePublisher::register_callback(Callback callback) {
+  std::lock_guard<std::mutex> lock(callbacks_mutex_);
+  auto registered_callback = std::make_shared<RegisteredCallback>();
+  registered_callback->id = next_callback_id_++;
+  registered_callback->callback = std::move(callback);
+  callbacks_.emplace_back(std::move(registered_callback));
+  return callbacks_.back()->id;
+}
+
+void PosePublisher::unregister_callback(int callback_id) {
+  std::lock_guard<std::mutex> lock(callbacks_mutex_);
+  callbacks_.erase(std::remove_if(callbacks_.begin(), callbacks_.end(),
+                                  [callback_id](const std::shared_ptr<const RegisteredCallback> &registered_callback) {
+                                    return registered_callback->id == callback_id;
+                                  }),
+                   callbacks_.end());
+}
+
+void PosePublisher::dispatcher_loop() {
+  uint64_t dispatched_sequence = get_sequence();
+  std::vector<std::shared_ptr<const RegisteredCallback>> callbacks;
+  PoseResult result;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(dispatch_mutex_);
+      dispatch_condition_.wait(lock, [this, dispatched_sequence]() {
+        return stop_ || get_sequence() != dispatched_sequence;
+      });
+      if (stop_) {
+        return;
+      }
+    }
+
+    dispatched_sequence = get_sequence();
+    if (!read_latest(&result)) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(callbacks_mutex_);
+      callbacks = callbacks_;  //! Callbacks may register or unregister from inside a call.
+    }
+    for (const auto &registered_callback : callbacks) {
+      registered_callback->callback(result);
+    }
+  }
+}
@@ -0,0 +1,93 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_POSEPUBLISHER_POSEPUBLISHER_POSEPUBLISHER_H_
+#define INCLUDE_POSEPUBLISHER_POSEPUBLISHER_POSEPUBLISHER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//! Result of one frame. Plain data, so it can be copied word by word through the seqlock.
+struct PoseResult {
+  double timestamp_seconds = 0;  //! Color frame timestamp.
+  double sensor_time_seconds = 0;  //! Exposure of the older of color and depth, system clock. 0 when unmapped.
+  uint64_t frame_number = 0;
+  uint8_t timestamp_mapping = 0;  //! TimestampMapping of sensor_time_seconds.
+  float latency_seconds = 0;  //! From sensor_time_seconds to publishing, host side only when unmapped.
+  uint16_t source_id = 0;  //! Camera in settings.sources.
+  bool valid = false;  //! A pose vector was found in this frame.
+  bool filtered_valid = false;
+  float position[3] = {0, 0, 0};  //! Pallet face center in the camera frame, meter.
+  float direction[3] = {0, 0, 0};  //! Pose vector, pallet face normal.
+  float yaw_radians = 0;
+  float filtered_position[3] = {0, 0, 0};
+  float filtered_yaw_radians = 0;
+  float detection_confidence = 0;
+  float pose_confidence = 0;  //! From the pose quality stage, 0 when no planes were fitted.
+  uint32_t roi_points = 0;
+  float ground_inlier_ratio = 0;
+  float face_inlier_ratio = 0;
+  float face_residual_rms_meter = 0;
+  float plane_angle_radians = 0;  //! Between the ground and face planes.
+};
+
+//! Latest-value publisher for in-process consumers. The vision thread writes with a seqlock and never waits for
+//! readers; readers poll without locks and retry only while a write is in progress. Registered callbacks are run
+//! on a dispatcher thread of their own, not the thread pool, so a slow callback can not hold up a parallel_for of
+//! the vision thread. Results published while the callbacks are busy are coalesced, only the latest is delivered.
+class PosePublisher {
+ public:
+  using Callback = std::function<void(const PoseResult &)>;
+
+  ~PosePublisher();
+
+  void setup_pose_publisher();
+
+  void shutdown();
+
+  //! Called by the vision thread only.
+  void publish(const PoseResult &result);
+
+  //! Copies the latest result. Returns false if nothing has been published yet.
+  bool read_latest(PoseResult *result) const;
+
+  //! Increases with every publish, a reader can poll this to see if there is a new result.
+  uint64_t get_sequence() const;
+
+  int register_callback(Callback callback);
+
+  void unregister_callback(int callback_id);
+
+ private:
+  static_assert(std::is_trivially_copyable_v<PoseResult>, "PoseResult is copied word by word");
+
+  static constexpr size_t number_of_words_ = (sizeof(PoseResult) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  struct RegisteredCallback {
+    int id;
+    Callback callback;
+  };
+
+  void dispatcher_loop();
+
+  alignas(64) std::atomic<uint64_t> sequence_{0};  //! Odd while a write is in progress.
+  std::atomic<uint64_t> words_[number_of_words_] = {};
+
+  std::mutex callbacks_mutex_;
+  std::vector<std::shared_ptr<const RegisteredCallback>> callbacks_;
+  int next_callback_id_ = 0;
+
+  std::thread dispatcher_;
+  std::mutex dispatch_mutex_;
+  std::condition_variable dispatch_condition_;
+  bool stop_ = false;
+};
+
+#endif  // INCLUDE_POSEPUBLISHER_POSEPUBLISHER_POSEPUBLISHER_H_
@@ -0,0 +1,84 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "PoseQuality/PoseQuality.h"
+
+#include <algorithm>
+#include <cmath>
+
+void PoseQuality::set_quality_settings(double distance_threshold_meter,
+                                       uint32_t full_confidence_roi_points,
+                                       double maximum_plane_angle_deviation_radians) {
+  distance_threshold_meter_ = distance_threshold_meter;
+  full_confidence_roi_points_ = full_confidence_roi_points;
+  maximum_plane_angle_deviation_radians_ = maximum_plane_angle_deviation_radians;
+}
+
+PoseQualityMetrics PoseQuality::evaluate(const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                                         const std::vector<float> &ground_coefficients,
+                                         const std::vector<float> &face_coefficients) const {
+  PoseQualityMetrics metrics;
+  metrics.roi_points = static_cast<uint32_t>(cloud.size());
+
+  Eigen::Vector4f ground_plane;
+  Eigen::Vector4f face_plane;
+  if (cloud.empty() || !to_unit_plane(ground_coefficients, &ground_plane)
+      || !to_unit_plane(face_coefficients, &face_plane)) {
+    return metrics;
+  }
+
+  const float distance_threshold = static_cast<float>(distance_threshold_meter_);
+  uint32_t ground_inliers = 0;
+  uint32_t face_inliers = 0;
+  double ground_squared_residuals = 0;
+  double face_squared_residuals = 0;
+  //! A point on both planes, along the line where the face meets the floor, is counted as ground.
+  for (const pcl::PointXYZ &point : cloud.points) {
+    const Eigen::Vector4f homogeneous_point(point.x, point.y, point.z, 1);
+    const float ground_distance = std::abs(ground_plane.dot(homogeneous_point));
+    const float face_distance = std::abs(face_plane.dot(homogeneous_point));
+    if (ground_distance < distance_threshold) {
+      ++ground_inliers;
+      ground_squared_residuals += ground_distance * ground_distance;
+    } else if (face_distance < distance_threshold) {
+      ++face_inliers;
+      face_squared_residuals += face_distance * face_distance;
+    }
+  }
+
+  const uint32_t non_ground_points = metrics.roi_points - ground_inliers;
+  metrics.ground_inlier_ratio = static_cast<float>(ground_inliers) / metrics.roi_points;
+  metrics.face_inlier_ratio = non_ground_points > 0 ? static_cast<float>(face_inliers) / non_ground_points : 0;
+  metrics.ground_residual_rms_meter =
+      ground_inliers > 0 ? static_cast<float>(std::sqrt(ground_squared_residuals / ground_inliers)) : 0;
+  metrics.face_residual_rms_meter =
+      face_inliers > 0 ? static_cast<float>(std::sqrt(face_squared_residuals / face_inliers)) : 0;
+  metrics.plane_angle_radians =
+      std::acos(std::clamp(std::abs(ground_plane.head<3>().dot(face_plane.head<3>())), 0.0f, 1.0f));
+
+  if (face_inliers == 0) {
+    return metrics;
+  }
+
+  const float roi_points_score =
+      std::min(1.0f, static_cast<float>(metrics.roi_points) / std::max<uint32_t>(full_confidence_roi_points_, 1));
+  const float explained_points_score = static_cast<float>(ground_inliers + face_inliers) / metrics.roi_points;
+  const float face_residual_score = std::max(0.0f, 1 - metrics.face_residual_rms_meter / distance_threshold);
+  const float plane_angle_score = std::max(0.0f, 1 - std::abs(metrics.plane_angle_radians - static_cast<float>(M_PI_2))
+      / static_cast<float>(maximum_plane_angle_deviation_radians_));
+  metrics.confidence = roi_points_score * explained_points_score * face_residual_score * plane_angle_score;
+  return metrics;
+}
+
+bool PoseQuality::to_unit_plane(const std::vector<float> &coefficients, Eigen::Vector4f *plane) {
+  if (coefficients.size() < number_of_plane_coefficients_) {
+    return false;
+  }
+  *plane = Eigen::Vector4f(coefficients.at(0), coefficients.at(1), coefficients.at(2), coefficients.at(3));  // TODO(simon) Magic number.
+  const float normal_length = plane->head<3>().norm();
+  if (normal_length < minimum_normal_length_) {
+    return false;
+  }
+  *plane /= normal_length;
+  return true;
+}
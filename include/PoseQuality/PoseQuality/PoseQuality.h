@@ -0,0 +1,53 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_POSEQUALITY_POSEQUALITY_POSEQUALITY_H_
+#define INCLUDE_POSEQUALITY_POSEQUALITY_POSEQUALITY_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+//! Fit quality of one pose. All zero when no pose was estimated.
+struct PoseQualityMetrics {
+  uint32_t roi_points = 0;  //! Points left in the pallet ROI after the crop.
+  float ground_inlier_ratio = 0;  //! Of the ROI points.
+  float face_inlier_ratio = 0;  //! Of the ROI points that are not on the ground plane.
+  float ground_residual_rms_meter = 0;  //! Over the ground inliers.
+  float face_residual_rms_meter = 0;  //! Over the face inliers.
+  float plane_angle_radians = 0;  //! Between the ground and face normals, pi / 2 for an upright pallet face.
+  float confidence = 0;  //! 0 to 1.
+};
+
+//! Scores the ground and face planes of a pose against the ROI cloud they were fitted to. The face is the pallet face
+//! whose normal gives the pose direction, the plane PalletFaceSolver writes. One pass over the cloud, no allocations,
+//! so it runs on every frame. The confidence is the product of four scores in [0, 1]: the ROI point count relative to
+//! full_confidence_roi_points, the fraction of ROI points explained by either plane, the face RMS relative to the
+//! distance threshold, and the deviation of the plane angle from pi / 2.
+class PoseQuality {
+ public:
+  void set_quality_settings(double distance_threshold_meter,
+                            uint32_t full_confidence_roi_points,
+                            double maximum_plane_angle_deviation_radians);
+
+  PoseQualityMetrics evaluate(const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                              const std::vector<float> &ground_coefficients,
+                              const std::vector<float> &face_coefficients) const;
+
+ private:
+  //! Plane (a, b, c, d) scaled to a unit normal. Returns false if there are too few coefficients or no normal.
+  static bool to_unit_plane(const std::vector<float> &coefficients, Eigen::Vector4f *plane);
+
+  static constexpr uint8_t number_of_plane_coefficients_ = 4;
+  static constexpr float minimum_normal_length_ = 1e-6;
+
+  double distance_threshold_meter_ = 0.02;
+  uint32_t full_confidence_roi_points_ = 500;
+  double maximum_plane_angle_deviation_radians_ = 0.35;
+};
+
+#endif  // INCLUDE_POSEQUALITY_POSEQUALITY_POSEQUALITY_H_
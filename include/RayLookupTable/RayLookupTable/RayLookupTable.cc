@@ -0,0 +1,78 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "RayLookupTable/RayLookupTable.h"
+
+#include <Eigen/Core>
+
+#include <iostream>
+
+bool RayLookupTable::update(const rs2_intrinsics &intrinsics) {
+  if (!is_empty() && same_intrinsics(intrinsics, intrinsics_)) {
+    return false;
+  }
+  intrinsics_ = intrinsics;
+
+  const size_t number_of_pixels = static_cast<size_t>(intrinsics.width) * intrinsics.height;
+  ray_x_.resize(number_of_pixels);
+  ray_y_.resize(number_of_pixels);
+
+  for (int v = 0; v < intrinsics.height; ++v) {
+    for (int u = 0; u < intrinsics.width; ++u) {
+      const float pixel[2] = {static_cast<float>(u), static_cast<float>(v)};
+      float ray[3];
+      rs2_deproject_pixel_to_point(ray, &intrinsics_, pixel, 1.0f);
+
+      const size_t index = static_cast<size_t>(v) * intrinsics.width + u;
+      ray_x_[index] = ray[0];
+      ray_y_[index] = ray[1];
+    }
+  }
+
+  std::cout << "Ray lookup table built: " << intrinsics.width << "x" << intrinsics.height << std::endl;
+  return true;
+}
+
+void RayLookupTable::back_project(const uint16_t *depth,
+                                  float depth_units,
+                                  size_t begin,
+                                  size_t end,
+                                  float *x,
+                                  float *y,
+                                  float *z) const {
+  const Eigen::Index length = static_cast<Eigen::Index>(end - begin);
+
+  Eigen::Map<Eigen::ArrayXf> z_out(z, length);
+  Eigen::Map<Eigen::ArrayXf> x_out(x, length);
+  Eigen::Map<Eigen::ArrayXf> y_out(y, length);
+
+  z_out = Eigen::Map<const Eigen::Array<uint16_t, Eigen::Dynamic, 1>>(depth + begin, length).cast<float>()
+      * depth_units;
+  x_out = z_out * Eigen::Map<const Eigen::ArrayXf>(ray_x_.data() + begin, length);
+  y_out = z_out * Eigen::Map<const Eigen::ArrayXf>(ray_y_.data() + begin, length);
+}
+
+int RayLookupTable::get_width() const {
+  return intrinsics_.width;
+}
+
+int RayLookupTable::get_height() const {
+  return intrinsics_.height;
+}
+
+bool RayLookupTable::is_empty() const {
+  return ray_x_.empty();
+}
+
+bool RayLookupTable::same_intrinsics(const rs2_intrinsics &a, const rs2_intrinsics &b) {
+  if (a.width != b.width || a.height != b.height || a.model != b.model || a.fx != b.fx || a.fy != b.fy
+      || a.ppx != b.ppx || a.ppy != b.ppy) {
+    return false;
+  }
+  for (int i = 0; i < 5; ++i) {  // TODO(simon) Magic number.
+    if (a.coeffs[i] != b.coeffs[i]) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,69 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_RAYLOOKUPTABLE_RAYLOOKUPTABLE_RAYLOOKUPTABLE_H_
+#define INCLUDE_RAYLOOKUPTABLE_RAYLOOKUPTABLE_RAYLOOKUPTABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "librealsense2/rs.hpp"
+#include "librealsense2/rsutil.h"
+
+template<typename T>
+struct CacheAlignedAllocator {
+  using value_type = T;
+  static constexpr std::size_t alignment_bytes = 64;
+
+  CacheAlignedAllocator() = default;
+  template<typename U>
+  CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}  // NOLINT(runtime/explicit)
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignment_bytes)));
+  }
+  void deallocate(T *pointer, std::size_t) {
+    ::operator delete(pointer, std::align_val_t(alignment_bytes));
+  }
+
+  template<typename U>
+  bool operator==(const CacheAlignedAllocator<U> &) const { return true; }
+  template<typename U>
+  bool operator!=(const CacheAlignedAllocator<U> &) const { return false; }
+};
+
+using CacheAlignedFloatBuffer = std::vector<float, CacheAlignedAllocator<float>>;
+
+//! Unit depth ray (x/z, y/z) for every pixel of a stream, distortion included. Stored as two cache aligned planes,
+//! so back-projection of a pixel span is depth times ray with no per pixel pinhole math.
+class RayLookupTable {
+ public:
+  //! Rebuilds the table only if the intrinsics differ from the ones it was built for. Returns true on rebuild.
+  bool update(const rs2_intrinsics &intrinsics);
+
+  //! x, y and z in meter for the pixels [begin, end) in row-major order. Zero depth gives the point (0, 0, 0).
+  void back_project(const uint16_t *depth,
+                    float depth_units,
+                    size_t begin,
+                    size_t end,
+                    float *x,
+                    float *y,
+                    float *z) const;
+
+  int get_width() const;
+
+  int get_height() const;
+
+  bool is_empty() const;
+
+ private:
+  static bool same_intrinsics(const rs2_intrinsics &a, const rs2_intrinsics &b);
+
+  rs2_intrinsics intrinsics_{};
+  CacheAlignedFloatBuffer ray_x_;
+  CacheAlignedFloatBuffer ray_y_;
+};
+
+#endif  // INCLUDE_RAYLOOKUPTABLE_RAYLOOKUPTABLE_RAYLOOKUPTABLE_H_
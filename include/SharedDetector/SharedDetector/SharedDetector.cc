@@ -0,0 +1,106 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "SharedDetector/SharedDetector.h"
+
+#include <algorithm>
+
+SharedDetector::~SharedDetector() {
+  shutdown();
+}
+
+void SharedDetector::setup_shared_detector(ObjectDetection *object_detection,
+                                           uint16_t number_of_sources,
+                                           uint32_t batch_timeout_ms) {
+  if (detector_.joinable()) {
+    return;
+  }
+  object_detection_ = object_detection;
+  batch_timeout_ = std::chrono::milliseconds(batch_timeout_ms);
+  sources_.assign(number_of_sources, Source());
+  batch_images_.reserve(number_of_sources);
+  batch_source_ids_.reserve(number_of_sources);
+
+  stop_ = false;
+  detector_ = std::thread(&SharedDetector::detector_loop, this);
+}
+
+void SharedDetector::run_object_detection(uint16_t source_id, cv::Mat &image) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Source &source = sources_.at(source_id);
+  source.image = &image;
+  source.pending = true;
+  frame_condition_.notify_one();
+  batch_condition_.wait(lock, [this, &source]() { return stop_ || !source.pending; });
+}
+
+object_detection_output SharedDetector::get_detection(uint16_t source_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sources_.at(source_id).detection;
+}
+
+void SharedDetector::set_object_detection_settings(float nms_threshold, float bbox_conf_threshold) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  nms_threshold_ = nms_threshold;
+  bbox_conf_threshold_ = bbox_conf_threshold;
+  has_settings_ = true;
+}
+
+void SharedDetector::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  frame_condition_.notify_all();
+  batch_condition_.notify_all();
+  if (detector_.joinable()) {
+    detector_.join();
+  }
+}
+
+void SharedDetector::detector_loop() {
+  auto number_of_pending = [this]() {
+    return static_cast<size_t>(std::count_if(sources_.begin(), sources_.end(),
+                                             [](const Source &source) { return source.pending; }));
+  };
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    frame_condition_.wait(lock, [this, &number_of_pending]() { return stop_ || number_of_pending() > 0; });
+    if (stop_) {
+      return;
+    }
+    //! First frame of a batch, give the other cameras until the timeout to join.
+    frame_condition_.wait_for(lock, batch_timeout_, [this, &number_of_pending]() {
+      return stop_ || number_of_pending() == sources_.size();
+    });
+    if (stop_) {
+      return;
+    }
+
+    batch_images_.clear();
+    batch_source_ids_.clear();
+    for (uint16_t source_id = 0; source_id < sources_.size(); ++source_id) {
+      if (sources_.at(source_id).pending) {
+        batch_images_.emplace_back(sources_.at(source_id).image);
+        batch_source_ids_.emplace_back(source_id);
+      }
+    }
+    if (has_settings_) {
+      object_detection_->set_object_detection_settings(nms_threshold_, bbox_conf_threshold_);
+    }
+
+    //! The images belong to camera threads that are blocked until pending is cleared, so they can be used unlocked.
+    lock.unlock();
+    object_detection_->run_object_detection_batch(batch_images_);
+    lock.lock();
+
+    for (size_t i = 0; i < batch_source_ids_.size(); ++i) {
+      Source &source = sources_.at(batch_source_ids_.at(i));
+      source.detection = object_detection_->get_detection(i);
+      source.image = nullptr;
+      source.pending = false;
+    }
+    batch_condition_.notify_all();
+  }
+}
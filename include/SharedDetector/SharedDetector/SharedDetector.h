@@ -0,0 +1,65 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_SHAREDDETECTOR_SHAREDDETECTOR_SHAREDDETECTOR_H_
+#define INCLUDE_SHAREDDETECTOR_SHAREDDETECTOR_SHAREDDETECTOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+
+#include "ObjectDetection/ObjectDetection.h"
+
+//! One object detection network shared by several cameras. Every camera thread hands in its frame and blocks; the
+//! detector thread waits until all cameras have a frame, or until batch_timeout_ms after the first one, and runs
+//! them as one batch. A slow or stalled camera therefore delays the others by at most the timeout.
+class SharedDetector {
+ public:
+  ~SharedDetector();
+
+  //! The detector must already be set up with a batch size of at least number_of_sources.
+  void setup_shared_detector(ObjectDetection *object_detection, uint16_t number_of_sources, uint32_t batch_timeout_ms);
+
+  //! Blocks until the batch with this image is done. Detections are drawn on the image.
+  void run_object_detection(uint16_t source_id, cv::Mat &image);
+
+  //! Selected detection of the last batch this source was part of.
+  object_detection_output get_detection(uint16_t source_id);
+
+  //! Applied to the next batch. Every camera calls it with its snapshot, the last call wins.
+  void set_object_detection_settings(float nms_threshold, float bbox_conf_threshold);
+
+  void shutdown();
+
+ private:
+  struct Source {
+    cv::Mat *image = nullptr;  //! Set while the camera thread waits for the batch.
+    bool pending = false;
+    object_detection_output detection{1, 1, 1, 1, 1.0};  //! Same as ObjectDetection's non detection.
+  };
+
+  void detector_loop();
+
+  ObjectDetection *object_detection_ = nullptr;
+  std::chrono::milliseconds batch_timeout_{0};
+  float nms_threshold_ = 0;
+  float bbox_conf_threshold_ = 0;
+  bool has_settings_ = false;
+
+  std::vector<Source> sources_;
+  std::vector<cv::Mat *> batch_images_;
+  std::vector<uint16_t> batch_source_ids_;
+
+  std::thread detector_;
+  std::mutex mutex_;
+  std::condition_variable frame_condition_;  //! A camera handed in a frame.
+  std::condition_variable batch_condition_;  //! A batch is done.
+  bool stop_ = false;
+};
+
+#endif  // INCLUDE_SHAREDDETECTOR_SHAREDDETECTOR_SHAREDDETECTOR_H_
@@ -0,0 +1,186 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#include "ThreadPool/ThreadPool.h"
+
+#include <algorithm>
+#include <iostream>
+
+thread_local int ThreadPool::worker_id_ = ThreadPool::not_a_worker_;
+thread_local const ThreadPool *ThreadPool::worker_owner_ = nullptr;
+
+ThreadPool::~ThreadPool() {
+  shutdown();
+}
+
+void ThreadPool::setup_thread_pool(uint16_t number_of_threads,
+                                   bool pin_threads,
+                                   const std::vector<int> &core_ids) {
+  shutdown();
+  stop_ = false;
+
+  if (number_of_threads == 0) {
+    number_of_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  queues_.clear();
+  for (uint16_t i = 0; i < number_of_threads; ++i) {
+    queues_.emplace_back(std::make_unique<WorkerQueue>());
+  }
+
+  for (uint16_t i = 0; i < number_of_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    if (pin_threads) {
+      int core_id = core_ids.empty() ? i : core_ids.at(i % core_ids.size());
+      pin_thread_to_core(&workers_.back(), core_id);
+    }
+  }
+}
+
+void ThreadPool::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stop_ = true;
+  }
+  wake_condition_.notify_all();
+
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+}
+
+void ThreadPool::parallel_for(size_t begin,
+                              size_t end,
+                              size_t minimum_chunk_size,
+                              const std::function<void(size_t, size_t)> &body) {
+  if (begin >= end) {
+    return;
+  }
+
+  const size_t range = end - begin;
+  const size_t chunk_size = std::max<size_t>(std::max<size_t>(minimum_chunk_size, 1),
+                                             (range + workers_.size()) / (workers_.size() + 1));
+  const size_t number_of_chunks = (range + chunk_size - 1) / chunk_size;
+
+  if (workers_.empty() || number_of_chunks == 1) {
+    body(begin, end);
+    return;
+  }
+
+  std::atomic<size_t> remaining_chunks(number_of_chunks - 1);
+  for (size_t chunk = 1; chunk < number_of_chunks; ++chunk) {
+    const size_t chunk_begin = begin + chunk * chunk_size;
+    const size_t chunk_end = std::min(end, chunk_begin + chunk_size);
+    push_task([&body, &remaining_chunks, chunk_begin, chunk_end]() {
+      body(chunk_begin, chunk_end);
+      remaining_chunks.fetch_sub(1, std::memory_order_release);
+    });
+  }
+
+  body(begin, std::min(end, begin + chunk_size));
+
+  while (remaining_chunks.load(std::memory_order_acquire) > 0) {
+    if (!try_run_pending_task()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+uint16_t ThreadPool::get_number_of_threads() const {
+  return workers_.size();
+}
+
+void ThreadPool::worker_loop(size_t worker_id) {
+  worker_id_ = static_cast<int>(worker_id);
+  worker_owner_ = this;
+  std::function<void()> task;
+
+  while (true) {
+    if (pop_task(worker_id, &task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_condition_.wait(lock, [this]() { return stop_ || pending_tasks_ > 0; });
+    if (stop_ && pending_tasks_ == 0) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::push_task(std::function<void()> task) {
+  const int own_worker_id = get_own_worker_id();
+  size_t queue_id = own_worker_id != not_a_worker_
+                    ? static_cast<size_t>(own_worker_id)
+                    : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+  //! Counted before it is queued, otherwise a worker can pop it first and wrap the counter below zero.
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    pending_tasks_++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues_.at(queue_id)->mutex);
+    queues_.at(queue_id)->tasks.emplace_back(std::move(task));
+  }
+  wake_condition_.notify_one();
+}
+
+bool ThreadPool::pop_task(size_t worker_id, std::function<void()> *task) {
+  if (pending_tasks_ == 0) {
+    return false;
+  }
+
+  {  //! Own queue, newest first.
+    WorkerQueue &own_queue = *queues_.at(worker_id);
+    std::lock_guard<std::mutex> lock(own_queue.mutex);
+    if (!own_queue.tasks.empty()) {
+      *task = std::move(own_queue.tasks.back());
+      own_queue.tasks.pop_back();
+      pending_tasks_--;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < queues_.size(); ++i) {  //! Steal the oldest task from the others.
+    WorkerQueue &victim_queue = *queues_.at((worker_id + i) % queues_.size());
+    std::lock_guard<std::mutex> lock(victim_queue.mutex);
+    if (!victim_queue.tasks.empty()) {
+      *task = std::move(victim_queue.tasks.front());
+      victim_queue.tasks.pop_front();
+      pending_tasks_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::try_run_pending_task() {
+  std::function<void()> task;
+  const int own_worker_id = get_own_worker_id();
+  size_t start_queue = own_worker_id != not_a_worker_ ? static_cast<size_t>(own_worker_id) : 0;
+
+  if (!pop_task(start_queue, &task)) {
+    return false;
+  }
+  task();
+  return true;
+}
+
+int ThreadPool::get_own_worker_id() const {
+  return worker_owner_ == this ? worker_id_ : not_a_worker_;
+}
+
+void ThreadPool::pin_thread_to_core(std::thread *thread, int core_id) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(core_id, &cpu_set);
+
+  if (pthread_setaffinity_np(thread->native_handle(), sizeof(cpu_set_t), &cpu_set) != 0) {
+    std::cerr << "Could not pin thread pool worker to core " << core_id << std::endl;
+  }
+}
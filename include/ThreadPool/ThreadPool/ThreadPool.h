@@ -0,0 +1,97 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+#ifndef INCLUDE_THREADPOOL_THREADPOOL_THREADPOOL_H_
+#define INCLUDE_THREADPOOL_THREADPOOL_THREADPOOL_H_
+
+#include <pthread.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//! Work-stealing thread pool owned by the application. Every worker has its own task queue; idle workers
+//! steal from the front of the other queues. Threads waiting on a parallel_for help executing tasks, so
+//! nested submissions never deadlock.
+class ThreadPool {
+ public:
+  ~ThreadPool();
+
+  void setup_thread_pool(uint16_t number_of_threads,
+                         bool pin_threads,
+                         const std::vector<int> &core_ids);
+
+  void shutdown();
+
+  template<typename Function>
+  std::future<std::invoke_result_t<Function>> submit(Function &&function);
+
+  //! Splits [begin, end) into chunks of at least minimum_chunk_size and runs body(chunk_begin, chunk_end)
+  //! on the pool. The calling thread takes part and returns when every chunk is done.
+  void parallel_for(size_t begin,
+                    size_t end,
+                    size_t minimum_chunk_size,
+                    const std::function<void(size_t, size_t)> &body);
+
+  uint16_t get_number_of_threads() const;
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void worker_loop(size_t worker_id);
+
+  void push_task(std::function<void()> task);
+
+  bool pop_task(size_t worker_id, std::function<void()> *task);
+
+  bool try_run_pending_task();
+
+  //! Queue of the calling thread if it is a worker of this pool, not_a_worker_ for any other thread, including the
+  //! workers of another pool.
+  int get_own_worker_id() const;
+
+  static void pin_thread_to_core(std::thread *thread, int core_id);
+
+  static constexpr int not_a_worker_ = -1;
+  static thread_local int worker_id_;
+  static thread_local const ThreadPool *worker_owner_;  //! Pool of worker_id_, every camera has its own pool.
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_condition_;
+  std::atomic<size_t> pending_tasks_{0};
+  std::atomic<size_t> next_queue_{0};
+  std::atomic<bool> stop_{false};
+};
+
+template<typename Function>
+std::future<std::invoke_result_t<Function>> ThreadPool::submit(Function &&function) {
+  using result_type = std::invoke_result_t<Function>;
+
+  auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Function>(function));
+  std::future<result_type> result = task->get_future();
+
+  if (workers_.empty()) {  //! Pool not set up, run inline.
+    (*task)();
+    return result;
+  }
+
+  push_task([task]() { (*task)(); });
+  return result;
+}
+
+#endif  // INCLUDE_THREADPOOL_THREADPOOL_THREADPOOL_H_
@@ -0,0 +1,175 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Reads a frame recorder capture. The header and the record of every frame are printed, and with a frame index
+//! the color image of that frame is written as a PPM file and the depth image as a 16 bit PGM file, both readable
+//! by any image viewer.
+//!
+//! Usage: capture_reader <capture.bin> [frame_index output_prefix]
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "FrameRecorder/CaptureLayout.h"
+
+namespace {
+
+//! rs2_format values, the layout only depends on the standard library.
+constexpr uint32_t format_z16 = 1;
+constexpr uint32_t format_rgb8 = 5;
+constexpr uint32_t format_bgr8 = 6;
+constexpr float milliseconds_per_second = 1000;
+
+const char *trigger_reason_name(uint32_t trigger_reason) {
+  switch (trigger_reason) {
+    case capture::kApi:
+      return "api";
+    case capture::kSignal:
+      return "signal";
+    case capture::kPoseQuality:
+      return "pose quality";
+    default:
+      return "unknown";
+  }
+}
+
+void print_stream(const char *name, const capture::StreamInfo &stream) {
+  std::cout << name << ": " << stream.width << "x" << stream.height << " format " << stream.format << " "
+            << stream.fps << " fps, fx " << stream.fx << " fy " << stream.fy << " ppx " << stream.ppx << " ppy "
+            << stream.ppy << std::endl;
+}
+
+void print_record(uint32_t index, const capture::FrameRecord &record) {
+  std::cout << index << ": frame " << record.frame_number << " t " << record.color_timestamp_seconds
+            << " detection " << record.detection_box[0] << " " << record.detection_box[1] << " "
+            << record.detection_box[2] << "x" << record.detection_box[3] << " conf " << record.detection_confidence;
+  if (record.flags & capture::kPoseValid) {
+    std::cout << " pose " << record.position[0] << " " << record.position[1] << " " << record.position[2]
+              << " yaw " << record.yaw_radians << " pose conf " << record.pose_confidence;
+  } else {
+    std::cout << " no pose";
+  }
+  std::cout << " roi " << record.roi_points << " latency " << record.latency_seconds * milliseconds_per_second
+            << " ms" << std::endl;
+}
+
+bool write_color(const std::string &path, const capture::StreamInfo &stream, const uint8_t *image) {
+  if (stream.format != format_rgb8 && stream.format != format_bgr8) {
+    std::cerr << "Color format " << stream.format << " is not written, only RGB8 and BGR8" << std::endl;
+    return false;
+  }
+  std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+  file << "P6\n" << stream.width << " " << stream.height << "\n255\n";
+  for (uint64_t pixel = 0; pixel < static_cast<uint64_t>(stream.width) * stream.height; ++pixel) {
+    const uint8_t *bytes = image + pixel * stream.bytes_per_pixel;
+    const char rgb[3] = {static_cast<char>(bytes[stream.format == format_rgb8 ? 0 : 2]),
+                         static_cast<char>(bytes[1]),
+                         static_cast<char>(bytes[stream.format == format_rgb8 ? 2 : 0])};
+    file.write(rgb, sizeof(rgb));
+  }
+  return file.good();
+}
+
+//! PGM stores 16 bit samples big endian, the depth units are written unscaled.
+bool write_depth(const std::string &path, const capture::StreamInfo &stream, const uint8_t *image) {
+  if (stream.format != format_z16) {
+    std::cerr << "Depth format " << stream.format << " is not written, only Z16" << std::endl;
+    return false;
+  }
+  std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+  file << "P5\n" << stream.width << " " << stream.height << "\n65535\n";
+  for (uint64_t pixel = 0; pixel < static_cast<uint64_t>(stream.width) * stream.height; ++pixel) {
+    uint16_t depth;
+    std::memcpy(&depth, image + pixel * sizeof(depth), sizeof(depth));
+    const char big_endian[2] = {static_cast<char>(depth >> 8), static_cast<char>(depth & 0xff)};
+    file.write(big_endian, sizeof(big_endian));
+  }
+  return file.good();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " <capture.bin> [frame_index output_prefix]" << std::endl;
+    return 2;
+  }
+
+  int file_descriptor = open(argv[1], O_RDONLY);
+  if (file_descriptor < 0) {
+    std::cerr << "Could not open " << argv[1] << ": " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0
+      || static_cast<uint64_t>(file_status.st_size) < sizeof(capture::FileHeader)) {
+    std::cerr << "File is smaller than a capture header" << std::endl;
+    close(file_descriptor);
+    return 1;
+  }
+  const auto file_size = static_cast<uint64_t>(file_status.st_size);
+  void *address = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+  close(file_descriptor);
+  if (address == MAP_FAILED) {
+    std::cerr << "mmap: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  const auto *file = static_cast<const uint8_t *>(address);
+  capture::FileHeader header;
+  std::memcpy(&header, file, sizeof(header));
+
+  if (header.magic != capture::magic || header.layout_version != capture::layout_version) {
+    std::cerr << "Not a capture of this layout, file version " << header.layout_version << ", reader version "
+              << capture::layout_version << std::endl;
+    munmap(address, file_size);
+    return 1;
+  }
+  if (header.frame_stride_bytes == 0
+      || header.frames_offset_bytes + header.number_of_frames * header.frame_stride_bytes > file_size) {
+    std::cerr << "Capture is truncated" << std::endl;
+    munmap(address, file_size);
+    return 1;
+  }
+
+  std::cout << "Source " << header.source_id << ", trigger " << trigger_reason_name(header.trigger_reason)
+            << " after frame " << header.trigger_frame_number << ", " << header.number_of_frames << " frames, "
+            << "depth units " << header.depth_units << " m" << std::endl;
+  print_stream("Color", header.color);
+  print_stream("Depth", header.depth);
+
+  for (uint32_t i = 0; i < header.number_of_frames; ++i) {
+    capture::FrameRecord record;
+    std::memcpy(&record, file + header.frames_offset_bytes + i * header.frame_stride_bytes, sizeof(record));
+    print_record(i, record);
+  }
+
+  int result = 0;
+  if (argc == 4) {
+    char *end = nullptr;
+    const uint64_t frame_index = std::strtoull(argv[2], &end, 10);
+    if (end == argv[2] || *end != '\0' || frame_index >= header.number_of_frames) {
+      std::cerr << "Frame index must be below " << header.number_of_frames << std::endl;
+      result = 2;
+    } else {
+      const uint8_t *frame = file + header.frames_offset_bytes + frame_index * header.frame_stride_bytes;
+      const std::string output_prefix = argv[3];
+      if (!write_color(output_prefix + "_color.ppm", header.color, frame + header.color_offset_bytes)
+          || !write_depth(output_prefix + "_depth.pgm", header.depth, frame + header.depth_offset_bytes)) {
+        result = 1;
+      }
+    }
+  }
+
+  munmap(address, file_size);
+  return result;
+}
@@ -0,0 +1,402 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Offline comparison of object detection models on a recorded rosbag. Every frame is run through the reference
+//! model (normally FP32 at the configured input size) and one or more candidates (normally INT8, or the same model
+//! at other input sizes). The detections are matched by box IoU, and the confidence drift and latency of every
+//! model are reported. There is no ground truth: the reference detections are the target, so the agreement is how
+//! closely a candidate reproduces the reference, not its recall. The exit code is non-zero if a candidate is outside
+//! the agreement guardrail.
+//!
+//! With --sources it instead compares the multi camera setups on the same frames, without cameras: one network with a
+//! batch of N shared through SharedDetector, against N networks with a batch of 1 running side by side, as N
+//! processes would. Both get thread_pool.number_of_threads inference threads in total. Every simulated camera hands
+//! in a frame every camera_period_ms, all at once or staggered over the period, and the shared setup is also run
+//! without the batch timeout. The throughput and the latency of every camera from handing in a frame to its
+//! detections are reported.
+//!
+//! Usage: detection_benchmark <rosbag> <reference_model.xml> <candidate_model.xml> [max_frames] [WxH,WxH,...]
+//!        detection_benchmark --sources <N> <rosbag> <model.xml> [frames_per_source] [camera_period_ms]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "librealsense2/rs.hpp"
+#include "opencv2/opencv.hpp"
+
+#include "Configuration/Configuration.h"
+#include "ObjectDetection/ObjectDetection.h"
+#include "SharedDetector/SharedDetector.h"
+
+namespace {
+
+constexpr char configuration_relative_path[] = "config/realtime_pose_estimation_config.json";
+constexpr uint32_t frame_timeout_ms = 1000;
+
+constexpr double match_iou_threshold = 0.5;
+constexpr double minimum_reference_agreement = 0.95;  //! Share of reference detections matched.
+constexpr double minimum_mean_iou = 0.85;
+constexpr double maximum_mean_confidence_drift = 0.05;
+
+constexpr uint32_t cached_frames = 30;  //! Decoded once, the cameras cycle through them.
+constexpr uint32_t default_frames_per_source = 300;
+constexpr double default_camera_period_ms = 33.3;
+
+struct InputSize {
+  uint16_t width;
+  uint16_t height;
+};
+
+struct ComparisonStatistics {
+  size_t reference_detections = 0;
+  size_t candidate_detections = 0;
+  size_t matched_detections = 0;
+  double iou_sum = 0;
+  double confidence_drift_sum = 0;
+  double confidence_drift_max = 0;
+};
+
+double box_iou(const object_detection_output &a, const object_detection_output &b) {
+  cv::Rect_<double> rect_a(a.x, a.y, a.width, a.height);
+  cv::Rect_<double> rect_b(b.x, b.y, b.width, b.height);
+  double intersection = (rect_a & rect_b).area();
+  double union_area = rect_a.area() + rect_b.area() - intersection;
+  return union_area > 0 ? intersection / union_area : 0;
+}
+
+//! Greedy one-to-one matching, every reference detection takes its best unused candidate.
+void compare_detections(const std::vector<object_detection_output> &reference,
+                        const std::vector<object_detection_output> &candidate,
+                        ComparisonStatistics *statistics) {
+  statistics->reference_detections += reference.size();
+  statistics->candidate_detections += candidate.size();
+
+  std::vector<bool> candidate_used(candidate.size(), false);
+  for (const auto &reference_detection : reference) {
+    double best_iou = match_iou_threshold;
+    int best_candidate = -1;
+    for (size_t j = 0; j < candidate.size(); ++j) {
+      double iou = box_iou(reference_detection, candidate.at(j));
+      if (!candidate_used.at(j) && iou >= best_iou) {
+        best_iou = iou;
+        best_candidate = static_cast<int>(j);
+      }
+    }
+    if (best_candidate < 0) {
+      continue;
+    }
+    candidate_used.at(best_candidate) = true;
+
+    double confidence_drift = std::abs(reference_detection.confidence - candidate.at(best_candidate).confidence);
+    statistics->matched_detections++;
+    statistics->iou_sum += best_iou;
+    statistics->confidence_drift_sum += confidence_drift;
+    statistics->confidence_drift_max = std::max(statistics->confidence_drift_max, confidence_drift);
+  }
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values.at(index);
+}
+
+void print_latency(const std::string &name, const std::vector<double> &latency_ms) {
+  double sum = 0;
+  for (double latency : latency_ms) {
+    sum += latency;
+  }
+  std::cout << name << " latency [ms]: mean " << (latency_ms.empty() ? 0 : sum / latency_ms.size())
+            << ", p50 " << percentile(latency_ms, 0.5)
+            << ", p99 " << percentile(latency_ms, 0.99) << std::endl;
+}
+
+struct Candidate {
+  std::string name;
+  std::unique_ptr<ObjectDetection> detector = std::make_unique<ObjectDetection>();
+  ComparisonStatistics statistics;
+  std::vector<double> latency_ms;
+};
+
+std::vector<InputSize> parse_input_sizes(const std::string &argument) {
+  std::vector<InputSize> input_sizes;
+  std::stringstream stream(argument);
+  std::string size;
+  while (std::getline(stream, size, ',')) {
+    size_t separator = size.find('x');
+    if (separator == std::string::npos) {
+      std::cerr << "Ignoring input size: " << size << std::endl;
+      continue;
+    }
+    input_sizes.push_back({static_cast<uint16_t>(std::stoul(size.substr(0, separator))),
+                           static_cast<uint16_t>(std::stoul(size.substr(separator + 1)))});
+  }
+  return input_sizes;
+}
+
+void setup_detector(ObjectDetection *detector,
+                    const std::string &model_path,
+                    const InputSize &input_size,
+                    const Settings &settings,
+                    const TunableSettings &tunable_settings,
+                    uint16_t number_of_threads,
+                    uint16_t batch_size = 1) {
+  detector->set_model_path(model_path);
+  detector->set_network_settings(settings.inference_device_name, settings.number_of_classes);
+  detector->set_network_input_dimensions(input_size.width, input_size.height);
+  detector->set_batch_size(batch_size);
+  detector->set_u8_input(settings.object_detection_input_precision == "U8");
+  detector->set_model_cache_directory(settings.model_cache_relative_path);
+  detector->set_inference_threads(number_of_threads, settings.thread_pool_pin_threads);
+  detector->set_object_detection_settings(tunable_settings.object_detection_nms_threshold,
+                                          tunable_settings.object_detection_bbox_conf_threshold);
+  detector->set_draw_detections(false);
+  detector->setup_object_detection();
+}
+
+double run_timed(ObjectDetection *detector, cv::Mat *image) {
+  auto begin = std::chrono::steady_clock::now();
+  detector->run_object_detection(*image);
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//! Calls process_frame with every color frame of the rosbag as BGR, at most max_frames.
+uint32_t for_each_frame(const std::string &rosbag_path,
+                        uint32_t max_frames,
+                        const std::function<void(cv::Mat &)> &process_frame) {
+  rs2::pipeline pipeline;
+  rs2::config config;
+  config.enable_device_from_file(rosbag_path, false);
+  rs2::pipeline_profile profile = pipeline.start(config);
+  if (auto playback = profile.get_device().as<rs2::playback>()) {
+    playback.set_real_time(false);
+  }
+
+  rs2::frameset frames;
+  uint32_t frame_count = 0;
+  while (frame_count < max_frames && pipeline.try_wait_for_frames(&frames, frame_timeout_ms)) {
+    rs2::video_frame color = frames.get_color_frame();
+    if (!color) {
+      continue;
+    }
+    cv::Mat rgb_image(cv::Size(color.get_width(), color.get_height()),
+                      CV_8UC3,
+                      const_cast<void *>(color.get_data()),
+                      cv::Mat::AUTO_STEP);
+    cv::Mat image;
+    cv::cvtColor(rgb_image, image, cv::COLOR_RGB2BGR);
+    process_frame(image);
+    frame_count++;
+  }
+  pipeline.stop();
+  return frame_count;
+}
+
+//! Runs one thread per camera. Camera i hands in frame k at start + k * camera_period_ms, shifted by i / N of the
+//! period when staggered, and waits for detect to return. Returns the wall time of the run in seconds.
+double run_cameras(uint16_t number_of_sources,
+                   const std::vector<cv::Mat> &frames,
+                   uint32_t frames_per_source,
+                   double camera_period_ms,
+                   bool staggered,
+                   const std::function<void(uint16_t, cv::Mat &)> &detect,
+                   std::vector<double> *latency_ms) {
+  std::vector<std::vector<double>> source_latency_ms(number_of_sources);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> cameras;
+  for (uint16_t source_id = 0; source_id < number_of_sources; ++source_id) {
+    cameras.emplace_back([&, source_id]() {
+      const double offset_ms = staggered ? camera_period_ms * source_id / number_of_sources : 0;
+      for (uint32_t k = 0; k < frames_per_source; ++k) {
+        cv::Mat image = frames.at((k + source_id) % frames.size()).clone();
+        std::this_thread::sleep_until(start + std::chrono::duration<double, std::milli>(offset_ms
+            + k * camera_period_ms));
+        auto begin = std::chrono::steady_clock::now();
+        detect(source_id, image);
+        source_latency_ms.at(source_id).emplace_back(
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+      }
+    });
+  }
+  for (auto &camera : cameras) {
+    camera.join();
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  latency_ms->clear();
+  for (const auto &latency : source_latency_ms) {
+    latency_ms->insert(latency_ms->end(), latency.begin(), latency.end());
+  }
+  return seconds;
+}
+
+void print_camera_run(const std::string &name, uint32_t number_of_frames, double seconds,
+                      const std::vector<double> &latency_ms) {
+  std::cout << name << ": " << number_of_frames / seconds << " frames/s" << std::endl;
+  print_latency("  Per camera", latency_ms);
+}
+
+int run_source_benchmark(int argc, char **argv) {
+  if (argc < 5) {
+    std::cerr << "Usage: " << argv[0]
+              << " --sources <N> <rosbag> <model.xml> [frames_per_source] [camera_period_ms]" << std::endl;
+    return 2;
+  }
+  const auto number_of_sources = static_cast<uint16_t>(std::max(1ul, std::stoul(argv[2])));
+  const std::string model_path = argv[4];
+  const uint32_t frames_per_source = argc > 5 ? std::stoul(argv[5]) : default_frames_per_source;
+  const double camera_period_ms = argc > 6 ? std::stod(argv[6]) : default_camera_period_ms;
+
+  Configuration configuration;
+  configuration.load_configuration(
+      (std::filesystem::current_path().parent_path() / configuration_relative_path).string());
+  const Settings &settings = configuration.get_settings();
+  const TunableSettings &tunable_settings = *configuration.get_tunable_settings();
+  const InputSize input_size = {settings.network_input_width, settings.network_input_height};
+  const auto total_threads = static_cast<uint16_t>(settings.thread_pool_number_of_threads > 0
+      ? settings.thread_pool_number_of_threads : std::max(1u, std::thread::hardware_concurrency()));
+
+  std::vector<cv::Mat> frames;
+  for_each_frame(argv[3], cached_frames, [&frames](cv::Mat &image) { frames.emplace_back(image); });
+  if (frames.empty()) {
+    std::cerr << "No color frames in " << argv[3] << std::endl;
+    return 1;
+  }
+  const uint32_t number_of_frames = frames_per_source * number_of_sources;
+  std::cout << number_of_sources << " cameras, " << frames_per_source << " frames each, a frame every "
+            << camera_period_ms << " ms, " << total_threads << " inference threads in total" << std::endl;
+
+  std::vector<double> latency_ms;
+  {  //! N processes, each with its share of the threads.
+    std::vector<std::unique_ptr<ObjectDetection>> detectors;
+    for (uint16_t source_id = 0; source_id < number_of_sources; ++source_id) {
+      detectors.emplace_back(std::make_unique<ObjectDetection>());
+      setup_detector(detectors.back().get(), model_path, input_size, settings, tunable_settings,
+                     std::max(1, total_threads / number_of_sources));
+    }
+    const double seconds = run_cameras(number_of_sources, frames, frames_per_source, camera_period_ms, false,
+                                       [&detectors](uint16_t source_id, cv::Mat &image) {
+                                         detectors.at(source_id)->run_object_detection(image);
+                                       }, &latency_ms);
+    print_camera_run("Separate networks, batch 1", number_of_frames, seconds, latency_ms);
+  }
+
+  ObjectDetection shared_network;
+  setup_detector(&shared_network, model_path, input_size, settings, tunable_settings, total_threads,
+                 number_of_sources);
+  struct SharedRun {
+    const char *name;
+    uint32_t batch_timeout_ms;
+    bool staggered;
+  };
+  const SharedRun shared_runs[] = {
+      {"Shared network, cameras in step", settings.shared_detector_batch_timeout_ms, false},
+      {"Shared network, staggered cameras", settings.shared_detector_batch_timeout_ms, true},
+      {"Shared network, staggered cameras, no batch timeout", 0, true},
+  };
+  for (const SharedRun &shared_run : shared_runs) {
+    SharedDetector shared_detector;
+    shared_detector.setup_shared_detector(&shared_network, number_of_sources, shared_run.batch_timeout_ms);
+    const double seconds = run_cameras(number_of_sources, frames, frames_per_source, camera_period_ms,
+                                       shared_run.staggered, [&shared_detector](uint16_t source_id, cv::Mat &image) {
+                                         shared_detector.run_object_detection(source_id, image);
+                                       }, &latency_ms);
+    shared_detector.shutdown();
+    print_camera_run(std::string(shared_run.name) + ", batch timeout " + std::to_string(shared_run.batch_timeout_ms)
+                         + " ms", number_of_frames, seconds, latency_ms);
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "--sources") {
+    return run_source_benchmark(argc, argv);
+  }
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " <rosbag> <reference_model.xml> <candidate_model.xml> [max_frames] [WxH,WxH,...]" << std::endl;
+    std::cerr << "       " << argv[0]
+              << " --sources <N> <rosbag> <model.xml> [frames_per_source] [camera_period_ms]" << std::endl;
+    return 2;
+  }
+  const std::string rosbag_path = argv[1];
+  const uint32_t max_frames = argc > 4 && std::stoul(argv[4]) > 0 ? std::stoul(argv[4]) : UINT32_MAX;  //! 0 is all.
+
+  Configuration configuration;
+  configuration.load_configuration(
+      (std::filesystem::current_path().parent_path() / configuration_relative_path).string());
+  const Settings &settings = configuration.get_settings();
+  const TunableSettings &tunable_settings = *configuration.get_tunable_settings();
+
+  const InputSize reference_input_size = {settings.network_input_width, settings.network_input_height};
+  std::vector<InputSize> candidate_input_sizes = {reference_input_size};
+  if (argc > 5) {
+    candidate_input_sizes = parse_input_sizes(argv[5]);
+  }
+
+  ObjectDetection reference_detector;
+  setup_detector(&reference_detector, argv[2], reference_input_size, settings, tunable_settings,
+                 settings.thread_pool_number_of_threads);
+
+  std::vector<Candidate> candidates(candidate_input_sizes.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    candidates.at(i).name = "Candidate " + std::to_string(candidate_input_sizes.at(i).width) + "x" +
+        std::to_string(candidate_input_sizes.at(i).height);
+    setup_detector(candidates.at(i).detector.get(), argv[3], candidate_input_sizes.at(i), settings,
+                   tunable_settings, settings.thread_pool_number_of_threads);
+  }
+
+  std::vector<double> reference_latency_ms;
+  const uint32_t frame_count = for_each_frame(rosbag_path, max_frames, [&](cv::Mat &image) {
+    reference_latency_ms.emplace_back(run_timed(&reference_detector, &image));
+    for (auto &candidate : candidates) {
+      candidate.latency_ms.emplace_back(run_timed(candidate.detector.get(), &image));
+      compare_detections(reference_detector.get_detections(),
+                         candidate.detector->get_detections(),
+                         &candidate.statistics);
+    }
+  });
+
+  std::cout << "Frames: " << frame_count << std::endl;
+  print_latency("Reference", reference_latency_ms);
+
+  bool passed = true;
+  for (const auto &candidate : candidates) {
+    const ComparisonStatistics &statistics = candidate.statistics;
+    double reference_agreement = statistics.reference_detections > 0
+                    ? static_cast<double>(statistics.matched_detections) / statistics.reference_detections : 1;
+    double mean_iou = statistics.matched_detections > 0
+                      ? statistics.iou_sum / statistics.matched_detections : 0;
+    double mean_confidence_drift = statistics.matched_detections > 0
+                                   ? statistics.confidence_drift_sum / statistics.matched_detections : 0;
+    bool candidate_passed = reference_agreement >= minimum_reference_agreement &&
+        (statistics.matched_detections == 0 || mean_iou >= minimum_mean_iou) &&
+        mean_confidence_drift <= maximum_mean_confidence_drift;
+
+    std::cout << candidate.name << ":" << std::endl;
+    std::cout << "  Detections reference/candidate/matched: " << statistics.reference_detections << "/"
+              << statistics.candidate_detections << "/" << statistics.matched_detections << std::endl;
+    std::cout << "  Agreement with reference: " << reference_agreement << ", mean IoU: " << mean_iou
+              << ", confidence drift mean: " << mean_confidence_drift
+              << ", max: " << statistics.confidence_drift_max << std::endl;
+    print_latency("  " + candidate.name, candidate.latency_ms);
+    std::cout << "  Agreement guardrail: " << (candidate_passed ? "PASSED" : "FAILED") << std::endl;
+    passed = passed && candidate_passed;
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Checks that FrustumCrop keeps the same points as pcl::FrustumCulling, and compares their speed. A random 1280x720
+//! cloud with (0, 0, 0) and NaN points is cropped with a few camera poses, fields of view and near planes. The two
+//! sum the plane equation in a different order, so a point within rounding of a plane may go either way. Such points
+//! are counted apart, and any other difference fails the check.
+//!
+//! Usage: frustum_crop_check [repetitions]
+
+#include <pcl/filters/frustum_culling.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "FrustumCrop/FrustumCrop.h"
+
+namespace {
+
+constexpr uint32_t cloud_width = 1280;
+constexpr uint32_t cloud_height = 720;
+constexpr uint32_t zero_point_interval = 97;  //! Depth pixels without a value are (0, 0, 0).
+constexpr uint32_t nan_point_interval = 101;
+constexpr float coordinate_range_meter = 6;
+constexpr float far_plane_distance_meter = 5;
+constexpr double rad_to_deg = 180.0 / M_PI;
+constexpr uint32_t default_repetitions = 10;
+constexpr float boundary_distance_meter = 1e-4;
+
+struct Frustum {
+  Eigen::Matrix4f camera_pose;
+  float vertical_fov_rad;
+  float horizontal_fov_rad;
+  float near_plane_distance_meter;
+};
+
+pcl::PointCloud<pcl::PointXYZ>::Ptr make_cloud() {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>(cloud_width, cloud_height));
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> coordinate(-coordinate_range_meter, coordinate_range_meter);
+  for (size_t i = 0; i < cloud->size(); ++i) {
+    pcl::PointXYZ &point = cloud->points[i];
+    if (i % zero_point_interval == 0) {
+      point.x = point.y = point.z = 0;
+    } else if (i % nan_point_interval == 0) {
+      point.x = point.y = point.z = std::numeric_limits<float>::quiet_NaN();
+    } else {
+      point.x = coordinate(generator);
+      point.y = coordinate(generator);
+      point.z = coordinate(generator);
+    }
+  }
+  return cloud;
+}
+
+std::vector<Frustum> make_frustums() {
+  //! The pcl::FrustumCulling convention views along x, the pipeline turns it to view along the camera z axis.
+  Eigen::Matrix4f along_x = Eigen::Matrix4f::Identity();
+  Eigen::Matrix4f along_z = Eigen::Matrix4f::Identity();
+  along_z.block<3, 3>(0, 0) << 0, 0, 1,
+                               0, -1, 0,
+                               1, 0, 0;
+
+  std::vector<Frustum> frustums;
+  for (const Eigen::Matrix4f &camera_pose : {along_x, along_z}) {
+    for (float near_plane_distance_meter : {0.0f, 0.5f}) {
+      frustums.push_back({camera_pose, 0.3f, 0.5f, near_plane_distance_meter});  //! A detection box.
+      frustums.push_back({camera_pose, 1.0f, 1.2f, near_plane_distance_meter});  //! Most of the image.
+    }
+  }
+  return frustums;
+}
+
+//! The point is within boundary_distance_meter of a plane if moving it that far along an axis changes the result.
+bool is_on_boundary(const FrustumCrop &frustum_crop, const pcl::PointXYZ &point) {
+  pcl::PointCloud<pcl::PointXYZ> moved_points;
+  for (int axis = 0; axis < 3; ++axis) {
+    for (float sign : {-1.0f, 1.0f}) {
+      pcl::PointXYZ moved_point = point;
+      moved_point.data[axis] += sign * boundary_distance_meter;
+      moved_points.push_back(moved_point);
+    }
+  }
+  pcl::PointCloud<pcl::PointXYZ>::VectorType inside_points;
+  std::vector<int> inside_indices;
+  frustum_crop.crop(moved_points, 0, moved_points.size(), &inside_points, &inside_indices);
+  return !inside_indices.empty() && inside_indices.size() != moved_points.size();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t repetitions = argc > 1 ? std::max(1ul, std::strtoul(argv[1], nullptr, 10)) : default_repetitions;
+  const pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = make_cloud();
+
+  uint32_t mismatched_frustums = 0;
+  for (const Frustum &frustum : make_frustums()) {
+    pcl::FrustumCulling<pcl::PointXYZ> frustum_filter;
+    frustum_filter.setInputCloud(cloud);
+    frustum_filter.setCameraPose(frustum.camera_pose);
+    frustum_filter.setNearPlaneDistance(frustum.near_plane_distance_meter);
+    frustum_filter.setFarPlaneDistance(far_plane_distance_meter);
+    frustum_filter.setVerticalFOV(frustum.vertical_fov_rad * rad_to_deg);
+    frustum_filter.setHorizontalFOV(frustum.horizontal_fov_rad * rad_to_deg);
+
+    FrustumCrop frustum_crop;
+    frustum_crop.set_frustum(frustum.camera_pose, frustum.vertical_fov_rad, frustum.horizontal_fov_rad,
+                             frustum.near_plane_distance_meter, far_plane_distance_meter);
+
+    std::vector<int> reference_indices;
+    std::vector<int> indices;
+    pcl::PointCloud<pcl::PointXYZ>::VectorType points;
+    double reference_seconds = 0;
+    double seconds = 0;
+    for (uint32_t repetition = 0; repetition < repetitions; ++repetition) {
+      auto begin = std::chrono::steady_clock::now();
+      frustum_filter.filter(reference_indices);
+      auto end = std::chrono::steady_clock::now();
+      reference_seconds += std::chrono::duration<double>(end - begin).count();
+
+      indices.clear();
+      points.clear();
+      begin = std::chrono::steady_clock::now();
+      frustum_crop.crop(*cloud, 0, cloud->size(), &points, &indices);
+      end = std::chrono::steady_clock::now();
+      seconds += std::chrono::duration<double>(end - begin).count();
+    }
+
+    //! Both lists are sorted, walk them together.
+    uint32_t boundary_points = 0;
+    uint32_t different_points = 0;
+    std::vector<int> only_in_one;
+    std::set_symmetric_difference(indices.begin(), indices.end(), reference_indices.begin(), reference_indices.end(),
+                                  std::back_inserter(only_in_one));
+    for (int index : only_in_one) {
+      if (is_on_boundary(frustum_crop, cloud->points[index])) {
+        boundary_points++;
+      } else {
+        different_points++;
+      }
+    }
+
+    std::cout << "fov " << frustum.vertical_fov_rad << "x" << frustum.horizontal_fov_rad << " rad, near "
+              << frustum.near_plane_distance_meter << " m: " << indices.size() << " points, " << different_points
+              << " different, " << boundary_points << " on a plane, pcl " << reference_seconds / repetitions * 1000
+              << " ms, FrustumCrop " << seconds / repetitions * 1000 << " ms" << std::endl;
+    mismatched_frustums += different_points == 0 ? 0 : 1;
+  }
+  return mismatched_frustums == 0 ? 0 : 1;
+}
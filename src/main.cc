@@ -1,13 +1,65 @@
 // Copyright 2022 Simon Erik Nylund.
 // Author: snenyl
 
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Configuration/Configuration.h"
+#include "ObjectDetection/ObjectDetection.h"
 #include "PoseEstimation/PoseEstimation.h"
+#include "SharedDetector/SharedDetector.h"
+
+static constexpr char configuration_relative_path[] = "config/realtime_pose_estimation_config.json";
 
-PoseEstimation pose_estimation_object;
+int main(int argc, char **argv) {
+  Configuration configuration;
+  configuration.load_configuration(argc > 1 ? std::string(argv[1]) :
+                                   (std::filesystem::current_path().parent_path() / configuration_relative_path).string());
+  const Settings &settings = configuration.get_settings();
 
-int main() {
-  pose_estimation_object.setup_pose_estimation();
+  if (settings.sources.size() <= 1) {
+    PoseEstimation pose_estimation_object(configuration);
+    if (!pose_estimation_object.setup_pose_estimation()) {
+      return 1;
+    }
+    while (true) {
+      pose_estimation_object.run_pose_estimation();
+    }
+  }
+
+  //! Several cameras, one pipeline each, all sharing one batched object detection network.
+  const auto number_of_sources = static_cast<uint16_t>(settings.sources.size());
+  ObjectDetection object_detection_object;
+  if (!PoseEstimation::setup_object_detection(&object_detection_object, settings,
+                                              *configuration.get_tunable_settings(),
+                                              PoseEstimation::get_shared_detector_threads(settings),
+                                              number_of_sources)) {
+    return 1;
+  }
+  SharedDetector shared_detector;
+  shared_detector.setup_shared_detector(&object_detection_object, number_of_sources,
+                                        settings.shared_detector_batch_timeout_ms);
+
+  std::vector<std::unique_ptr<PoseEstimation>> pose_estimation_objects;
+  for (uint16_t source_id = 0; source_id < number_of_sources; ++source_id) {
+    pose_estimation_objects.emplace_back(std::make_unique<PoseEstimation>(configuration, source_id, &shared_detector));
+    if (!pose_estimation_objects.back()->setup_pose_estimation()) {
+      shared_detector.shutdown();
+      return 1;
+    }
+  }
+
+  //! The first camera runs on the main thread, the only one allowed to show windows.
+  std::vector<std::thread> camera_threads;
+  for (uint16_t source_id = 1; source_id < number_of_sources; ++source_id) {
+    camera_threads.emplace_back([&pose_estimation_objects, source_id]() {
+      while (true) {
+        pose_estimation_objects.at(source_id)->run_pose_estimation();
+      }
+    });
+  }
   while (true) {
-    pose_estimation_object.run_pose_estimation();
+    pose_estimation_objects.at(0)->run_pose_estimation();
   }
 }
@@ -0,0 +1,226 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Offline object detection of a recorded rosbag for re-labeling, where throughput matters and latency does not.
+//! batch_size consecutive frames are letterboxed in parallel, run as one inference and decoded in parallel. Every
+//! detection is written to a CSV file. With verify_frames > 0 the first frames are also run one by one and the
+//! detections are checked to be identical to the batched ones.
+//!
+//! Usage: offline_detection <rosbag> <output.csv> [batch_size] [verify_frames]
+
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "librealsense2/rs.hpp"
+#include "opencv2/opencv.hpp"
+
+#include "Configuration/Configuration.h"
+#include "ObjectDetection/ObjectDetection.h"
+#include "PoseEstimation/PoseEstimation.h"
+#include "ThreadPool/ThreadPool.h"
+
+namespace {
+
+constexpr char configuration_relative_path[] = "config/realtime_pose_estimation_config.json";
+constexpr uint32_t frame_timeout_ms = 1000;
+constexpr uint16_t default_batch_size = 8;
+
+struct Frame {
+  uint64_t frame_number = 0;
+  double timestamp_seconds = 0;
+  cv::Mat image;
+};
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " <rosbag> <output.csv> [batch_size] [verify_frames]" << std::endl;
+}
+
+//! Whole decimal number in [minimum, maximum], returns false for anything else.
+bool parse_count(const char *text, unsigned long minimum, unsigned long maximum, unsigned long *value) {
+  char *end = nullptr;
+  errno = 0;
+  *value = std::strtoul(text, &end, 10);
+  return end != text && *end == '\0' && errno == 0 && text[0] != '-' && *value >= minimum && *value <= maximum;
+}
+
+//! The model follows object_detection.model_precision, as in the live pipeline.
+bool setup_detector(ObjectDetection *detector,
+                    uint16_t batch_size,
+                    uint16_t number_of_threads,
+                    const Settings &settings,
+                    const TunableSettings &tunable_settings) {
+  detector->set_draw_detections(false);
+  return PoseEstimation::setup_object_detection(detector, settings, tunable_settings, number_of_threads, batch_size);
+}
+
+//! Copies the color frame into image as BGR. Returns false for a format the detector cannot take.
+bool to_bgr(const rs2::video_frame &color, cv::Mat *image) {
+  const cv::Mat color_image(cv::Size(color.get_width(), color.get_height()),
+                            CV_8UC3,
+                            const_cast<void *>(color.get_data()),
+                            cv::Mat::AUTO_STEP);
+  switch (color.get_profile().format()) {
+    case RS2_FORMAT_RGB8:
+      cv::cvtColor(color_image, *image, cv::COLOR_RGB2BGR);
+      return true;
+    case RS2_FORMAT_BGR8:
+      color_image.copyTo(*image);
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool same_detections(const std::vector<object_detection_output> &a, const std::vector<object_detection_output> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a.at(i).x != b.at(i).x || a.at(i).y != b.at(i).y || a.at(i).width != b.at(i).width
+        || a.at(i).height != b.at(i).height || a.at(i).confidence != b.at(i).confidence) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void write_detections(std::ofstream *output_file,
+                      const Frame &frame,
+                      const std::vector<object_detection_output> &detections) {
+  for (size_t i = 0; i < detections.size(); ++i) {
+    const object_detection_output &detection = detections.at(i);
+    *output_file << frame.frame_number << "," << frame.timestamp_seconds << "," << i << "," << detection.x << ","
+                 << detection.y << "," << detection.width << "," << detection.height << ","
+                 << detection.confidence << "\n";
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned long batch_size_argument = default_batch_size;
+  unsigned long verify_frames_argument = 0;
+  if (argc < 3 || argc > 5
+      || (argc > 3 && !parse_count(argv[3], 1, std::numeric_limits<uint16_t>::max(), &batch_size_argument))
+      || (argc > 4 && !parse_count(argv[4], 0, std::numeric_limits<uint32_t>::max(), &verify_frames_argument))) {
+    print_usage(argv[0]);
+    return 2;
+  }
+  const std::string rosbag_path = argv[1];
+  const auto batch_size = static_cast<uint16_t>(batch_size_argument);
+  const auto verify_frames = static_cast<uint32_t>(verify_frames_argument);
+
+  Configuration configuration;
+  configuration.load_configuration(
+      (std::filesystem::current_path().parent_path() / configuration_relative_path).string());
+  const Settings &settings = configuration.get_settings();
+  const TunableSettings &tunable_settings = *configuration.get_tunable_settings();
+
+  ThreadPool thread_pool;
+  thread_pool.setup_thread_pool(settings.thread_pool_number_of_threads, settings.thread_pool_pin_threads,
+                                settings.thread_pool_core_ids);
+
+  ObjectDetection detector;
+  ObjectDetection single_frame_detector;
+  if (!setup_detector(&detector, batch_size, thread_pool.get_number_of_threads(), settings, tunable_settings)
+      || (verify_frames > 0
+          && !setup_detector(&single_frame_detector, 1, thread_pool.get_number_of_threads(), settings,
+                             tunable_settings))) {
+    return 1;
+  }
+
+  std::ofstream output_file(argv[2]);
+  if (!output_file.is_open()) {
+    std::cerr << "Could not open output file: " << argv[2] << std::endl;
+    return 2;
+  }
+  output_file << std::fixed << std::setprecision(6);
+  output_file << "frame_number,timestamp_seconds,detection,x,y,width,height,confidence\n";
+
+  rs2::pipeline pipeline;
+  rs2::config config;
+  config.enable_device_from_file(rosbag_path, false);
+  rs2::pipeline_profile profile = pipeline.start(config);
+  if (auto playback = profile.get_device().as<rs2::playback>()) {
+    playback.set_real_time(false);
+  }
+
+  std::vector<Frame> batch;
+  std::vector<cv::Mat *> batch_images;
+  batch.reserve(batch_size);
+  batch_images.reserve(batch_size);
+  uint64_t frame_count = 0;
+  uint64_t verified_frames = 0;
+  uint64_t mismatched_frames = 0;
+  bool end_of_recording = false;
+  auto begin = std::chrono::steady_clock::now();
+
+  while (!end_of_recording) {
+    batch.clear();
+    rs2::frameset frames;
+    while (batch.size() < batch_size) {
+      if (!pipeline.try_wait_for_frames(&frames, frame_timeout_ms)) {
+        end_of_recording = true;
+        break;
+      }
+      rs2::video_frame color = frames.get_color_frame();
+      if (!color) {
+        continue;
+      }
+      Frame frame;
+      if (!to_bgr(color, &frame.image)) {
+        std::cerr << "Unsupported color format " << rs2_format_to_string(color.get_profile().format())
+                  << ", only RGB8 and BGR8 can be detected on" << std::endl;
+        pipeline.stop();
+        return 1;
+      }
+      frame.frame_number = color.get_frame_number();
+      frame.timestamp_seconds = color.get_timestamp() / 1000.0;  // TODO(simon) Magic number.
+      batch.emplace_back(std::move(frame));
+    }
+    if (batch.empty()) {
+      break;
+    }
+
+    batch_images.clear();
+    for (auto &frame : batch) {
+      batch_images.emplace_back(&frame.image);
+    }
+    detector.run_object_detection_batch(batch_images, &thread_pool);
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const std::vector<object_detection_output> &detections = detector.get_batch_detections(i);
+      write_detections(&output_file, batch.at(i), detections);
+
+      if (verified_frames < verify_frames) {
+        single_frame_detector.run_object_detection(batch.at(i).image);
+        if (!same_detections(single_frame_detector.get_detections(), detections)) {
+          std::cerr << "Frame " << batch.at(i).frame_number << ": batched detections differ from single frame"
+                    << std::endl;
+          mismatched_frames++;
+        }
+        verified_frames++;
+      }
+    }
+    frame_count += batch.size();
+  }
+  pipeline.stop();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << "Frames: " << frame_count << ", batch size " << batch_size << ", "
+            << (seconds > 0 ? frame_count / seconds : 0) << " frames/s" << std::endl;
+  if (verify_frames > 0) {
+    std::cout << "Verified frames: " << verified_frames << ", mismatched: " << mismatched_frames << std::endl;
+  }
+  return mismatched_frames == 0 ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Offline accuracy versus latency sweep. Every trial replays the configured rosbag headless with one combination
+//! of the tunable parameters in the sweep file, and records the per-frame latency of run_pose_estimation and the
+//! pose error against the AprilTag ground truth. Trials run in parallel worker processes, each with its own
+//! PoseEstimation. Every trial writes its frames to a CSV file, all trials are summarized in another, and the Pareto
+//! front over mean latency, mean angle error and pose rate is printed.
+//!
+//! Usage: parameter_sweep [sweep_config.json] [base_config.json]
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Configuration/Configuration.h"
+#include "PoseEstimation/PoseEstimation.h"
+
+namespace {
+
+constexpr char sweep_configuration_relative_path[] = "config/parameter_sweep_config.json";
+constexpr char configuration_relative_path[] = "config/realtime_pose_estimation_config.json";
+constexpr char output_relative_path[] = "log/parameter_sweep";
+constexpr double rad_to_deg = 180.0 / M_PI;
+
+//! One value per tunable, as JSON section, key and value.
+struct Parameter {
+  std::string section;
+  std::string key;
+  std::vector<Json::Value> values;
+};
+
+using Trial = std::vector<size_t>;  //! Index into Parameter::values for every parameter.
+
+//! Written by a worker process into its pipe, so plain data only.
+struct TrialResult {
+  bool completed = false;
+  uint32_t frames = 0;
+  uint32_t valid_frames = 0;  //! Frames with a pose.
+  uint32_t evaluated_frames = 0;  //! Frames with both a pose and the ground truth.
+  double mean_latency_ms = 0;
+  double p95_latency_ms = 0;
+  double mean_angle_error_deg = std::numeric_limits<double>::infinity();
+  double mean_position_error_meter = std::numeric_limits<double>::infinity();
+};
+
+struct SweepSettings {
+  std::string search = "RANDOM";  //! GRID or RANDOM.
+  uint32_t random_trials = 40;
+  uint32_t seed = 0;
+  uint32_t frames = 300;
+  uint32_t warmup_frames = 30;  //! Not measured, lets the detector and the ground plane settle.
+  uint32_t jobs = 1;
+};
+
+bool read_json(const std::string &path, Json::Value *root) {
+  std::ifstream file(path);
+  Json::CharReaderBuilder reader_builder;
+  std::string errors;
+  if (!file.is_open() || !Json::parseFromStream(reader_builder, file, root, &errors)) {
+    std::cerr << "Could not read " << path << " " << errors << std::endl;
+    return false;
+  }
+  return true;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values.at(index);
+}
+
+std::vector<Trial> make_trials(const std::vector<Parameter> &parameters, const SweepSettings &sweep_settings) {
+  std::vector<Trial> trials;
+  if (sweep_settings.search == "GRID") {
+    Trial trial(parameters.size(), 0);
+    while (true) {
+      trials.push_back(trial);
+      size_t i = 0;
+      for (; i < parameters.size(); ++i) {  //! Odometer increment.
+        if (++trial.at(i) < parameters.at(i).values.size()) {
+          break;
+        }
+        trial.at(i) = 0;
+      }
+      if (i == parameters.size()) {
+        break;
+      }
+    }
+    return trials;
+  }
+
+  std::mt19937 generator(sweep_settings.seed);
+  for (uint32_t t = 0; t < sweep_settings.random_trials; ++t) {
+    Trial trial(parameters.size());
+    for (size_t i = 0; i < parameters.size(); ++i) {
+      trial.at(i) = std::uniform_int_distribution<size_t>(0, parameters.at(i).values.size() - 1)(generator);
+    }
+    trials.push_back(trial);
+  }
+  return trials;
+}
+
+//! Base configuration with the trial values, headless and without side outputs.
+Json::Value make_trial_configuration(const Json::Value &base_configuration,
+                                     const std::vector<Parameter> &parameters,
+                                     const Trial &trial,
+                                     uint32_t threads_per_job) {
+  Json::Value configuration = base_configuration;
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    configuration[parameters.at(i).section][parameters.at(i).key] = parameters.at(i).values.at(trial.at(i));
+  }
+  configuration["capture"]["load_from_rosbag"] = true;
+  configuration["capture"]["single_run"] = true;
+  configuration["visualization"]["enable"] = false;
+  configuration["logger"]["enable_logger"] = false;
+  configuration["logger"]["enable_debug_mode"] = false;
+  configuration["pose_export"]["enable"] = false;
+  //! The tracked mode lags the frame, its ground truth would rarely belong to the pose it is compared with.
+  configuration["aruco"]["evaluation_mode"] = "FULL_FRAME";
+  configuration["thread_pool"]["number_of_threads"] = threads_per_job;
+  return configuration;
+}
+
+//! Runs in the worker process. Writes the latency and the pose error of every measured frame to frames_path.
+TrialResult run_trial(const std::string &configuration_path, const std::string &frames_path,
+                      const SweepSettings &sweep_settings) {
+  TrialResult result;
+  std::vector<double> latency_ms;
+  double angle_error_sum = 0;
+  double position_error_sum = 0;
+
+  Configuration configuration;
+  if (!configuration.load_configuration(configuration_path)) {
+    return result;
+  }
+  PoseEstimation pose_estimation(configuration);
+  if (!pose_estimation.setup_pose_estimation()) {
+    return result;
+  }
+
+  std::ofstream frames_file(frames_path);
+  frames_file << "frame,latency_ms,pose_valid,angle_error_deg,position_error_meter" << std::endl;
+
+  try {
+    for (uint32_t frame = 0; frame < sweep_settings.warmup_frames + sweep_settings.frames; ++frame) {
+      auto begin = std::chrono::steady_clock::now();
+      pose_estimation.run_pose_estimation();
+      double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+      if (frame < sweep_settings.warmup_frames) {
+        continue;
+      }
+
+      result.frames++;
+      latency_ms.emplace_back(elapsed_ms);
+
+      PoseResult pose;
+      const bool pose_valid = pose_estimation.get_pose_publisher().read_latest(&pose) && pose.valid;
+      frames_file << frame << "," << elapsed_ms << "," << pose_valid;
+      if (!pose_valid) {
+        frames_file << ",," << std::endl;
+        continue;
+      }
+      result.valid_frames++;
+
+      //! Ground truth from an older frame than the pose is not used, the pallet or the camera may have moved since.
+      Eigen::Vector3d ground_truth_position;
+      Eigen::Vector3d ground_truth_direction;
+      uint64_t ground_truth_frame_number;
+      const Eigen::Vector3d position(pose.position[0], pose.position[1], pose.position[2]);
+      const Eigen::Vector3d direction(pose.direction[0], pose.direction[1], pose.direction[2]);
+      if (!pose_estimation.get_ground_truth(&ground_truth_position, &ground_truth_direction,
+                                            &ground_truth_frame_number)
+          || ground_truth_frame_number != pose.frame_number) {
+        frames_file << ",," << std::endl;
+        continue;
+      }
+      const double norms = direction.norm() * ground_truth_direction.norm();
+      if (norms <= 0) {
+        frames_file << ",," << std::endl;
+        continue;
+      }
+      //! Angle between the face normals as lines, the sign of either normal is not meaningful.
+      const double cosine = std::min(1.0, std::abs(direction.dot(ground_truth_direction)) / norms);
+      const double angle_error_deg = std::acos(cosine) * rad_to_deg;
+      const double position_error_meter = (position - ground_truth_position).norm();
+      angle_error_sum += angle_error_deg;
+      position_error_sum += position_error_meter;
+      result.evaluated_frames++;
+      frames_file << "," << angle_error_deg << "," << position_error_meter << std::endl;
+    }
+  } catch (const rs2::error &error) {  //! End of the recording.
+    std::cerr << "Stopped after " << result.frames << " frames: " << error.what() << std::endl;
+  }
+
+  if (!latency_ms.empty()) {
+    double sum = 0;
+    for (double latency : latency_ms) {
+      sum += latency;
+    }
+    result.mean_latency_ms = sum / latency_ms.size();
+    result.p95_latency_ms = percentile(latency_ms, 0.95);
+  }
+  if (result.evaluated_frames > 0) {
+    result.mean_angle_error_deg = angle_error_sum / result.evaluated_frames;
+    result.mean_position_error_meter = position_error_sum / result.evaluated_frames;
+  }
+  result.completed = true;
+  return result;
+}
+
+std::string value_to_string(const Json::Value &value) {
+  if (value.isDouble()) {
+    std::ostringstream stream;
+    stream << value.asDouble();
+    return stream.str();
+  }
+  return value.asString();
+}
+
+double pose_rate(const TrialResult &result) {
+  return result.frames > 0 ? static_cast<double>(result.valid_frames) / result.frames : 0;
+}
+
+//! a is at least as good as b in latency, angle error and pose rate, and better in one of them.
+bool dominates(const TrialResult &a, const TrialResult &b) {
+  const bool no_worse = a.mean_latency_ms <= b.mean_latency_ms && a.mean_angle_error_deg <= b.mean_angle_error_deg
+      && pose_rate(a) >= pose_rate(b);
+  const bool better = a.mean_latency_ms < b.mean_latency_ms || a.mean_angle_error_deg < b.mean_angle_error_deg
+      || pose_rate(a) > pose_rate(b);
+  return no_worse && better;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const std::filesystem::path root_path = std::filesystem::current_path().parent_path();
+  const std::string sweep_configuration_path =
+      argc > 1 ? std::string(argv[1]) : (root_path / sweep_configuration_relative_path).string();
+  const std::string configuration_path =
+      argc > 2 ? std::string(argv[2]) : (root_path / configuration_relative_path).string();
+
+  Json::Value sweep_configuration;
+  Json::Value base_configuration;
+  if (!read_json(sweep_configuration_path, &sweep_configuration) ||
+      !read_json(configuration_path, &base_configuration)) {
+    return 2;
+  }
+
+  SweepSettings sweep_settings;
+  sweep_settings.search = sweep_configuration.get("search", sweep_settings.search).asString();
+  sweep_settings.random_trials = sweep_configuration.get("random_trials", sweep_settings.random_trials).asUInt();
+  sweep_settings.seed = sweep_configuration.get("seed", sweep_settings.seed).asUInt();
+  sweep_settings.frames = sweep_configuration.get("frames", sweep_settings.frames).asUInt();
+  sweep_settings.warmup_frames = sweep_configuration.get("warmup_frames", sweep_settings.warmup_frames).asUInt();
+  sweep_settings.jobs = std::max(1u, sweep_configuration.get("jobs", sweep_settings.jobs).asUInt());
+
+  std::vector<Parameter> parameters;
+  const Json::Value &parameter_sections = sweep_configuration["parameters"];
+  for (const std::string &section : parameter_sections.getMemberNames()) {
+    for (const std::string &key : parameter_sections[section].getMemberNames()) {
+      const Json::Value &values = parameter_sections[section][key];
+      if (!values.isArray() || values.empty()) {
+        std::cerr << "Ignoring " << section << "." << key << ", it needs a non-empty list of values" << std::endl;
+        continue;
+      }
+      parameters.push_back({section, key, std::vector<Json::Value>(values.begin(), values.end())});
+    }
+  }
+
+  const std::vector<Trial> trials = make_trials(parameters, sweep_settings);
+  //! Workers share the cores, so latency is comparable between trials but higher than in a single run.
+  const uint32_t threads_per_job = std::max(1u, std::thread::hardware_concurrency() / sweep_settings.jobs);
+
+  const std::filesystem::path output_path = root_path / output_relative_path;
+  std::filesystem::create_directories(output_path);
+  std::cout << "Trials: " << trials.size() << ", jobs: " << sweep_settings.jobs << ", threads per job: "
+            << threads_per_job << ", output: " << output_path << std::endl;
+
+  std::vector<TrialResult> results(trials.size());
+  std::map<pid_t, std::pair<size_t, int>> running;  //! Worker pid to trial index and read end of its pipe.
+  size_t next_trial = 0;
+
+  while (next_trial < trials.size() || !running.empty()) {
+    while (next_trial < trials.size() && running.size() < sweep_settings.jobs) {
+      const std::string trial_configuration_path =
+          (output_path / ("trial_" + std::to_string(next_trial) + ".json")).string();
+      std::ofstream trial_configuration_file(trial_configuration_path);
+      trial_configuration_file << make_trial_configuration(base_configuration, parameters, trials.at(next_trial),
+                                                           threads_per_job);
+      trial_configuration_file.close();
+
+      int pipe_descriptors[2];
+      if (pipe(pipe_descriptors) != 0) {
+        std::cerr << "Could not create a pipe" << std::endl;
+        return 1;
+      }
+      pid_t pid = fork();
+      if (pid == 0) {
+        close(pipe_descriptors[0]);
+        const std::string log_path = (output_path / ("trial_" + std::to_string(next_trial) + ".log")).string();
+        if (std::freopen(log_path.c_str(), "w", stdout) == nullptr) {
+          std::cerr << "Could not redirect the output of trial " << next_trial << std::endl;
+        }
+        const std::string frames_path =
+            (output_path / ("trial_" + std::to_string(next_trial) + "_frames.csv")).string();
+        TrialResult result = run_trial(trial_configuration_path, frames_path, sweep_settings);
+        std::fflush(stdout);
+        ssize_t written = write(pipe_descriptors[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+      }
+      close(pipe_descriptors[1]);
+      if (pid < 0) {
+        std::cerr << "Could not start a worker" << std::endl;
+        close(pipe_descriptors[0]);
+        return 1;
+      }
+      running[pid] = {next_trial, pipe_descriptors[0]};
+      next_trial++;
+    }
+
+    int status;
+    pid_t pid = wait(&status);
+    auto worker = running.find(pid);
+    if (worker == running.end()) {
+      continue;
+    }
+    const size_t trial_index = worker->second.first;
+    TrialResult result;
+    if (read(worker->second.second, &result, sizeof(result)) == sizeof(result)) {
+      results.at(trial_index) = result;
+    }
+    close(worker->second.second);
+    running.erase(worker);
+
+    std::cout << "Trial " << trial_index << (results.at(trial_index).completed ? " done" : " FAILED")
+              << ", mean latency " << results.at(trial_index).mean_latency_ms << " ms, angle error "
+              << results.at(trial_index).mean_angle_error_deg << " deg" << std::endl;
+  }
+
+  std::vector<bool> on_front(trials.size(), false);
+  for (size_t i = 0; i < trials.size(); ++i) {
+    if (!results.at(i).completed || results.at(i).evaluated_frames == 0) {
+      continue;
+    }
+    on_front.at(i) = true;
+    for (size_t j = 0; j < trials.size() && on_front.at(i); ++j) {
+      if (results.at(j).completed && results.at(j).evaluated_frames > 0 && dominates(results.at(j), results.at(i))) {
+        on_front.at(i) = false;
+      }
+    }
+  }
+
+  std::ofstream results_file(output_path / "results.csv");
+  results_file << "trial";
+  for (const auto &parameter : parameters) {
+    results_file << "," << parameter.section << "." << parameter.key;
+  }
+  results_file << ",frames,pose_rate,evaluated_frames,mean_latency_ms,p95_latency_ms,mean_angle_error_deg,"
+                  "mean_position_error_meter,pareto" << std::endl;
+  for (size_t i = 0; i < trials.size(); ++i) {
+    const TrialResult &result = results.at(i);
+    results_file << i;
+    for (size_t p = 0; p < parameters.size(); ++p) {
+      results_file << "," << value_to_string(parameters.at(p).values.at(trials.at(i).at(p)));
+    }
+    results_file << "," << result.frames << "," << pose_rate(result) << "," << result.evaluated_frames << ","
+                 << result.mean_latency_ms << "," << result.p95_latency_ms << "," << result.mean_angle_error_deg
+                 << "," << result.mean_position_error_meter << "," << on_front.at(i) << std::endl;
+  }
+
+  std::vector<size_t> front;
+  for (size_t i = 0; i < trials.size(); ++i) {
+    if (on_front.at(i)) {
+      front.push_back(i);
+    }
+  }
+  std::sort(front.begin(), front.end(), [&results](size_t a, size_t b) {
+    return results.at(a).mean_latency_ms < results.at(b).mean_latency_ms;
+  });
+
+  std::cout << "Pareto front, by mean latency:" << std::endl;
+  for (size_t i : front) {
+    std::cout << "  Trial " << i << ": " << results.at(i).mean_latency_ms << " ms (p95 "
+              << results.at(i).p95_latency_ms << "), " << results.at(i).mean_angle_error_deg << " deg, "
+              << results.at(i).mean_position_error_meter << " m, pose rate " << pose_rate(results.at(i)) << std::endl;
+    for (size_t p = 0; p < parameters.size(); ++p) {
+      std::cout << "    " << parameters.at(p).section << "." << parameters.at(p).key << " = "
+                << value_to_string(parameters.at(p).values.at(trials.at(i).at(p))) << std::endl;
+    }
+  }
+  return front.empty() ? 1 : 0;
+}
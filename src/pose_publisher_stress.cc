@@ -0,0 +1,105 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Stress test of the PosePublisher seqlock. One writer publishes results whose fields are all derived from the
+//! frame number while several readers poll read_latest and a callback receives them. Every copy must be a whole
+//! result and the frame numbers seen by a reader must never go back. Build with -fsanitize=thread to also check for
+//! data races.
+//!
+//! Usage: pose_publisher_stress [results] [readers]
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "PosePublisher/PosePublisher.h"
+
+namespace {
+
+constexpr uint64_t default_results = 1000000;
+constexpr uint32_t default_readers = 4;
+
+PoseResult make_result(uint64_t frame_number) {
+  PoseResult result;
+  result.frame_number = frame_number;
+  result.timestamp_seconds = static_cast<double>(frame_number);
+  result.valid = frame_number % 2 == 0;
+  for (int i = 0; i < 3; ++i) {
+    result.position[i] = static_cast<float>(frame_number % 1000 + i);  // TODO(simon) Magic number.
+    result.direction[i] = -result.position[i];
+  }
+  result.roi_points = static_cast<uint32_t>(frame_number);
+  return result;
+}
+
+//! A torn copy mixes fields of two results.
+bool is_whole(const PoseResult &result) {
+  const PoseResult expected = make_result(result.frame_number);
+  for (int i = 0; i < 3; ++i) {
+    if (result.position[i] != expected.position[i] || result.direction[i] != expected.direction[i]) {
+      return false;
+    }
+  }
+  return result.timestamp_seconds == expected.timestamp_seconds && result.valid == expected.valid
+      && result.roi_points == expected.roi_points;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint64_t number_of_results = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : default_results;
+  const uint32_t number_of_readers = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : default_readers;
+
+  PosePublisher pose_publisher;
+  pose_publisher.setup_pose_publisher();
+
+  std::atomic<bool> writing{true};
+  std::atomic<uint64_t> torn_reads{0};
+  std::atomic<uint64_t> backward_reads{0};
+  std::atomic<uint64_t> reads{0};
+  std::atomic<uint64_t> callbacks{0};
+
+  pose_publisher.register_callback([&](const PoseResult &result) {
+    if (!is_whole(result)) {
+      torn_reads++;
+    }
+    callbacks++;
+  });
+
+  std::vector<std::thread> readers;
+  for (uint32_t r = 0; r < number_of_readers; ++r) {
+    readers.emplace_back([&]() {
+      uint64_t last_frame_number = 0;
+      PoseResult result;
+      while (writing.load(std::memory_order_relaxed)) {
+        if (!pose_publisher.read_latest(&result)) {
+          continue;
+        }
+        if (!is_whole(result)) {
+          torn_reads++;
+        }
+        if (result.frame_number < last_frame_number) {
+          backward_reads++;
+        }
+        last_frame_number = result.frame_number;
+        reads++;
+      }
+    });
+  }
+
+  for (uint64_t frame_number = 1; frame_number <= number_of_results; ++frame_number) {
+    pose_publisher.publish(make_result(frame_number));
+  }
+  writing = false;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  pose_publisher.shutdown();
+
+  std::cout << "Published " << number_of_results << ", reads " << reads << ", callbacks " << callbacks
+            << ", torn " << torn_reads << ", backwards " << backward_reads << std::endl;
+  return torn_reads == 0 && backward_reads == 0 ? 0 : 1;
+}
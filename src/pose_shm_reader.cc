@@ -0,0 +1,148 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Reads the shared memory pose export of a running realtime_pose_estimation. Every new pose record is printed, and
+//! with a preview path the latest preview image is written to that file whenever it changes.
+//!
+//! Usage: pose_shm_reader [shared_memory_name] [preview_path]
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "PoseExport/PoseExportLayout.h"
+
+namespace {
+
+constexpr char default_shared_memory_name[] = "/realtime_pose_estimation";
+constexpr uint32_t wait_timeout_ms = 1000;
+constexpr float milliseconds_per_second = 1000;
+constexpr uint8_t maximum_read_attempts = 16;
+
+void print_record(const pose_export::PoseRecord &record) {
+  std::cout << "source " << record.source_id << " frame " << record.frame_number << " t " << record.timestamp_seconds;
+  if (record.flags & pose_export::kPoseValid) {
+    std::cout << " pose " << record.position[0] << " " << record.position[1] << " " << record.position[2]
+              << " yaw " << record.yaw_radians;
+  } else {
+    std::cout << " no pose";
+  }
+  if (record.flags & pose_export::kFilteredPoseValid) {
+    std::cout << " filtered " << record.filtered_position[0] << " " << record.filtered_position[1] << " "
+              << record.filtered_position[2] << " yaw " << record.filtered_yaw_radians;
+  }
+  std::cout << " conf " << record.detection_confidence << " pose conf " << record.pose_confidence
+            << " roi " << record.roi_points << " latency " << record.latency_seconds * milliseconds_per_second << " ms"
+            << (record.timestamp_mapping == 0 ? " (host)" : "") << std::endl;
+}
+
+//! Copies the preview out under its seqlock, returns false if it is empty or was being written.
+bool read_preview(const pose_export::PreviewSlot &preview, std::vector<unsigned char> *data, uint64_t *sequence) {
+  const uint64_t sequence_before = preview.sequence.load(std::memory_order_acquire);
+  if ((sequence_before & 1) || sequence_before == 0 || preview.size_bytes > pose_export::preview_capacity_bytes) {
+    return false;
+  }
+  data->assign(preview.data, preview.data + preview.size_bytes);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (preview.sequence.load(std::memory_order_relaxed) != sequence_before) {
+    return false;
+  }
+  *sequence = sequence_before;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const std::string shared_memory_name = argc > 1 ? argv[1] : default_shared_memory_name;
+  const std::string preview_path = argc > 2 ? argv[2] : "";
+
+  int file_descriptor = shm_open(shared_memory_name.c_str(), O_RDONLY, 0);
+  if (file_descriptor < 0) {
+    std::cerr << "Could not open " << shared_memory_name << ": " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0
+      || static_cast<size_t>(file_status.st_size) < sizeof(pose_export::SharedMemory)) {
+    std::cerr << "Shared memory is smaller than this reader's layout" << std::endl;
+    close(file_descriptor);
+    return 1;
+  }
+  //! Read only mapping, but the futex word is waited on, which only needs read access.
+  void *address = mmap(nullptr, sizeof(pose_export::SharedMemory), PROT_READ, MAP_SHARED, file_descriptor, 0);
+  close(file_descriptor);
+  if (address == MAP_FAILED) {
+    std::cerr << "mmap: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  auto *shared_memory = static_cast<pose_export::SharedMemory *>(address);
+  auto &header = shared_memory->header;
+
+  if (header.magic.load(std::memory_order_acquire) != pose_export::magic
+      || header.layout_version != pose_export::layout_version
+      || header.record_size != sizeof(pose_export::PoseRecord)) {
+    std::cerr << "Layout mismatch, writer version " << header.layout_version << ", reader version "
+              << pose_export::layout_version << std::endl;
+    return 1;
+  }
+
+  uint64_t read_count = header.write_count.load(std::memory_order_acquire);
+  uint64_t preview_sequence = 0;
+  uint64_t dropped_records = 0;
+  std::vector<unsigned char> preview_data;
+
+  while (header.writer_alive.load(std::memory_order_acquire)) {
+    const uint32_t notify = header.notify.load(std::memory_order_acquire);
+    const uint64_t write_count = header.write_count.load(std::memory_order_acquire);
+
+    if (write_count < read_count) {  //! Only a new writer restarts the count, follow it from its newest record.
+      std::cerr << "Write count went back from " << read_count << " to " << write_count << ", resynchronizing"
+                << std::endl;
+      read_count = write_count;
+    }
+    if (write_count - read_count > pose_export::ring_capacity) {  //! Overwritten before we got to them.
+      dropped_records += write_count - read_count - pose_export::ring_capacity;
+      read_count = write_count - pose_export::ring_capacity;
+      std::cerr << "Dropped records: " << dropped_records << std::endl;
+    }
+
+    for (; read_count < write_count; ++read_count) {
+      pose_export::PoseRecord record;
+      const auto &slot = shared_memory->records[read_count % pose_export::ring_capacity];
+      bool is_read = false;
+      for (uint8_t attempt = 0; attempt < maximum_read_attempts && !is_read; ++attempt) {
+        is_read = pose_export::read_record(slot, read_count, &record);
+      }
+      if (is_read) {
+        print_record(record);
+      } else if (slot.sequence.load(std::memory_order_acquire) > pose_export::expected_sequence(read_count)) {
+        ++dropped_records;  //! Overwritten while we were reading it.
+        std::cerr << "Dropped records: " << dropped_records << std::endl;
+      }
+    }
+
+    uint64_t sequence;
+    if (!preview_path.empty() && shared_memory->preview.sequence.load(std::memory_order_acquire) != preview_sequence
+        && read_preview(shared_memory->preview, &preview_data, &sequence)) {
+      preview_sequence = sequence;
+      std::ofstream preview_file(preview_path, std::ios_base::binary | std::ios_base::trunc);
+      preview_file.write(reinterpret_cast<const char *>(preview_data.data()), preview_data.size());
+    }
+
+    pose_export::wait_for_writer(&header.notify, notify, wait_timeout_ms);
+  }
+
+  std::cout << "Writer stopped" << std::endl;
+  munmap(address, sizeof(pose_export::SharedMemory));
+  return 0;
+}
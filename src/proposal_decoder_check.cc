@@ -0,0 +1,42 @@
+// Copyright 2022 Simon Erik Nylund.
+// Author: snenyl
+
+//! Checks that the specialized YOLOX proposal decoders give bit identical proposals to the generic decoder. Random
+//! network outputs are decoded for every class count and input size below, no model or camera is needed.
+//!
+//! Usage: proposal_decoder_check [outputs_per_case]
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+#include "ObjectDetection/ObjectDetection.h"
+
+namespace {
+
+constexpr uint32_t default_outputs_per_case = 20;
+constexpr float prob_threshold = 0.3;  // TODO(simon) Magic number.
+constexpr uint16_t class_counts[] = {1, 2, 3};  //! 3 has no specialization and checks the generic fallback.
+constexpr dimensions input_sizes[] = {{640, 640}, {640, 384}, {416, 256}};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t outputs_per_case = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : default_outputs_per_case;
+
+  uint32_t failed_cases = 0;
+  uint32_t seed = 0;
+  for (uint16_t number_of_classes : class_counts) {
+    for (const dimensions &input_size : input_sizes) {
+      ObjectDetection object_detection;
+      object_detection.set_network_settings(ObjectDetection::inference_device_name_, number_of_classes);
+      object_detection.set_network_input_dimensions(input_size.width, input_size.height);
+      const bool identical = object_detection.check_proposal_decoder(outputs_per_case, seed++, prob_threshold);
+      std::cout << number_of_classes << " classes, " << input_size.width << "x" << input_size.height << ", "
+                << (object_detection.is_proposal_decoder_specialized() ? "specialized" : "generic") << ": "
+                << (identical ? "identical" : "DIFFERENT") << std::endl;
+      failed_cases += identical ? 0 : 1;
+    }
+  }
+  return failed_cases == 0 ? 0 : 1;
+}